@@ -33,6 +33,11 @@ size is 1,2,4, or 8 bytes per number depending on the type.
 of a certain type. Storage size is 4 or 8 bytes per number depending on
 the type. Nan, -inf, and +inf values are supported.
 
+* Q16, Q24, Q32 -- Quantized (lossy) floating-point types. Values are
+stored as 2, 3 or 4-byte signed integer codes, value = offset + scale*code.
+Scale and offset are database parameters. Smallest codes are used for NaN
+and -inf, the largest one for +inf.
+
 Changes/fixed errors since graphene 2.8:
 - parsing INT8 and UINT8 data
 - empty text is allowed
@@ -51,6 +56,9 @@ graphene_dtype_parse(const std::string & s){
   if (strcasecmp(s.c_str(), "UINT64")==0) return DATA_UINT64;
   if (strcasecmp(s.c_str(), "FLOAT")==0)  return DATA_FLOAT;
   if (strcasecmp(s.c_str(), "DOUBLE")==0) return DATA_DOUBLE;
+  if (strcasecmp(s.c_str(), "Q16")==0)    return DATA_Q16;
+  if (strcasecmp(s.c_str(), "Q24")==0)    return DATA_Q24;
+  if (strcasecmp(s.c_str(), "Q32")==0)    return DATA_Q32;
   throw Err() << "Unknown data type: " << s;
 }
 
@@ -68,6 +76,9 @@ graphene_dtype_name(const DataType dtype){
     case DATA_UINT64:  return "UINT64";
     case DATA_FLOAT:   return "FLOAT";
     case DATA_DOUBLE:  return "DOUBLE";
+    case DATA_Q16:     return "Q16";
+    case DATA_Q24:     return "Q24";
+    case DATA_Q32:     return "Q32";
     default: throw Err() << "Unknown data type: " << dtype;
   }
 }
@@ -86,14 +97,85 @@ graphene_dtype_size(const DataType dtype){
     case DATA_UINT64:  return 8;
     case DATA_FLOAT:   return 4;
     case DATA_DOUBLE:  return 8;
+    case DATA_Q16:     return 2;
+    case DATA_Q24:     return 3;
+    case DATA_Q32:     return 4;
     default: throw Err() << "Unknown data type: " << dtype;
   }
 }
 
+bool
+graphene_dtype_quant(const DataType dtype){
+  return dtype==DATA_Q16 || dtype==DATA_Q24 || dtype==DATA_Q32;
+}
+
+/********************************************************************/
+// Quantized codes. Codes are signed integers in the range -qmax-1..qmax:
+// -qmax-1 is NaN, -qmax is -inf, qmax is +inf.
+
+static int32_t
+q_max(const DataType dtype){
+  switch (dtype){
+    case DATA_Q16: return 0x7FFF;
+    case DATA_Q24: return 0x7FFFFF;
+    case DATA_Q32: return 0x7FFFFFFF;
+    default: throw Err() << "Unexpected data format";
+  }
+}
+
+// Get i-th code as a double value (NaN or inf for special codes).
+static double
+q_get(const std::string & s, const size_t i, const DataType dtype){
+  int32_t c;
+  switch (dtype){
+    case DATA_Q16: c = ((int16_t *)s.data())[i]; break;
+    case DATA_Q24: {
+      const uint8_t * p = (const uint8_t *)s.data() + 3*i;
+      c = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16));
+      if (c & 0x800000) c -= 0x1000000; // sign
+      break;
+    }
+    case DATA_Q32: c = ((int32_t *)s.data())[i]; break;
+    default: throw Err() << "Unexpected data format";
+  }
+  int32_t m = q_max(dtype);
+  if (c == -m-1) return NAN;
+  if (c == -m)   return -INFINITY;
+  if (c ==  m)   return +INFINITY;
+  return c;
+}
+
+// Put i-th code (rounded double value, NaN and inf are allowed).
+// Return false if the value is out of range.
+static bool
+q_put(std::string & s, const size_t i, const DataType dtype, const double v){
+  int32_t m = q_max(dtype);
+  int32_t c;
+  if (std::isnan(v)) c = -m-1;
+  else if (std::isinf(v)) c = v<0 ? -m : m;
+  else {
+    double r = std::round(v);
+    if (r <= -m || r >= m) return false;
+    c = (int32_t)r;
+  }
+  switch (dtype){
+    case DATA_Q16: ((int16_t *)s.data())[i] = c; break;
+    case DATA_Q24: {
+      uint8_t * p = (uint8_t *)s.data() + 3*i;
+      p[0] = c & 0xFF; p[1] = (c>>8) & 0xFF; p[2] = (c>>16) & 0xFF;
+      break;
+    }
+    case DATA_Q32: ((int32_t *)s.data())[i] = c; break;
+    default: throw Err() << "Unexpected data format";
+  }
+  return true;
+}
+
 /********************************************************************/
 
 std::string
-graphene_data_parse(const std::vector<std::string> & strs, const DataType dtype){
+graphene_data_parse(const std::vector<std::string> & strs, const DataType dtype,
+                    const DataQuant & quant){
 
   // TEXT: join all data
   if (dtype == DATA_TEXT){
@@ -200,6 +282,26 @@ graphene_data_parse(const std::vector<std::string> & strs, const DataType dtype)
             getline(s, tmp); break;
           }
           s >> ((double*)ret.data())[i]; break;
+
+        case DATA_Q16:
+        case DATA_Q24:
+        case DATA_Q32: {
+          double v;
+          if (strcasecmp(strs[i].c_str(),"inf")==0 ||
+              strcasecmp(strs[i].c_str(),"+inf")==0) {
+            v = +INFINITY; getline(s, tmp);
+          }
+          else if (strcasecmp(strs[i].c_str(),"-inf")==0) {
+            v = -INFINITY; getline(s, tmp);
+          }
+          else if (strcasecmp(strs[i].c_str(),"nan")==0) {
+            v = NAN; getline(s, tmp);
+          }
+          else s >> v;
+          if (!s.fail() && !q_put(ret, i, dtype, (v-quant.offset)/quant.scale))
+            throw Err() << graphene_dtype_name(dtype) << " value out of range: " << strs[i];
+          break;
+        }
         default: throw Err() << "Unexpected data format";
       }
 
@@ -211,7 +313,8 @@ graphene_data_parse(const std::vector<std::string> & strs, const DataType dtype)
 }
 
 std::vector<std::string>
-graphene_data_print(const std::string & s, const int col, const DataType dtype){
+graphene_data_print(const std::string & s, const int col, const DataType dtype,
+                    const DataQuant & quant){
   std::vector<std::string> ret;
 
   if (dtype == DATA_TEXT) {
@@ -246,6 +349,12 @@ graphene_data_print(const std::string & s, const int col, const DataType dtype){
       // We use one less digit to have round values (3.1415 instead of 3.1415000
       case DATA_FLOAT:  ostr << std::setprecision(8)  << ((float  *)s.data())[i]; break;
       case DATA_DOUBLE: ostr << std::setprecision(16) << ((double *)s.data())[i]; break;
+      case DATA_Q16:
+      case DATA_Q24:
+      // Codes have at most 10 digits, 15 digits are enough for any
+      // scale/offset and hide rounding errors of the conversion.
+      case DATA_Q32:
+        ostr << std::setprecision(15) << quant.offset + quant.scale*q_get(s,i,dtype); break;
       default: throw Err() << "Unexpected data format";
     }
     ret.push_back(ostr.str());
@@ -253,6 +362,39 @@ graphene_data_print(const std::string & s, const int col, const DataType dtype){
   return ret;
 }
 
+std::vector<double>
+graphene_data_values(const std::string & s, const DataType dtype,
+                     const DataQuant & quant){
+  std::vector<double> ret;
+  if (dtype == DATA_TEXT) return ret;
+
+  size_t dsize = graphene_dtype_size(dtype);
+  if (s.size() % dsize != 0)
+    throw Err() << "Broken database: wrong data length";
+  size_t cn = s.size()/dsize;
+  ret.resize(cn);
+
+  for (size_t i=0; i<cn; i++){
+    switch (dtype){
+      case DATA_INT8:   ret[i] = ((int8_t   *)s.data())[i]; break;
+      case DATA_UINT8:  ret[i] = ((uint8_t  *)s.data())[i]; break;
+      case DATA_INT16:  ret[i] = ((int16_t  *)s.data())[i]; break;
+      case DATA_UINT16: ret[i] = ((uint16_t *)s.data())[i]; break;
+      case DATA_INT32:  ret[i] = ((int32_t  *)s.data())[i]; break;
+      case DATA_UINT32: ret[i] = ((uint32_t *)s.data())[i]; break;
+      case DATA_INT64:  ret[i] = ((int64_t  *)s.data())[i]; break;
+      case DATA_UINT64: ret[i] = ((uint64_t *)s.data())[i]; break;
+      case DATA_FLOAT:  ret[i] = ((float    *)s.data())[i]; break;
+      case DATA_DOUBLE: ret[i] = ((double   *)s.data())[i]; break;
+      case DATA_Q16:
+      case DATA_Q24:
+      case DATA_Q32:    ret[i] = quant.offset + quant.scale*q_get(s,i,dtype); break;
+      default: throw Err() << "Unexpected data format";
+    }
+  }
+  return ret;
+}
+
 
 /********************************************************************/
 /*
@@ -601,6 +743,35 @@ graphene_time_add(const std::string & t1, const std::string & t2,
   throw Err() << "Unknown time type: " << ttype;
 }
 
+uint64_t
+graphene_time_to_units(const std::string & t, const TimeType ttype){
+  switch (ttype){
+    case TIME_V1: return graphene_time_unpack_v1(t);
+    case TIME_V2: {
+      uint64_t v = graphene_time_unpack_v2(t);
+      return (v >> 32)*1000000000 + (v & 0xFFFFFFFF);
+    }
+  }
+  throw Err() << "Unknown time type: " << ttype;
+}
+
+std::string
+graphene_time_from_units(const uint64_t u, const TimeType ttype){
+  switch (ttype){
+    case TIME_V1: {
+      std::string ret(sizeof(uint64_t), '\0');
+      *(uint64_t *)ret.data() = u;
+      return ret;
+    }
+    case TIME_V2: {
+      uint64_t s = u/1000000000;
+      if (s >= ((uint64_t)1<<32)) throw Err() << "Bad timestamp: too large value";
+      return graphene_time_pack_v2((s<<32) + u%1000000000);
+    }
+  }
+  throw Err() << "Unknown time type: " << ttype;
+}
+
 std::string
 graphene_time_print(const std::string & t, const TimeType ttype,
                     const TimeFMT tfmt, const std::string & t0){
@@ -675,7 +846,12 @@ graphene_interpolate(
         ((double*)v0.data())[i] = ((double*)v1.data())[i]*k
                                 + ((double*)v2.data())[i]*(1-k);
         break;
-      default: throw Err() << "FLOAT or DOUBLE data expected for interpolation";
+      case DATA_Q16:
+      case DATA_Q24:
+      case DATA_Q32:
+        q_put(v0, i, dtype, q_get(v1,i,dtype)*k + q_get(v2,i,dtype)*(1-k));
+        break;
+      default: throw Err() << "FLOAT, DOUBLE or quantized data expected for interpolation";
     }
   }
   return v0;
@@ -698,12 +874,26 @@ graphene_spp_text(const std::string & data){
   return out;
 }
 
+std::string
+graphene_utf8_cut(const std::string & data){
+  // find the first byte of the last character
+  size_t p = data.size(), n = 0;
+  while (p>0 && n<4 && ((unsigned char)data[p-1] & 0xC0) == 0x80) { p--; n++; }
+  if (p==0) return data;
+  unsigned char c = data[p-1];
+  size_t len = c<0x80? 1 : (c & 0xE0)==0xC0? 2 :
+               (c & 0xF0)==0xE0? 3 : (c & 0xF8)==0xF0? 4 : 0;
+  if (len==0 || n+1>=len) return data; // not UTF-8 or complete character
+  return data.substr(0, p-1);
+}
+
 /***********************************************************/
 void
 check_name(const std::string & name){
-  static const char *reject = ".:+| \n\t/";
+  // '%' is reserved for partition and archive names
+  static const char *reject = ".:+|% \n\t/";
   if (strcspn(name.c_str(), reject)!=name.length())
-    throw Err() << "symbols '.:+| \\n\\t/' are not allowed in the database name: " << name;
+    throw Err() << "symbols '.:+|% \\n\\t/' are not allowed in the database name: " << name;
 }
 
 std::string
@@ -11,7 +11,16 @@
 enum DataType { DATA_TEXT,
          DATA_INT8, DATA_UINT8, DATA_INT16, DATA_UINT16,
          DATA_INT32, DATA_UINT32, DATA_INT64, DATA_UINT64,
-         DATA_FLOAT, DATA_DOUBLE};
+         DATA_FLOAT, DATA_DOUBLE,
+         DATA_Q16, DATA_Q24, DATA_Q32};
+
+// Scale and offset for quantized data types (Q16, Q24, Q32):
+// value = offset + scale*code
+struct DataQuant {
+  double scale, offset;
+  DataQuant(const double scale_ = 1, const double offset_ = 0):
+    scale(scale_), offset(offset_) {}
+};
 
 // Convert string into DataType number.
 DataType graphene_dtype_parse(const std::string & s);
@@ -23,21 +32,35 @@ std::string graphene_dtype_name(const DataType dtype);
 // For TEXT 1 is returned.
 size_t graphene_dtype_size(const DataType dtype);
 
+// Is the data type quantized (Q16, Q24, Q32)?
+bool graphene_dtype_quant(const DataType dtype);
+
 // Parse and pack data.
 // Data is coming from user interface as a vector<string>.
 // On output std::string is used as a convenient storage, which
 // can be easily converted into Berkleydb data.
 // Output string is not a c-string, it may contain zeros!
+// Quantization parameters are used only for quantized types.
 std::string graphene_data_parse(
   const std::vector<std::string> & strs,
-  const DataType dtype
+  const DataType dtype,
+  const DataQuant & quant = DataQuant()
 );
 
 // Print packed data for output
 std::vector<std::string> graphene_data_print(
   const std::string & s,
   const int col,
-  const DataType dtype
+  const DataType dtype,
+  const DataQuant & quant = DataQuant()
+);
+
+// Unpack numeric data as double values (one for each column).
+// For TEXT data empty vector is returned.
+std::vector<double> graphene_data_values(
+  const std::string & s,
+  const DataType dtype,
+  const DataQuant & quant = DataQuant()
 );
 
 
@@ -99,6 +122,16 @@ std::string graphene_time_add(
   const TimeType ttype);
 
 
+// Convert packed timestamp to an integer number of time units
+// (milliseconds for TIME_V1, nanoseconds for TIME_V2) and back.
+uint64_t graphene_time_to_units(
+  const std::string & t,
+  const TimeType ttype);
+
+std::string graphene_time_from_units(
+  const uint64_t u,
+  const TimeType ttype);
+
 // Print timestamp.
 // t0 is the reference time for relative output (non-parsed text string!).
 std::string graphene_time_print(
@@ -110,8 +143,10 @@ std::string graphene_time_print(
 
 /********************************************************************/
 
-// Interpolate data (for FLOAT and DOUBLE values).
+// Interpolate data (for FLOAT, DOUBLE and quantized values).
 // Arguments k0,k1,k2,v1,v2 and return value are packed strings!
+// Quantized values are interpolated in integer codes (scale and
+// offset are not needed).
 
 std::string graphene_interpolate(
         const std::string & k0,
@@ -124,6 +159,10 @@ std::string graphene_interpolate(
 // Protect # symbol in beginning of each line for SPP protocol
 std::string graphene_spp_text(const std::string & data);
 
+// Remove an incomplete UTF-8 character at the end of a string
+// (text values which were read partially).
+std::string graphene_utf8_cut(const std::string & data);
+
 /***********************************************************/
 // Check database or filter name
 // All names (not only for reading/writing, but
@@ -12,7 +12,8 @@
 
 // analog of graphene_data_parse but with a single string argument
 std::string
-graphene_data_parse_str(const std::string & input, const DataType dtype){
+graphene_data_parse_str(const std::string & input, const DataType dtype,
+                        const DataQuant & quant = DataQuant()){
   // split input
   std::vector<std::string> args;
 
@@ -30,13 +31,14 @@ graphene_data_parse_str(const std::string & input, const DataType dtype){
     }
   }
 
-  return graphene_data_parse(args, dtype);
+  return graphene_data_parse(args, dtype, quant);
 }
 
 // analog of graphene_data_print but with a single string return value
 std::string
-graphene_data_print_str(const std::string & input, const int col, const DataType dtype){
-  auto data = graphene_data_print(input, col, dtype);
+graphene_data_print_str(const std::string & input, const int col, const DataType dtype,
+                        const DataQuant & quant = DataQuant()){
+  auto data = graphene_data_print(input, col, dtype, quant);
 
   std::string ret;
   for (auto const & d:data){
@@ -67,6 +69,9 @@ int main() {
     assert_eq(graphene_dtype_size(DATA_UINT64), 8);
     assert_eq(graphene_dtype_size(DATA_FLOAT),  4);
     assert_eq(graphene_dtype_size(DATA_DOUBLE), 8);
+    assert_eq(graphene_dtype_size(DATA_Q16),    2);
+    assert_eq(graphene_dtype_size(DATA_Q24),    3);
+    assert_eq(graphene_dtype_size(DATA_Q32),    4);
 
     assert_eq(graphene_dtype_name(DATA_TEXT),   "TEXT"  );
     assert_eq(graphene_dtype_name(DATA_INT8),   "INT8"  );
@@ -79,6 +84,9 @@ int main() {
     assert_eq(graphene_dtype_name(DATA_UINT64), "UINT64");
     assert_eq(graphene_dtype_name(DATA_FLOAT),  "FLOAT" );
     assert_eq(graphene_dtype_name(DATA_DOUBLE), "DOUBLE");
+    assert_eq(graphene_dtype_name(DATA_Q16),    "Q16");
+    assert_eq(graphene_dtype_name(DATA_Q24),    "Q24");
+    assert_eq(graphene_dtype_name(DATA_Q32),    "Q32");
 
     assert_eq(graphene_ttype_name(TIME_V1),  "TIME_V1" );
     assert_eq(graphene_ttype_name(TIME_V2),  "TIME_V2");
@@ -97,6 +105,9 @@ int main() {
     assert_eq(DATA_UINT64, graphene_dtype_parse("UINT64"));
     assert_eq(DATA_FLOAT,  graphene_dtype_parse("FLOAT" ));
     assert_eq(DATA_DOUBLE, graphene_dtype_parse("DOUBLE"));
+    assert_eq(DATA_Q16,    graphene_dtype_parse("Q16"));
+    assert_eq(DATA_Q24,    graphene_dtype_parse("q24"));
+    assert_eq(DATA_Q32,    graphene_dtype_parse("Q32"));
 
     assert_eq(TIME_V1,  graphene_ttype_parse("TIME_V1" ));
     assert_eq(TIME_V2,  graphene_ttype_parse("TIME_V2" ));
@@ -367,6 +378,37 @@ int main() {
     assert_err(graphene_data_parse_str("", DATA_DOUBLE),
       "Some data expected");
 
+    // quantized
+    {
+      DataQuant q(0.001, 10);
+      s = graphene_data_parse_str("10 10.0014 9.9986 -inf +Inf Nan", DATA_Q16, q);
+      assert_eq(s.size(), 6*2);
+      assert_eq(((int16_t *)s.data())[1], 1);
+      assert_eq(((int16_t *)s.data())[2], -1);
+      assert_eq(graphene_data_print_str(s, -1, DATA_Q16, q), "10 10.001 9.999 -inf inf nan");
+      assert_eq(graphene_data_print_str(s, 1, DATA_Q16, q), "10.001");
+      auto vv = graphene_data_values(s, DATA_Q16, q);
+      assert_eq(vv.size(), 6);
+      assert_feq(vv[2], 9.999, 1e-9);
+
+      assert_err(graphene_data_parse_str("1 42.767", DATA_Q16, q),
+        "Q16 value out of range: 42.767");
+      assert_eq(graphene_data_print_str(graphene_data_parse_str("42.766", DATA_Q16, q), -1, DATA_Q16, q), "42.766");
+      assert_err(graphene_data_parse_str("1 a", DATA_Q16, q),
+        "Bad Q16 value: a");
+
+      // 24-bit codes, negative values
+      s = graphene_data_parse_str("-8000 0.5 8388.606", DATA_Q24, q);
+      assert_eq(s.size(), 3*3);
+      assert_eq(graphene_data_print_str(s, -1, DATA_Q24, q), "-8000 0.5 8388.606");
+      assert_err(graphene_data_parse_str("8400", DATA_Q24, q),
+        "Q24 value out of range: 8400");
+
+      s = graphene_data_parse_str("-1e6 1e6", DATA_Q32, q);
+      assert_eq(s.size(), 2*4);
+      assert_eq(graphene_data_print_str(s, -1, DATA_Q32, q), "-1000000 1000000");
+    }
+
 
     // text
     {
@@ -414,6 +456,17 @@ int main() {
       assert_eq(graphene_data_print_str(graphene_data_parse(v2, DATA_TEXT), 0, DATA_TEXT), "3.1415 6.2830");
       assert_eq(graphene_data_print_str(graphene_data_parse(v2, DATA_TEXT), 1, DATA_TEXT), "3.1415 6.2830");
       assert_eq(graphene_data_print_str(graphene_data_parse(v2, DATA_TEXT), 2, DATA_TEXT), "3.1415 6.2830");
+
+      // numeric values
+      auto vv = graphene_data_values(graphene_data_parse(v1, DATA_INT32), DATA_INT32);
+      assert_eq(vv.size(), 2);
+      assert_eq(vv[0], 314);
+      assert_eq(vv[1], 628);
+      vv = graphene_data_values(graphene_data_parse(v2, DATA_FLOAT), DATA_FLOAT);
+      assert_eq(vv.size(), 2);
+      assert_eq(vv[0], (float)3.1415);
+      vv = graphene_data_values(graphene_data_parse(v2, DATA_TEXT), DATA_TEXT);
+      assert_eq(vv.size(), 0);
     }
 
     /**************************************************************/
@@ -462,6 +515,17 @@ int main() {
       assert_eq(d.size(), 2*sizeof(float));
       assert_feq(((float *)d.data())[0], 0.4, 1e-6);
       assert_feq(((float *)d.data())[1], 1.4, 1e-6);
+
+      // quantized values are interpolated in codes
+      DataQuant q(0.1, 0);
+      d = graphene_interpolate(
+        graphene_time_parse("1.1", tt),
+        graphene_time_parse("1.0", tt),
+        graphene_time_parse("1.4", tt),
+        graphene_data_parse_str("0.2 1.2 nan", DATA_Q24, q),
+        graphene_data_parse_str("1.0 2.0 1", DATA_Q24, q), tt, DATA_Q24);
+      assert_eq(d.size(), 3*3);
+      assert_eq(graphene_data_print_str(d, -1, DATA_Q24, q), "0.4 1.4 nan");
     }
 
     {
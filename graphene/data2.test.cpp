@@ -491,6 +491,25 @@ int main() {
       graphene_time_parse("inf", tt), tt),
       graphene_time_parse("inf", tt));
 
+    /**************************************************************/
+    // Time units
+    /**************************************************************/
+
+    tt = TIME_V1;
+    assert_eq(graphene_time_to_units(graphene_time_parse("1.25", tt), tt), 1250);
+    assert_eq(graphene_time_from_units(1250, tt), graphene_time_parse("1.25", tt));
+
+    tt = TIME_V2;
+    assert_eq(graphene_time_to_units(graphene_time_parse("1.25", tt), tt), 1250000000);
+    assert_eq(graphene_time_from_units(1250000000, tt), graphene_time_parse("1.25", tt));
+    assert_eq(graphene_time_from_units(3000000000, tt), graphene_time_parse("3", tt));
+    assert_eq(graphene_time_from_units(
+      graphene_time_to_units(graphene_time_parse("inf", tt), tt), tt),
+      graphene_time_parse("inf", tt));
+    assert_err(graphene_time_from_units(
+      graphene_time_to_units(graphene_time_parse("inf", tt), tt)+1, tt),
+      "Bad timestamp: too large value");
+
     /**************************************************************/
     // Time print
     /**************************************************************/
@@ -530,12 +549,24 @@ int main() {
       "#0 0.1 100.001\n#abc\n #cde\nff\n"),
       "##0 0.1 100.001\n##abc\n #cde\nff\n");
 
+    /**************************************************************/
+    // graphene_utf8_cut
+    /**************************************************************/
+    assert_eq(graphene_utf8_cut(""), "");
+    assert_eq(graphene_utf8_cut("abc"), "abc");
+    assert_eq(graphene_utf8_cut("a\xd0\xb6"), "a\xd0\xb6");        // complete 2-byte
+    assert_eq(graphene_utf8_cut("a\xd0"), "a");                    // cut 2-byte
+    assert_eq(graphene_utf8_cut("a\xe2\x82\xac"), "a\xe2\x82\xac");  // complete 3-byte
+    assert_eq(graphene_utf8_cut("a\xe2\x82"), "a");                // cut 3-byte
+    assert_eq(graphene_utf8_cut("a\xf0\x9f\x98"), "a");            // cut 4-byte
+    assert_eq(graphene_utf8_cut("a\x82\x82"), "a\x82\x82");        // not UTF-8
+
     /**************************************************************/
     // check_name
     /**************************************************************/
-    check_name("abcABCefz0123_,%");
+    check_name("abcABCefz0123_,");
 
-    std::string msg = "symbols '.:+| \\n\\t/' are not allowed in the database name: ";
+    std::string msg = "symbols '.:+|% \\n\\t/' are not allowed in the database name: ";
     assert_err(check_name("a b"), msg + "a b");
     assert_err(check_name("a.b"), msg + "a.b");
     assert_err(check_name("a:b"), msg + "a:b");
@@ -544,6 +575,7 @@ int main() {
     assert_err(check_name("a\n"), msg + "a\n");
     assert_err(check_name("a\t"), msg + "a\t");
     assert_err(check_name("//"), msg + "//");
+    assert_err(check_name("a%p1"), msg + "a%p1");
 
     int c,f;
     assert_eq(parse_ext_name("abc:1", c,f), "abc"); assert_eq(c, 1); assert_eq(f, -1);
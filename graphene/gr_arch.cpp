@@ -0,0 +1,543 @@
+/* Archives (cold tier): GrapheneArch reader and writer,
+   GrapheneDB methods for moving old data to archives and
+   reading it back.
+
+   GrapheneDB::archive moves points with t <= t2 to a new archive
+   file in the archive folder and adds it to the KEY_ARCH list.
+   Archives cover consecutive time ranges, all get* methods read
+   archived range from archives and newer data from the database.
+   Archived data can not be modified, whole archives are removed
+   by trim. Archive files are immutable: they are not written by
+   transactions and do not need checkpoints or database backups.
+*/
+
+#include <cerrno>
+#include <algorithm>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gr_arch.h"
+
+using namespace std;
+
+/************************************/
+// Writer
+
+GrapheneArchWriter::GrapheneArchWriter(const string & file_, const TimeType ttype_,
+                                       const DataType dtype_, const DataQuant & quant_):
+    f(NULL), file(file_), tmp(file_ + ".tmp"), ttype(ttype_), dtype(dtype_), quant(quant_){
+  f = fopen(tmp.c_str(), "wb");
+  if (!f) throw Err() << tmp << ": " << strerror(errno);
+  if (fwrite(GRARCH_MAGIC, 1, 8, f)!=8)
+    throw Err() << tmp << ": write error: " << strerror(errno);
+}
+
+GrapheneArchWriter::~GrapheneArchWriter(){
+  if (!f) return;
+  fclose(f);
+  remove(tmp.c_str());
+}
+
+void
+GrapheneArchWriter::flush(){
+  if (data.empty()) return;
+  idx.back().off = ftell(f);
+  grdump_write_block(f, tmp, data, true);
+  data.clear();
+}
+
+void
+GrapheneArchWriter::add(const string & k, const string & v){
+  if (data.empty()) {
+    idx.push_back(GrapheneArchBlock());
+    idx.back().n = 0;
+    idx.back().k1 = k;
+  }
+  uint32_t s[2] = {(uint32_t)k.size(), (uint32_t)v.size()};
+  data.append((char *)s, sizeof(s));
+  data.append(k);
+  data.append(v);
+  idx.back().k2 = k;
+  idx.back().n++;
+  if (dtype!=DATA_TEXT) st.add(k, graphene_data_values(v, dtype, quant), ttype);
+  else st.add(k, vector<double>(), ttype);
+  if (data.size() >= GRARCH_BLOCK) flush();
+}
+
+void
+GrapheneArchWriter::finish(){
+  flush();
+
+  // index, statistics, trailer
+  uint64_t ioff = ftell(f);
+  string b;
+  uint32_t nb = idx.size();
+  b.append((char *)&nb, sizeof(nb));
+  for (auto const & i: idx){
+    uint32_t s1 = i.k1.size(), s2 = i.k2.size();
+    b.append((char *)&i.off, sizeof(i.off));
+    b.append((char *)&i.n, sizeof(i.n));
+    b.append((char *)&s1, sizeof(s1));
+    b.append(i.k1);
+    b.append((char *)&s2, sizeof(s2));
+    b.append(i.k2);
+  }
+  string sp = st.pack(ttype);
+  uint32_t ss = sp.size();
+  b.append((char *)&ss, sizeof(ss));
+  b.append(sp);
+  b.append((char *)&ioff, sizeof(ioff));
+  b.append(GRARCH_MAGIC, 8);
+
+  bool ok = fwrite(b.data(), 1, b.size(), f) == b.size();
+  ok = fflush(f)==0 && ok;
+  ok = fsync(fileno(f))==0 && ok;
+  ok = fclose(f)==0 && ok;
+  f = NULL;
+  if (!ok || rename(tmp.c_str(), file.c_str())!=0){
+    int e = errno;
+    remove(tmp.c_str());
+    throw Err() << file << ": " << strerror(e);
+  }
+}
+
+/************************************/
+// Reader
+
+GrapheneArch::GrapheneArch(const string & file_, const TimeType ttype_):
+    file(file_), ttype(ttype_){
+  fd = open(file.c_str(), O_RDONLY);
+  if (fd<0) throw Err() << file << ": " << strerror(errno);
+  try {
+    struct stat sb;
+    if (fstat(fd, &sb)!=0) throw Err() << file << ": " << strerror(errno);
+
+    // trailer
+    char tr[16];
+    if (sb.st_size < 24 || pread(fd, tr, 16, sb.st_size-16)!=16 ||
+        memcmp(tr+8, GRARCH_MAGIC, 8)!=0)
+      throw Err() << file << ": not a graphene archive";
+    uint64_t ioff;
+    memcpy(&ioff, tr, sizeof(ioff));
+    if (ioff < 8 || ioff > (uint64_t)sb.st_size-16)
+      throw Err() << file << ": broken archive index";
+
+    // index and statistics
+    string b(sb.st_size-16-ioff, '\0');
+    if (pread(fd, &b[0], b.size(), ioff) != (ssize_t)b.size())
+      throw Err() << file << ": read error: " << strerror(errno);
+    size_t pos = 0;
+    auto get = [&](void *d, const size_t s){
+      if (pos + s > b.size()) throw Err() << file << ": broken archive index";
+      memcpy(d, b.data()+pos, s);
+      pos += s;
+    };
+    auto gets = [&](string & str){
+      uint32_t s;
+      get(&s, sizeof(s));
+      str.resize(s);
+      if (s) get(&str[0], s);
+    };
+    uint32_t nb;
+    get(&nb, sizeof(nb));
+    idx.resize(nb);
+    for (auto & i: idx){
+      get(&i.off, sizeof(i.off));
+      get(&i.n, sizeof(i.n));
+      gets(i.k1);
+      gets(i.k2);
+    }
+    string sp;
+    gets(sp);
+    st.unpack(sp, ttype);
+  }
+  catch (Err e){
+    ::close(fd);
+    throw e;
+  }
+}
+
+GrapheneArch::~GrapheneArch(){
+  ::close(fd);
+}
+
+void
+GrapheneArch::read_block(const size_t b, vector<pair<string, string> > & recs) const {
+  uint32_t h[3]; // size, stored size, crc
+  if (pread(fd, h, sizeof(h), idx[b].off) != sizeof(h))
+    throw Err() << file << ": unexpected end of file";
+  string buf(h[1], '\0'), data;
+  if (pread(fd, &buf[0], h[1], idx[b].off + sizeof(h)) != (ssize_t)h[1])
+    throw Err() << file << ": unexpected end of file";
+  grdump_decode_block(file, buf, h[0], h[2], true, data);
+
+  recs.clear();
+  size_t pos = 0;
+  while (pos < data.size()){
+    uint32_t s[2];
+    if (pos + sizeof(s) > data.size()) throw Err() << file << ": broken block";
+    memcpy(s, data.data()+pos, sizeof(s));
+    pos += sizeof(s);
+    if (pos + s[0] + s[1] > data.size()) throw Err() << file << ": broken block";
+    recs.emplace_back(data.substr(pos, s[0]), data.substr(pos+s[0], s[1]));
+    pos += s[0] + s[1];
+  }
+}
+
+size_t
+GrapheneArch::find(const string & tp) const {
+  auto tt = ttype;
+  return lower_bound(idx.begin(), idx.end(), tp,
+    [tt](const GrapheneArchBlock & b, const string & t){
+      return graphene_time_cmp(b.k2, t, tt)<0; }) - idx.begin();
+}
+
+bool
+GrapheneArch::get_next(const string & t1p, string & k, string & v) const {
+  size_t b = find(t1p);
+  if (b==idx.size()) return false;
+  vector<pair<string, string> > recs;
+  read_block(b, recs);
+  for (auto const & r: recs){
+    if (graphene_time_cmp(r.first, t1p, ttype)<0) continue;
+    k = r.first; v = r.second;
+    return true;
+  }
+  return false;
+}
+
+bool
+GrapheneArch::get_prev(const string & t2p, string & k, string & v) const {
+  // last block with first timestamp <= t2p
+  auto tt = ttype;
+  size_t b = upper_bound(idx.begin(), idx.end(), t2p,
+    [tt](const string & t, const GrapheneArchBlock & b){
+      return graphene_time_cmp(t, b.k1, tt)<0; }) - idx.begin();
+  if (b==0) return false;
+  vector<pair<string, string> > recs;
+  read_block(b-1, recs);
+  for (auto r = recs.rbegin(); r!=recs.rend(); ++r){
+    if (graphene_time_cmp(r->first, t2p, ttype)>0) continue;
+    k = r->first; v = r->second;
+    return true;
+  }
+  return false;
+}
+
+uint64_t
+GrapheneArch::get_range(const string & t1p, const string & t2p,
+                        const string & dtp, const uint64_t cnt, const DataType dtype,
+                        GrapheneFormatter & out, string & last) const {
+  bool every = graphene_time_zero(dtp, ttype);
+  string tgp = t1p; // target time for the next point
+  uint64_t n = 0;
+  vector<pair<string, string> > recs;
+  for (size_t b = find(t1p); b<idx.size(); b++){
+    if (graphene_time_cmp(idx[b].k1, t2p, ttype)>0) break;
+    if (graphene_time_cmp(idx[b].k2, tgp, ttype)<0) continue; // skip blocks by dt
+    read_block(b, recs);
+    for (auto const & r: recs){
+      if (graphene_time_cmp(r.first, tgp, ttype)<0) continue;
+      if (graphene_time_cmp(r.first, t2p, ttype)>0) return n;
+      out.proc_point(r.first, r.second, ttype, dtype);
+      last = r.first;
+      n++;
+      if (cnt && n>=cnt) return n;
+      if (!every) tgp = graphene_time_add(last, dtp, ttype);
+    }
+  }
+  return n;
+}
+
+uint64_t
+GrapheneArch::count_range(const string & t1p, const string & t2p) const {
+  uint64_t n = 0;
+  vector<pair<string, string> > recs;
+  for (size_t b = find(t1p); b<idx.size(); b++){
+    if (graphene_time_cmp(idx[b].k1, t2p, ttype)>0) break;
+    if (graphene_time_cmp(idx[b].k1, t1p, ttype)>=0 &&
+        graphene_time_cmp(idx[b].k2, t2p, ttype)<=0){
+      n += idx[b].n;
+      continue;
+    }
+    read_block(b, recs);
+    for (auto const & r: recs)
+      if (graphene_time_cmp(r.first, t1p, ttype)>=0 &&
+          graphene_time_cmp(r.first, t2p, ttype)<=0) n++;
+  }
+  return n;
+}
+
+/************************************/
+// GrapheneDB methods
+
+vector<pair<uint64_t, string> >
+GrapheneDB::ar_list(DB_TXN *txn){
+  vector<pair<uint64_t, string> > ret;
+  istringstream in(get_key(txn, KEY_ARCH));
+  uint64_t t;
+  string f;
+  while (in >> t >> f) ret.emplace_back(t, f);
+  return ret;
+}
+
+vector<string>
+GrapheneDB::arch_files(){
+  vector<string> ret;
+  for (auto const & a: ar_list()) ret.push_back(a.second);
+  return ret;
+}
+
+// Files are renamed before the list is committed,
+// they are renamed back if anything fails.
+void
+GrapheneDB::arch_rename(){
+  string dir = (ar_dir.empty()? path : ar_dir) + "/";
+  vector<pair<string, string> > done;
+  DB_TXN *txn = txn_begin();
+  try {
+    ostringstream s;
+    for (auto const & a: ar_list(txn)){
+      string f = name + "%a" + type_to_str(a.first) + ".gra";
+      s << a.first << " " << f << "\n";
+      if (f == a.second) continue;
+      if (rename((dir + a.second).c_str(), (dir + f).c_str())!=0)
+        throw Err() << dir + a.second << ": " << strerror(errno);
+      done.emplace_back(a.second, f);
+    }
+    if (done.size()) set_key(txn, KEY_ARCH, mk_dbt(s.str()));
+  }
+  catch (Err e){
+    txn_abort(txn);
+    for (auto const & d: done) rename((dir + d.second).c_str(), (dir + d.first).c_str());
+    throw e;
+  }
+  txn_commit(txn);
+  ar_cache.clear();
+}
+
+GrapheneArch &
+GrapheneDB::ar_open(const string & file){
+  auto i = ar_cache.find(file);
+  if (i!=ar_cache.end()) return *i->second;
+  auto a = make_shared<GrapheneArch>((ar_dir.empty()? path : ar_dir) + "/" + file, ttype);
+  ar_cache[file] = a;
+  return *a;
+}
+
+void
+GrapheneDB::ar_check(DB_TXN *txn, const string & tp){
+  auto l = ar_list(txn);
+  string lk = get_key(txn, KEY_ARCH_LOCK);
+  uint64_t u = l.size()? l.back().first : 0;
+  if (lk.size()) u = max(u, str_to_type<uint64_t>(lk));
+  if ((l.size() || lk.size()) && graphene_time_to_units(tp, ttype) <= u)
+    throw Err() << name << ".db: can't modify archived data: "
+                << graphene_time_print(tp, ttype);
+}
+
+void
+GrapheneDB::ar_drop(const size_t k){
+  vector<pair<uint64_t, string> > l;
+  DB_TXN *txn = txn_begin();
+  try {
+    l = ar_list(txn);
+    ostringstream s;
+    for (size_t i=k; i<l.size(); i++) s << l[i].first << " " << l[i].second << "\n";
+    if (k<l.size()) set_key(txn, KEY_ARCH, mk_dbt(s.str()));
+    else del_key(txn, KEY_ARCH);
+    if (k) backup_upd(txn, ar_open(l[0].second).stats().first);
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+
+  for (size_t i=0; i<k && i<l.size(); i++){
+    ar_cache.erase(l[i].second);
+    string f = (ar_dir.empty()? path : ar_dir) + "/" + l[i].second;
+    if (remove(f.c_str())!=0 && errno!=ENOENT)
+      throw Err() << f << ": " << strerror(errno);
+  }
+}
+
+bool
+GrapheneDB::ar_get_next(string & t1p, GrapheneFormatter & out){
+  auto l = ar_list();
+  if (l.empty()) return false;
+  uint64_t u1 = graphene_time_to_units(t1p, ttype);
+  if (u1 > l.back().first) return false;
+  for (auto const & a: l){
+    if (a.first < u1) continue;
+    string k, v;
+    if (!ar_open(a.second).get_next(t1p, k, v)) continue;
+    out.partial = false;
+    out.quant = quant;
+    out.proc_point(k, v, ttype, dtype);
+    return true;
+  }
+  t1p = graphene_time_from_units(l.back().first + 1, ttype);
+  return false;
+}
+
+void
+GrapheneDB::ar_get_prev(const string & t2p, GrapheneFormatter & out){
+  auto l = ar_list();
+  uint64_t u2 = graphene_time_to_units(t2p, ttype);
+  for (auto a = l.rbegin(); a!=l.rend(); ++a){
+    // skip archives which start after t2
+    auto p = a+1;
+    if (p!=l.rend() && p->first >= u2) continue;
+    string k, v;
+    if (!ar_open(a->second).get_prev(t2p, k, v)) continue;
+    out.partial = false;
+    out.quant = quant;
+    out.proc_point(k, v, ttype, dtype);
+    return;
+  }
+}
+
+bool
+GrapheneDB::ar_get_range(string & t1p, const string & t2p,
+                         const string & dtp, uint64_t & cnt, GrapheneFormatter & out){
+  auto l = ar_list();
+  if (l.empty()) return false;
+  uint64_t u1 = graphene_time_to_units(t1p, ttype);
+  uint64_t u2 = graphene_time_to_units(t2p, ttype);
+  uint64_t ue = l.back().first;
+  if (u1 > ue) return false;
+  bool every = graphene_time_zero(dtp, ttype);
+  out.partial = false;
+  out.quant = quant;
+  for (size_t i=0; i<l.size(); i++){
+    if (l[i].first < u1) continue;
+    if (i>0 && l[i-1].first >= u2) break;
+    string last;
+    uint64_t n = ar_open(l[i].second).get_range(t1p, t2p, dtp, cnt, dtype, out, last);
+    // keep distance between the last point and the next archive
+    if (n && !every) t1p = graphene_time_add(last, dtp, ttype);
+    if (cnt) {
+      if (n >= cnt) return true;
+      cnt -= n;
+    }
+  }
+  if (u2 <= ue) return true;
+  string te = graphene_time_from_units(ue + 1, ttype);
+  if (graphene_time_cmp(t1p, te, ttype)<0) t1p = te;
+  return false;
+}
+
+uint64_t
+GrapheneDB::ar_count_range(string & t1p, const string & t2p){
+  auto l = ar_list();
+  if (l.empty()) return 0;
+  uint64_t u1 = graphene_time_to_units(t1p, ttype);
+  uint64_t u2 = graphene_time_to_units(t2p, ttype);
+  uint64_t ue = l.back().first, ret = 0;
+  if (u1 > ue) return 0;
+  for (size_t i=0; i<l.size(); i++){
+    if (l[i].first < u1) continue;
+    if (i>0 && l[i-1].first >= u2) break;
+    ret += ar_open(l[i].second).count_range(t1p, t2p);
+  }
+  t1p = graphene_time_from_units(ue + 1, ttype);
+  return ret;
+}
+
+/************************************/
+// Formatter for archive: write all points to the archive
+class GrapheneArchFormatter: public GrapheneFormatter {
+  public:
+  GrapheneArchWriter & w;
+  GrapheneArchFormatter(GrapheneArchWriter & w_): w(w_) {}
+  void proc_point(const string &k, const string &v,
+                  const TimeType ttype, const DataType dtype) override { w.add(k, v); }
+};
+
+// Writes to the range are blocked (KEY_ARCH_LOCK) before it is read,
+// so no point can be added or changed between reading and deleting.
+// Archive is written before it is added to the list, points are
+// deleted from the database after that. If deleting is interrupted,
+// remaining points are not visible (archived range is read from
+// archives) and they are deleted by the next archive call.
+uint64_t
+GrapheneDB::archive(const string &t2, const uint64_t n, const int pause_ms){
+  if (fr_period || pt_period || recnum) throw Err() << name << ".db: "
+    << "archiving is not supported for fixed-rate, partitioned and recnum databases";
+  string t2p = graphene_time_parse(t2, ttype);
+  uint64_t u2 = graphene_time_to_units(t2p, ttype);
+
+  // delete points from the database in a few transactions
+  auto del_pts = [&](string t1p, const string & t2p){
+    while (1){
+      string last;
+      bool more = false;
+      del_range_txn(t1p, t2p, n, 0, last, more, false);
+      if (!more || last=="") break;
+      t1p = last;
+      if (pause_ms>0) usleep(pause_ms*1000);
+    }
+  };
+
+  // new archive starts after the end of archived range,
+  // points left by an interrupted archiving are deleted
+  auto l = ar_list();
+  string t1p = graphene_time_parse("0", ttype);
+  if (l.size()){
+    string te = graphene_time_from_units(l.back().first, ttype);
+    del_pts(t1p, te);
+    if (u2 <= l.back().first) return 0;
+    t1p = graphene_time_from_units(l.back().first + 1, ttype);
+  }
+
+  // block writes to the range (waits for running write transactions)
+  DB_TXN *txn = txn_begin();
+  try { set_key(txn, KEY_ARCH_LOCK, mk_dbt(type_to_str(u2))); }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+
+  // remove the lock, add the archive to the list if file is set
+  auto unlock = [&](const string & file){
+    DB_TXN *txn = txn_begin();
+    try {
+      if (file!=""){
+        string s = get_key(txn, KEY_ARCH);
+        s += type_to_str(u2) + " " + file + "\n";
+        set_key(txn, KEY_ARCH, mk_dbt(s));
+      }
+      del_key(txn, KEY_ARCH_LOCK);
+    }
+    catch (Err e){
+      txn_abort(txn);
+      throw e;
+    }
+    txn_commit(txn);
+  };
+
+  // write the archive (a file left by an interrupted call,
+  // which is not in the list, is replaced)
+  string file = name + "%a" + type_to_str(u2) + ".gra";
+  string fpath = (ar_dir.empty()? path : ar_dir) + "/" + file;
+  uint64_t cnt;
+  try {
+    GrapheneArchWriter w(fpath, ttype, dtype, quant);
+    GrapheneArchFormatter f(w);
+    get_range(graphene_time_print(t1p, ttype), t2, "0", f);
+    cnt = w.count();
+    if (cnt) w.finish();
+    unlock(cnt? file : "");
+  }
+  catch (Err e){
+    try { unlock(""); } catch (Err & e1) {}
+    remove(fpath.c_str());
+    throw e;
+  }
+  if (cnt==0) return 0;
+
+  del_pts(t1p, t2p);
+  return cnt;
+}
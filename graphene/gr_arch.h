@@ -0,0 +1,109 @@
+/* Archive files (cold tier): immutable compressed files with old data
+   of a database, see gr_arch.cpp.
+
+   File structure (numbers in host byte order):
+     magic "GRARCH01",
+     blocks (same as in binary dumps, zlib-compressed, see gr_dump.cpp),
+     index: number of blocks (uint32), for each block: offset (uint64),
+            number of points (uint32), first and last keys (uint32 size + key),
+     statistics: uint32 size + GrapheneStats::pack() text,
+     trailer: offset of the index (uint64), magic "GRARCH01".
+*/
+
+#ifndef GR_ARCH_H
+#define GR_ARCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "gr_db.h"
+
+#define GRARCH_MAGIC "GRARCH01"
+#define GRARCH_BLOCK (64<<10) // uncompressed block size
+
+// Block encoding shared with binary dumps (see gr_dump.cpp):
+// data size, stored size, CRC32, stored data.
+void grdump_write_block(FILE *f, const std::string & file,
+                        const std::string & data, const bool zlib);
+void grdump_decode_block(const std::string & file, std::string & buf,
+                         const uint32_t size, const uint32_t crc,
+                         const bool zlib, std::string & data);
+
+// index record
+struct GrapheneArchBlock {
+  uint64_t off;         // block offset in the file
+  uint32_t n;           // number of points
+  std::string k1, k2;   // first and last packed timestamps
+};
+
+/***********************************************************/
+// Write an archive: points are added in the time order,
+// file is written through a temporary one and renamed by finish().
+class GrapheneArchWriter {
+  FILE *f;
+  std::string file, tmp;
+  TimeType ttype;
+  DataType dtype;
+  DataQuant quant;
+  std::string data;   // current block
+  std::vector<GrapheneArchBlock> idx;
+  GrapheneStats st;
+
+  void flush();
+
+  GrapheneArchWriter(const GrapheneArchWriter &) = delete;
+  GrapheneArchWriter & operator=(const GrapheneArchWriter &) = delete;
+
+  public:
+  GrapheneArchWriter(const std::string & file, const TimeType ttype,
+                     const DataType dtype, const DataQuant & quant);
+  ~GrapheneArchWriter(); // remove the temporary file if finish() was not called
+
+  void add(const std::string & k, const std::string & v);
+  void finish();
+  uint64_t count() const { return st.count; }
+};
+
+/***********************************************************/
+// Read-only archive. Index and statistics are read on open,
+// blocks are read with pread and decoded on each request.
+class GrapheneArch {
+  std::string file;
+  TimeType ttype;
+  int fd;
+  std::vector<GrapheneArchBlock> idx;
+  GrapheneStats st;
+
+  // read block b, return its records (packed timestamp and value)
+  void read_block(const size_t b,
+                  std::vector<std::pair<std::string, std::string> > & recs) const;
+
+  // first block with last timestamp >= tp (idx.size() if none)
+  size_t find(const std::string & tp) const;
+
+  GrapheneArch(const GrapheneArch &) = delete;
+  GrapheneArch & operator=(const GrapheneArch &) = delete;
+
+  public:
+  GrapheneArch(const std::string & file, const TimeType ttype);
+  ~GrapheneArch();
+
+  const GrapheneStats & stats() const { return st; }
+
+  // first point with t >= t1p, last point with t <= t2p;
+  // return false if there is no such point
+  bool get_next(const std::string & t1p, std::string & k, std::string & v) const;
+  bool get_prev(const std::string & t2p, std::string & k, std::string & v) const;
+
+  // Points in the range [t1p,t2p] with distance >= dtp between them,
+  // no more then cnt points (if cnt>0), same as GrapheneDB::get_range.
+  // Return number of points, last one is returned in last.
+  uint64_t get_range(const std::string & t1p, const std::string & t2p,
+                     const std::string & dtp, const uint64_t cnt, const DataType dtype,
+                     GrapheneFormatter & out, std::string & last) const;
+
+  // count points in the range (index is used for full blocks)
+  uint64_t count_range(const std::string & t1p, const std::string & t2p) const;
+};
+
+#endif
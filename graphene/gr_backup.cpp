@@ -0,0 +1,139 @@
+/* Native incremental backups: GrapheneEnv::backup and restore methods.
+
+   Each backup writes a new increment file <dir>/<name>.<n>.grinc for
+   every database (n is larger then numbers of existing increments of
+   this database). An increment contains all points with timestamps >=
+   main backup timer, see GrapheneDB::backup_inc. Restore applies
+   increments of each database in the order of numbers and removes them,
+   an interrupted restore can be repeated.
+
+   In txn environment databases are processed by groups of import_threads
+   in parallel threads: the environment handle is opened with DB_THREAD,
+   and each database handle is used by one thread only. Other environments
+   are not free-threaded, there databases are processed one by one.
+*/
+
+#include <dirent.h>
+#include <cerrno>
+#include <set>
+#include <algorithm>
+#include "gr_env.h"
+
+using namespace std;
+
+#define BACKUP_EXT ".grinc"
+
+// Increment files in the folder: database name -> number -> file.
+static map<string, map<uint64_t, string> >
+bk_files(const string & dir){
+  map<string, map<uint64_t, string> > ret;
+  DIR *d = opendir(dir.c_str());
+  if (!d) throw Err() << dir << ": " << strerror(errno);
+  const string ext(BACKUP_EXT);
+  while (struct dirent *e = readdir(d)){
+    string f(e->d_name);
+    if (f.size()<=ext.size() || f.substr(f.size()-ext.size())!=ext) continue;
+    string b = f.substr(0, f.size()-ext.size());
+    size_t p = b.rfind('.');
+    if (p==string::npos || p==0 || p+1==b.size() ||
+        b.find_first_not_of("0123456789", p+1)!=string::npos) continue;
+    ret[b.substr(0,p)][str_to_type<uint64_t>(b.substr(p+1))] = dir + "/" + f;
+  }
+  closedir(d);
+  return ret;
+}
+
+/************************************/
+void
+GrapheneEnv::backup_run(const vector<string> & names,
+       const function<shared_ptr<GrapheneDB> (const size_t)> & open,
+       const function<uint64_t (GrapheneDB &, const size_t)> & f,
+       ostream & out){
+  size_t nth = env_type=="txn"? import_threads : 1;
+  string err;
+  for (size_t i0=0; i0<names.size(); i0+=nth){
+    vector<shared_ptr<GrapheneDB> > dbs;
+    vector<size_t> idx; // indices of opened databases
+    for (size_t i=i0; i<min(i0+nth, names.size()); i++){
+      try {
+        dbs.push_back(open(i));
+        idx.push_back(i);
+      }
+      catch (Err & e){ if (err=="") err = e.str(); }
+    }
+    vector<int64_t> cnt(idx.size(), -1);
+    try {
+      run_parallel(idx.size(), [&](const size_t j){
+        cnt[j] = f(*dbs[j], idx[j]); });
+    }
+    catch (Err & e){ if (err=="") err = e.str(); }
+    for (size_t j=0; j<idx.size(); j++)
+      if (cnt[j]>=0) out << names[idx[j]] << " " << cnt[j] << "\n";
+  }
+  if (err!="") throw Err() << err;
+}
+
+void
+GrapheneEnv::backup(const string & name, const string & dir, ostream & out){
+  if (readonly) throw Err() << "can't do backup in readonly mode";
+  vector<string> names;
+  if (name=="all") names = dblist();
+  else {
+    check_name(name);
+    names.push_back(name);
+  }
+  auto files = bk_files(dir);
+  vector<string> fnames;
+  for (auto const & n: names){
+    auto const & ff = files[n];
+    fnames.push_back(dir + "/" + n + "." +
+      type_to_str(ff.size()? ff.rbegin()->first + 1 : 1) + BACKUP_EXT);
+  }
+
+  backup_run(names,
+    [&](const size_t i){ return getdb_pin(names[i]); },
+    [&](GrapheneDB & db, const size_t i){ return db.backup_inc(fnames[i]); },
+    out);
+}
+
+void
+GrapheneEnv::restore(const string & name, const string & dir, ostream & out){
+  if (readonly) throw Err() << "can't restore backup in readonly mode";
+  auto files = bk_files(dir);
+  if (name!="all"){
+    check_name(name);
+    if (files.count(name)==0)
+      throw Err() << dir << ": no increments for database " << name;
+    auto ff = files[name];
+    files.clear();
+    files[name] = ff;
+  }
+  vector<string> names;
+  for (auto const & f: files) names.push_back(f.first);
+  auto l = dblist();
+  set<string> exist(l.begin(), l.end());
+
+  backup_run(names,
+    [&](const size_t i){
+      // create the database using parameters from the first increment
+      if (exist.count(names[i])==0){
+        check_name(names[i]);
+        Opt h = GrapheneDB::inc_header(files[names[i]].begin()->second);
+        dbcreate(names[i], h.get<string>("descr"),
+          graphene_dtype_parse(h.get<string>("dtype")),
+          h.clone_known({"recnum", "step", "scale", "offset", "period", "t0", "block", "cols",
+                         "partition", "retention", "archive"}));
+      }
+      cat_reset(names[i]);
+      return getdb_pin(names[i]);
+    },
+    [&](GrapheneDB & db, const size_t i){
+      uint64_t n = 0;
+      for (auto const & f: files.at(names[i])){
+        n += db.restore_inc(f.second, del_chunk, del_time, del_pause);
+        if (remove(f.second.c_str())!=0)
+          throw Err() << f.second << ": " << strerror(errno);
+      }
+      return n;
+    }, out);
+}
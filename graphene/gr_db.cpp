@@ -6,9 +6,13 @@
 #include <iomanip>
 #include <iostream>
 #include <cstring> /* memset */
+#include <climits>
+#include <chrono>
+#include <unistd.h> /* usleep */
 
 #include "data.h"
 #include "gr_db.h"
+#include "gr_arch.h"
 #include "err/err.h"
 
 using namespace std;
@@ -65,11 +69,15 @@ int cmpfunc(DB *dbp, const DBT *a, const DBT *b){
 GrapheneDB::GrapheneDB(DB_ENV *env_,
      const string & path_,
      const string & name_,
-     const int flags):
-       env(env_), name(name_),
+     const int flags, const uint32_t db_flags,
+     const string & container_, DB_TXN *txn):
+       env(env_), name(name_), path(path_), container(container_),
+       recnum(false), step(false),
+       fr_t0(0), fr_period(0), fr_block(0), fr_cols(0), pt_period(0), pt_max(0), pt_use(0),
+       scan_mode(SCAN_AUTO),
        ttype(DEF_TIMETYPE), dtype(DEF_DATATYPE), version(DEF_DBVERSION) {
 
-  check_name(name); // check the name
+  check_int_name(name); // check the name
 
   // get environment flags
   env_flags = 0;
@@ -85,6 +93,7 @@ GrapheneDB::GrapheneDB(DB_ENV *env_,
    open_flags |= DB_AUTO_COMMIT | DB_READ_UNCOMMITTED;
 
   string fname = name_ + ".db";
+  if (container!="") fname = container + ".db";
   if (!env) { fname = path_ + "/" + fname; }
 
   /* Initialize the DB handle */
@@ -100,17 +109,32 @@ GrapheneDB::GrapheneDB(DB_ENV *env_,
   if (ret != 0)
     throw Err() << name << ".db: " << db_strerror(ret);
 
+  /* set database flags (only for new databases,
+     for existing ones they are read from the file) */
+  if (db_flags && (flags & DB_CREATE)){
+    ret = dbp->set_flags(dbp.get(), db_flags);
+    if (ret != 0)
+      throw Err() << name << ".db: " << db_strerror(ret);
+  }
+
   /* Open the database */
   ret = dbp->open(dbp.get(),     /* Pointer to the database */
-                  NULL,          /* Txn pointer */
+                  txn,           /* Txn pointer */
                   fname.c_str(), /* file */
-                  NULL,          /* database */
+                  container!=""? name.c_str():NULL, /* database */
                   DB_BTREE,      /* Database type (using btree) */
-                  open_flags,    /* Open flags */
+                  txn? open_flags & ~DB_AUTO_COMMIT : open_flags, /* Open flags */
                   0644);         /* File mode*/
   if (ret != 0){
     throw Err() << name << ".db: " << db_strerror(ret);
   }
+
+  uint32_t fl = 0;
+  ret = dbp->get_flags(dbp.get(), &fl);
+  if (ret != 0)
+    throw Err() << name << ".db: " << db_strerror(ret);
+  recnum = fl & DB_RECNUM;
+
   if ((flags & DB_CREATE) == 0) read_info();
 
 }
@@ -119,10 +143,10 @@ GrapheneDB::GrapheneDB(DB_ENV *env_,
 // Simple transaction wrappers:
 // For simple environments env can be NULL, txn can be null.
 DB_TXN *
-GrapheneDB::txn_begin(int flags){
+GrapheneDB::txn_begin(int flags, DB_TXN *parent){
   DB_TXN *txn = NULL;
   if (env && (env_flags & DB_INIT_TXN)) {
-    int ret = env->txn_begin(env, NULL, &txn, flags);
+    int ret = env->txn_begin(env, parent, &txn, flags);
     if (ret != 0) Err() << "Can't create a transaction: " << name << ".db: " << db_strerror(ret);
   }
   return txn;
@@ -142,6 +166,17 @@ GrapheneDB::txn_abort(DB_TXN *txn){
   if (ret != 0) Err() << "Can't abort a transaction: " << name << ".db: " << db_strerror(ret);
 }
 
+void
+GrapheneDB::sync_info(){
+  if (env && (env_flags & DB_INIT_TXN)) {
+    uint32_t fl = 0;
+    int ret = env->get_flags(env, &fl);
+    if (ret != 0) throw Err() << name << ".db: " << db_strerror(ret);
+    if (fl & (DB_TXN_NOSYNC | DB_TXN_WRITE_NOSYNC)) return;
+  }
+  sync();
+}
+
 /************************************/
 // Simple wrappers for cursor actions:
 
@@ -162,6 +197,33 @@ GrapheneDB::c_get(DBC *curs, DBT *k, DBT *v, int flags) {
   return res==0;
 }
 
+db_recno_t
+GrapheneDB::c_recno(DBC *curs) {
+  db_recno_t r = 0;
+  DBT k = mk_dbt();
+  DBT v = mk_dbt();
+  v.data  = &r;
+  v.ulen  = sizeof(r);
+  v.flags = DB_DBT_USERMEM;
+  if (!c_get(curs, &k, &v, DB_GET_RECNO))
+    throw Err() << name << ".db: can't get record number";
+  return r;
+}
+
+db_recno_t
+GrapheneDB::c_recno_at(DBC *curs, const std::string & tp, const bool incl) {
+  DBT k = mk_dbt(tp);
+  DBT v = mk_dbt();
+  v.flags = DB_DBT_PARTIAL; // we do not need data
+  bool found = c_get(curs, &k, &v, DB_SET_RANGE);
+  if (found && !incl && graphene_time_cmp(dbt2str(&k), tp, ttype)==0)
+    found = c_get(curs, &k, &v, DB_NEXT);
+  if (found) return c_recno(curs);
+  // after the last record
+  if (!c_get(curs, &k, &v, DB_LAST)) return 1;
+  return c_recno(curs) + 1;
+}
+
 /************************************/
 // Simple del/put/set operations for database information
 void
@@ -197,11 +259,11 @@ GrapheneDB::get_key(DB_TXN *txn, uint8_t key, const std::string & def){
 // key = (uint8_t)1 (1byte), value = version  (1byte)
 //
 void
-GrapheneDB::write_info(){
+GrapheneDB::write_info(DB_TXN *ptxn){
   int ret;
 
   // do everything in a single transaction
-  DB_TXN *txn = txn_begin();
+  DB_TXN *txn = txn_begin(0, ptxn);
   try {
 
     // Write format + description.
@@ -209,12 +271,19 @@ GrapheneDB::write_info(){
 
     // Write version.
     set_key(txn, KEY_VERSION, mk_dbt(&version));
+
+    // Write options.
+    if (dbopts.size()){
+      std::ostringstream ss; ss << dbopts;
+      set_key(txn, KEY_OPTS, mk_dbt(ss.str()));
+    }
+    else del_key(txn, KEY_OPTS);
   }
   catch (Err e){
     txn_abort(txn);
     throw e;
   }
-  sync();
+  sync_info();
   txn_commit(txn);
 }
 
@@ -248,6 +317,14 @@ GrapheneDB::read_info(){
       default: throw Err() << "unsupported database version: " << (int)version;
     }
 
+    // Read options
+    str = get_key(txn, KEY_OPTS);
+    dbopts = Opt();
+    if (str.size()){
+      std::istringstream ss(str);
+      ss >> dbopts;
+    }
+    apply_opts();
   }
   catch (Err e){
     txn_abort(txn);
@@ -270,7 +347,7 @@ GrapheneDB::clear_filter(const int n){
     txn_abort(txn);
     throw e;
   }
-  sync();
+  sync_info();
   txn_commit(txn);
 }
 
@@ -304,7 +381,7 @@ GrapheneDB::write_filter(const int n, const std::string & code){
     txn_abort(txn);
     throw e;
   }
-  sync(); // a very slow operation
+  sync_info(); // skipped in group and nosync durability modes
   txn_commit(txn);
 }
 
@@ -319,7 +396,7 @@ GrapheneDB::clear_f0data(){
     txn_abort(txn);
     throw e;
   }
-  sync();
+  sync_info();
   txn_commit(txn);
 }
 
@@ -443,6 +520,199 @@ GrapheneDB::backup_upd(DB_TXN *txn, const std::string &t){
   }
 }
 
+/************************************/
+// Database statistics
+
+void
+GrapheneStats::add(const std::string & t, const std::vector<double> & v, const TimeType ttype){
+  if (count==0) { first = last = t; }
+  else {
+    if (graphene_time_cmp(t, first, ttype)<0) first = t;
+    if (graphene_time_cmp(t, last,  ttype)>0) last = t;
+  }
+  for (size_t i=0; i<v.size(); i++){
+    if (i>=sum.size()){
+      min.push_back(v[i]); max.push_back(v[i]); sum.push_back(v[i]);
+      continue;
+    }
+    if (v[i]<min[i]) min[i] = v[i];
+    if (v[i]>max[i]) max[i] = v[i];
+    sum[i] += v[i];
+  }
+  count++;
+}
+
+void
+GrapheneStats::del(const std::string & t, const std::vector<double> & v, const TimeType ttype){
+  if (count<=1) { *this = GrapheneStats(); return; }
+  count--;
+  for (size_t i=0; i<v.size() && i<sum.size(); i++){
+    sum[i] -= v[i];
+    if (v[i]<=min[i] || v[i]>=max[i]) exact = false;
+  }
+  // first/last values are fixed by GrapheneDB::stats_fix_bounds
+}
+
+void
+GrapheneStats::merge(const GrapheneStats & s, const TimeType ttype){
+  if (s.count==0) return;
+  if (count==0) { *this = s; return; }
+  if (graphene_time_cmp(s.first, first, ttype)<0) first = s.first;
+  if (graphene_time_cmp(s.last, last, ttype)>0) last = s.last;
+  for (size_t i=0; i<s.sum.size(); i++){
+    if (i>=sum.size()){
+      min.push_back(s.min[i]); max.push_back(s.max[i]); sum.push_back(s.sum[i]);
+      continue;
+    }
+    if (s.min[i]<min[i]) min[i] = s.min[i];
+    if (s.max[i]>max[i]) max[i] = s.max[i];
+    sum[i] += s.sum[i];
+  }
+  count += s.count;
+  exact = exact && s.exact;
+}
+
+std::string
+GrapheneStats::pack(const TimeType ttype) const {
+  std::ostringstream out;
+  out << std::setprecision(17) << count << " " << exact << " "
+      << (count? graphene_time_print(first, ttype) : "-") << " "
+      << (count? graphene_time_print(last, ttype)  : "-") << " "
+      << sum.size();
+  for (size_t i=0; i<sum.size(); i++)
+    out << " " << min[i] << " " << max[i] << " " << sum[i];
+  return out.str();
+}
+
+void
+GrapheneStats::unpack(const std::string & s, const TimeType ttype){
+  std::istringstream in(s);
+  std::string t1, t2;
+  size_t n = 0;
+  in >> count >> exact >> t1 >> t2 >> n;
+  if (in.fail()) throw Err() << "broken statistics record";
+  first = count? graphene_time_parse(t1, ttype) : "";
+  last  = count? graphene_time_parse(t2, ttype) : "";
+  // values can be inf, -inf, nan: read words and parse them with strtod
+  auto rd = [&in](double & v){
+    std::string w;
+    in >> w;
+    char *e;
+    v = strtod(w.c_str(), &e);
+    if (w.empty() || *e!='\0') throw Err() << "broken statistics record";
+  };
+  min.resize(n); max.resize(n); sum.resize(n);
+  for (size_t i=0; i<n; i++) { rd(min[i]); rd(max[i]); rd(sum[i]); }
+}
+
+void
+GrapheneStats::print(std::ostream & out, const TimeType ttype) const {
+  out << "count " << count << "\n";
+  if (count==0) return;
+  out << "first " << graphene_time_print(first, ttype) << "\n"
+      << "last "  << graphene_time_print(last, ttype)  << "\n";
+  if (sum.size()==0) return;
+  auto pr = [&out](const char * name, const std::vector<double> & v){
+    out << name;
+    for (auto const & x:v) out << " " << std::setprecision(16) << x;
+    out << "\n";
+  };
+  pr("min", min);
+  pr("max", max);
+  pr("sum", sum);
+  out << "minmax_exact " << exact << "\n";
+}
+
+bool
+GrapheneDB::stats_read(DB_TXN *txn, GrapheneStats & st){
+  auto s = get_key(txn, KEY_STATS);
+  if (s.size()==0) return false;
+  st.unpack(s, ttype);
+  return true;
+}
+
+void
+GrapheneDB::stats_write(DB_TXN *txn, const GrapheneStats & st){
+  set_key(txn, KEY_STATS, mk_dbt(st.pack(ttype)));
+}
+
+void
+GrapheneDB::stats_fix_bounds(DB_TXN *txn, GrapheneStats & st){
+  if (st.count==0) return;
+  if (fr_period){
+    string v;
+    fr_scan(txn, 0, INT64_MAX,
+      [&](const int64_t i, const string & vi) -> int64_t {
+        st.first = fr_time(i); return -1; });
+    int64_t i = fr_prev(txn, fr_imax(), v);
+    if (i>=0) st.last = fr_time(i);
+    return;
+  }
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+    // smallest timestamp (1- and 2-byte keys are smaller)
+    uint32_t t0 = 0;
+    DBT k = mk_dbt(&t0);
+    DBT v = mk_dbt();
+    if (c_get(curs, &k, &v, DB_SET_RANGE) && is_tstamp(&k)) st.first = dbt2str(&k);
+    if (c_get(curs, &k, &v, DB_LAST) && is_tstamp(&k)) st.last = dbt2str(&k);
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    throw e;
+  }
+}
+
+GrapheneStats
+GrapheneDB::get_stats(){
+  if (pt_period) return pt_get_stats();
+  GrapheneStats st;
+  bool found;
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try { found = stats_read(txn, st); }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+  if (!found) throw Err() << name << ".db: "
+    << "statistics is not available, use rebuild_stats command";
+  for (auto const & a: ar_list()) st.merge(ar_open(a.second).stats(), ttype);
+  return st;
+}
+
+void
+GrapheneDB::rebuild_stats(){
+  if (pt_period) return pt_rebuild_stats();
+  if (fr_period) return fr_rebuild_stats();
+  GrapheneStats st;
+  DB_TXN *txn = txn_begin();
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+    uint32_t t0 = 0;
+    DBT k = mk_dbt(&t0);
+    DBT v = mk_dbt();
+    int fl = DB_SET_RANGE;
+    while (c_get(curs, &k, &v, fl)){
+      fl = DB_NEXT;
+      if (!is_tstamp(&k)) continue;
+      st.add(dbt2str(&k), graphene_data_values(dbt2str(&v), dtype, quant), ttype);
+    }
+    curs->close(curs);
+    curs = NULL;
+    stats_write(txn, st);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
 /************************************/
 // Put data to the database
 // input: timestamp + vector of strings
@@ -453,14 +723,36 @@ void
 GrapheneDB::put(const string &t, const vector<string> & dat, const string &dpolicy){
   int ret;
   string ks = graphene_time_parse(t, ttype);
-  string vs = graphene_data_parse(dat, dtype);
+  if (pt_period) return pt_put(ks, dat, dpolicy);
+  string vs = graphene_data_parse(dat, dtype, quant);
+  if (fr_period) return fr_put(ks, vs, dpolicy);
 
   // do everything in a single transaction
   DB_TXN *txn = txn_begin();
   try {
+    ar_check(txn, ks);
+
+    // statistics (if the database has it)
+    GrapheneStats st;
+    bool use_st = stats_read(txn, st);
+
+    // old value to be replaced
+    if (use_st && dpolicy == "replace"){
+      DBT k = mk_dbt(ks);
+      DBT v = mk_dbt();
+      int res = dbp->get(dbp.get(), txn, &k, &v, 0);
+      if (res == 0) st.del(ks, graphene_data_values(dbt2str(&v), dtype, quant), ttype);
+      else if (res != DB_NOTFOUND)
+        throw Err() << name << ".db: " << db_strerror(res);
+    }
+
+    // step databases: remove the middle point of a run of equal values
+    string kf = step ? step_fold(txn, ks, vs) : string();
+    if (kf.size()) backup_upd(txn, kf);
 
     int flags = (dpolicy =="replace")? 0:DB_NOOVERWRITE;
     int res = -1;
+    bool skipped = false;
     while (res!=0){
       DBT k = mk_dbt(ks);
       DBT v = mk_dbt(vs);
@@ -471,13 +763,22 @@ GrapheneDB::put(const string &t, const vector<string> & dat, const string &dpoli
           ks = graphene_time_add(ks, graphene_time_parse("1", ttype), ttype);
         else if (dpolicy =="nsshift")
           ks = graphene_time_add(ks, graphene_time_parse("0.000000001", ttype), ttype);
-        else if (dpolicy =="skip") break;
+        else if (dpolicy =="skip") {skipped = true; break;}
         else throw Err() << "Unknown dpolicy setting: " << dpolicy;
       }
       else if (res != 0)
         throw Err() << name << ".db: " << db_strerror(res);
     }
     backup_upd(txn, ks);
+
+    if (use_st && !skipped){
+      // folded point is replaced by the new one with the same value
+      if (kf.size()){
+        if (graphene_time_cmp(ks, st.last, ttype)>0) st.last = ks;
+      }
+      else st.add(ks, graphene_data_values(vs, dtype, quant), ttype);
+      stats_write(txn, st);
+    }
   }
   catch (Err e){
     txn_abort(txn);
@@ -486,14 +787,80 @@ GrapheneDB::put(const string &t, const vector<string> & dat, const string &dpoli
   txn_commit(txn);
 }
 
+/************************************/
+void
+GrapheneDB::apply_opts(){
+  step = dbopts.get("step", false);
+  quant = DataQuant(dbopts.get("scale", 1.0), dbopts.get("offset", 0.0));
+  fr_period = fr_t0 = 0;
+  if (dbopts.exists("period")){
+    fr_period = graphene_time_to_units(
+      graphene_time_parse(dbopts.get<std::string>("period"), ttype), ttype);
+    fr_t0 = graphene_time_to_units(
+      graphene_time_parse(dbopts.get<std::string>("t0", "0"), ttype), ttype);
+  }
+  fr_block = dbopts.get("block", 256);
+  fr_cols  = dbopts.get("cols", 1);
+  pt_period = dbopts.exists("partition") ? graphene_time_to_units(
+      graphene_time_parse(dbopts.get<std::string>("partition"), ttype), ttype) : 0;
+}
+
+void
+GrapheneDB::set_opts(const Opt & o){
+  dbopts = o;
+  apply_opts();
+  write_info();
+}
+
+std::string
+GrapheneDB::step_fold(DB_TXN *txn, const string & ks, const string & vs){
+  string ret;
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+    DBT k = mk_dbt(ks);
+    DBT v = mk_dbt();
+
+    // first point after ks (or the last point)
+    bool found = c_get(curs, &k, &v, DB_SET_RANGE);
+    if (found && dbt2str(&k) == ks) {
+      curs->close(curs);
+      return ret;
+    }
+    // previous point
+    found = c_get(curs, &k, &v, found? DB_PREV:DB_LAST);
+    if (found && is_tstamp(&k) && dbt2str(&v) == vs){
+      ret = dbt2str(&k);
+      // one more point before it
+      found = c_get(curs, &k, &v, DB_PREV);
+      if (!found || !is_tstamp(&k) || dbt2str(&v) != vs) ret.clear();
+    }
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    throw e;
+  }
+
+  if (ret.size()){
+    DBT k = mk_dbt(ret);
+    int res = dbp->del(dbp.get(), txn, &k, 0);
+    if (res != 0) throw Err() << name << ".db: " << db_strerror(res);
+  }
+  return ret;
+}
+
 /************************************/
 // get data from the database -- get_next
 //
 void
 GrapheneDB::get_next(const string &t1, GrapheneFormatter & out){
   string t1p = graphene_time_parse(t1, ttype);
+  if (pt_period) return pt_get_next(t1p, out);
+  if (fr_period) return fr_get_next(t1p, out);
+  if (ar_get_next(t1p, out)) return;
   DBT k = mk_dbt(t1p);
-  DBT v = mk_dbt();
+  DBT v = mk_vdbt(out);
 
   // do everything in a single transaction (with snapshot isolation)
   DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
@@ -524,8 +891,19 @@ void
 GrapheneDB::get_prev(const string &t2, GrapheneFormatter & out){
 
   string t2p = graphene_time_parse(t2, ttype);
+  if (pt_period) return pt_get_prev(t2p, out);
+  if (fr_period) return fr_get_prev(t2p, out);
+
+  // end of the archived range
+  auto al = ar_list();
+  string ae = al.size()? graphene_time_from_units(al.back().first, ttype) : string();
+  if (ae.size() && graphene_time_cmp(t2p, ae, ttype)<=0) return ar_get_prev(t2p, out);
+  bool done = false;
+
   DBT k = mk_dbt(t2p);
-  DBT v = mk_dbt();
+  DBT v = mk_vdbt(out);
+  // step databases: full values are needed to compare them
+  if (step) { v = mk_dbt(); out.partial = false; }
 
   // do everything in a single transaction (with snapshot isolation)
   DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
@@ -538,13 +916,24 @@ GrapheneDB::get_prev(const string &t2, GrapheneFormatter & out){
 
     // unpack time
     string tp = dbt2str(&k);
+    string tn, vn; // next record (step databases)
+    if (found && is_tstamp(&k)) { tn = tp; vn = dbt2str(&v); }
 
     // if needed, get previous record:
     if (graphene_time_cmp(tp,t2p, ttype)>0 || !found)
       found=c_get(curs, &k, &v, DB_PREV);
-
-    if (found && is_tstamp(&k))
-      out.proc_point(dbt2str(&k), dbt2str(&v), ttype, dtype);
+    else tn.clear(); // exact match
+
+    if (found && is_tstamp(&k) &&
+        (ae.empty() || graphene_time_cmp(dbt2str(&k), ae, ttype)>0)){
+      // step databases: inside a run of equal values (middle points
+      // could be folded) the value is reconstructed at t2
+      if (step && tn.size() && dbt2str(&v) == vn)
+        out.proc_point(t2p, vn, ttype, dtype);
+      else
+        out.proc_point(dbt2str(&k), dbt2str(&v), ttype, dtype);
+      done = true;
+    }
 
     curs->close(curs);
   }
@@ -554,6 +943,7 @@ GrapheneDB::get_prev(const string &t2, GrapheneFormatter & out){
     throw e;
   }
   txn_commit(txn);
+  if (!done && ae.size()) ar_get_prev(ae, out);
 }
 
 /************************************/
@@ -562,13 +952,19 @@ GrapheneDB::get_prev(const string &t2, GrapheneFormatter & out){
 void
 GrapheneDB::get(const string &t, GrapheneFormatter & out){
 
+  if (pt_period || ar_list().size())
+    return get_split(graphene_time_parse(t, ttype), out);
+
   /* for non-float databases use get_prev */
-  if (dtype!=DATA_FLOAT && dtype!=DATA_DOUBLE)
+  if (dtype!=DATA_FLOAT && dtype!=DATA_DOUBLE && !graphene_dtype_quant(dtype))
     return get_prev(t, out);
 
   string tp = graphene_time_parse(t, ttype);
+  if (fr_period) return fr_get(tp, out);
   DBT k = mk_dbt(tp);
   DBT v = mk_dbt();
+  out.partial = false; // full values are needed for interpolation
+  out.quant = quant;
   string t1p, v1p, t2p, v2p, vp;
 
   // do everything in a single transaction (with snapshot isolation)
@@ -619,17 +1015,68 @@ GrapheneDB::get(const string &t, GrapheneFormatter & out){
   txn_commit(txn);
 }
 
+// previous or interpolated point, neighbours can be in
+// different partitions or archives
+void
+GrapheneDB::get_split(const string & tp, GrapheneFormatter & out){
+  string t = graphene_time_print(tp, ttype);
+  GrapheneProxyFormatter p1(out, false), p2(out, false);
+  get_prev(t, p1);
+  if (!p1.n) return;
+  out.partial = false;
+  out.quant = quant;
+  if (p1.k == tp || (dtype!=DATA_FLOAT && dtype!=DATA_DOUBLE && !graphene_dtype_quant(dtype)))
+    return out.proc_point(p1.k, p1.v, ttype, dtype);
+
+  get_next(t, p2);
+  if (!p2.n) return out.proc_point(p1.k, p1.v, ttype, dtype);
+  out.proc_point(tp,
+    graphene_interpolate(tp, p1.k, p2.k, p1.v, p2.v, ttype, dtype), ttype, dtype);
+}
+
+/************************************/
+// Strategy for get_range with dt>0: after each output point we need
+// the first record with t >= t_last + dt. If data points are
+// dense (distance << dt) it is better to use DB_SET_RANGE (one
+// B-tree descent), if they are sparse (distance >> dt) -- DB_NEXT
+// (usually the next record on the same page).
+// We keep an exponential average of number of records between output
+// points, measured while stepping with DB_NEXT. If it is small, we try
+// stepping first, with a limited number of steps, and seek if the target
+// is not reached. If it is large, we seek, but from time to time
+// try stepping again to notice changes of the data density.
+class GrapheneScan {
+  double avg;   // average number of DB_NEXT steps between output points
+  int nseek;    // counter of seeks
+
+  public:
+  // Number of DB_NEXT steps with same cost as one seek.
+  static const int max_steps = 16;
+  // When seeking, try stepping every probe_period points.
+  static const int probe_period = 16;
+
+  GrapheneScan(): avg(1), nseek(0) {}
+
+  // how many DB_NEXT steps to try before seeking (0: seek immediately)
+  int budget(const int mode) {
+    if (mode==SCAN_NEXT) return INT_MAX;
+    if (mode==SCAN_SEEK) return 0;
+    if (avg <= max_steps) return max_steps;
+    return (++nseek % probe_period == 0) ? max_steps : 0;
+  }
+
+  // report result of stepping: n steps, target reached or not
+  void add(const int n, const bool reached) {
+    avg = 0.7*avg + 0.3*(reached ? n : 2*max_steps);
+  }
+};
+
 /************************************/
 // get data from the database -- get_range
 //
-// There can be two different cases: distance between
-// data points << dt or >> dt.
-// In the first case it is better to use DB_SET_RANGE,
-// in the second one -- DB_NEXT.
-// To work fast in both cases we use both methods
-// (order is not too important, but we prefer the 1nd case):
-// use DB_SET_RANGE with dt shift, if the point didn't
-// change - use DB_NEXT.
+// If dt is zero, all points are returned (DB_NEXT is used),
+// otherwise distance between returned points is at least dt,
+// see GrapheneScan for the strategy.
 void
 GrapheneDB::get_range(const string &t1, const string &t2,
                 const string &dt, GrapheneFormatter & out){
@@ -637,9 +1084,16 @@ GrapheneDB::get_range(const string &t1, const string &t2,
   string t1p = graphene_time_parse(t1, ttype);
   string t2p = graphene_time_parse(t2, ttype);
   string dtp = graphene_time_parse(dt, ttype);
+  if (pt_period) return pt_get_range(t1p, t2p, dtp, 0, out);
+  if (fr_period) return fr_get_range(t1p, t2p, dtp, 0, out);
+  uint64_t cnt = 0;
+  if (ar_get_range(t1p, t2p, dtp, cnt, out)) return;
+  bool every = graphene_time_zero(dtp, ttype);
   DBT k = mk_dbt(t1p);
-  DBT v = mk_dbt();
+  DBT v = mk_vdbt(out);
   string tlp; // last printed value
+  string tgp; // target time for the next point
+  GrapheneScan scan;
 
   // do everything in a single transaction (with snapshot isolation)
   DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
@@ -649,16 +1103,13 @@ GrapheneDB::get_range(const string &t1, const string &t2,
     // Get a cursor
     get_cursor(dbp.get(), txn, &curs, 0);
 
-    int fl = DB_SET_RANGE; // first get t >= t1
+    // first get t >= t1
+    bool found = c_get(curs, &k, &v, DB_SET_RANGE);
     while (1){
 
-      string pre = dbt2str(&k);
-      if (!c_get(curs, &k, &v, fl)) break;
-
-      if (!is_tstamp(&k)) {
-        fl=DB_NEXT;
-        continue;
-      }
+      // skip non-timestamp keys
+      while (found && !is_tstamp(&k)) found = c_get(curs, &k, &v, DB_NEXT);
+      if (!found) break;
 
       // unpack new time value and check the range
       string tnp = dbt2str(&k);
@@ -667,32 +1118,44 @@ GrapheneDB::get_range(const string &t1, const string &t2,
       // I have a broken database where DB_SET_RANGE/DB_NEXT can
       // get non-increasing values. Let's check this to prevent the
       // program from infinite loops..
-      if (graphene_time_cmp(tnp,pre,ttype)<0)
+      if (tlp.size()>0 && graphene_time_cmp(tnp,tlp,ttype)<=0)
         throw Err() << "Broken database (DB_SET_RANGE/DB_NEXT get smaller timestamp)";
 
-      // if we want every point, switch to DB_NEXT and repeat
-      if (graphene_time_zero(dtp, ttype)){
-        out.proc_point(dbt2str(&k), dbt2str(&v), ttype, dtype);
-        fl=DB_NEXT;
+      out.proc_point(tnp, dbt2str(&v), ttype, dtype);
+      tlp=tnp; // update last printed value
+
+      // if we want every point, use DB_NEXT
+      if (every){
+        found = c_get(curs, &k, &v, DB_NEXT);
         continue;
       }
 
-      // If dt >0 we continue using fl=DB_SET_RANGE.
-      // If new value the same as old
-      if (tlp.size()>0 && graphene_time_cmp(tlp,tnp,ttype)==0){
-        // get next value
-        if (!c_get(curs, &k, &v, DB_NEXT)) break;
-        // unpack new time value and check the range
-        tnp = dbt2str(&k);
-        if (graphene_time_cmp(tnp,t2p,ttype) > 0 ) break;
+      // find first point with t >= tlp + dt:
+      tgp = graphene_time_add(tlp, dtp, ttype);
+
+      // try DB_NEXT
+      int b = scan.budget(scan_mode);
+      if (b>0){
+        int n = 0;
+        bool reached = false;
+        while (n<b){
+          found = c_get(curs, &k, &v, DB_NEXT);
+          n++;
+          if (!found) break;
+          if (n%1024 == 0) out.check_time();
+          if (is_tstamp(&k) && graphene_time_cmp(dbt2str(&k),tgp,ttype)>=0) {
+            reached = true;
+            break;
+          }
+        }
+        if (!found) break;
+        scan.add(n, reached);
+        if (reached) continue;
       }
-      out.proc_point(dbt2str(&k), dbt2str(&v), ttype, dtype);
-      tlp=tnp; // update last printed value
 
-      // add dt to the key for the next loop:
-      string sp = graphene_time_add(tlp, dtp, ttype);
-      memcpy(k.data,sp.data(),k.size);
-      k = mk_dbt(sp);
+      // use DB_SET_RANGE
+      k = mk_dbt(tgp);
+      found = c_get(curs, &k, &v, DB_SET_RANGE);
     }
     curs->close(curs);
   }
@@ -718,9 +1181,21 @@ GrapheneDB::get_count(const string &t1,
   s >> N;
   if (s.bad() || s.fail() || !s.eof())
     throw Err() << "Can't parse data count: " << count;
+  if (pt_period){
+    if (N>0) pt_get_range(t1p, graphene_time_parse("inf", ttype),
+                          graphene_time_parse("0", ttype), N, out);
+    return;
+  }
+  if (fr_period){
+    if (N>0) fr_get_range(t1p, graphene_time_parse("inf", ttype),
+                          graphene_time_parse("0", ttype), N, out);
+    return;
+  }
+  if (N>0 && ar_get_range(t1p, graphene_time_parse("inf", ttype),
+                          graphene_time_parse("0", ttype), N, out)) return;
 
   DBT k = mk_dbt(t1p);
-  DBT v = mk_dbt();
+  DBT v = mk_vdbt(out);
 
   // do everything in a single transaction (with snapshot isolation)
   DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
@@ -762,22 +1237,135 @@ GrapheneDB::get_count(const string &t1,
 
 
 
+/************************************/
+// get data from the database -- get_range_idx
+//
+void
+GrapheneDB::get_range_idx(const string &t1, const string &t2,
+                          const uint64_t step, GrapheneFormatter & out){
+  if (!recnum) throw Err() << name << ".db: "
+    << "sampling by index needs a database created with recnum option";
+  if (step<1) throw Err() << "bad index step: " << step;
+
+  string t1p = graphene_time_parse(t1, ttype);
+  string t2p = graphene_time_parse(t2, ttype);
+
+  // do everything in a single transaction (with snapshot isolation)
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+
+    // record number range
+    db_recno_t r1 = c_recno_at(curs, t1p, true);
+    db_recno_t r2 = c_recno_at(curs, t2p, false);
+
+    for (uint64_t r = r1; r < r2; r += step){
+      db_recno_t rr = r;
+      DBT k = mk_dbt(&rr);
+      DBT v = mk_vdbt(out);
+      if (!c_get(curs, &k, &v, DB_SET_RECNO)) break;
+      if (!is_tstamp(&k)) continue;
+      out.proc_point(dbt2str(&k), dbt2str(&v), ttype, dtype);
+    }
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+/************************************/
+// count points in the range
+//
+uint64_t
+GrapheneDB::count_range(const string &t1, const string &t2){
+
+  string t1p = graphene_time_parse(t1, ttype);
+  string t2p = graphene_time_parse(t2, ttype);
+  if (pt_period) return pt_count_range(t1p, t2p);
+  if (fr_period) return fr_count_range(t1p, t2p);
+  uint64_t ret = ar_count_range(t1p, t2p);
+  if (graphene_time_cmp(t1p, t2p, ttype)>0) return ret;
+
+  // do everything in a single transaction (with snapshot isolation)
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+
+    if (recnum) {
+      // difference of record numbers of the range boundaries
+      db_recno_t r1 = c_recno_at(curs, t1p, true);
+      db_recno_t r2 = c_recno_at(curs, t2p, false);
+      if (r2>r1) ret += r2-r1;
+    }
+    else {
+      // walk through all keys (without reading data)
+      DBT k = mk_dbt(t1p);
+      DBT v = mk_dbt();
+      v.flags = DB_DBT_PARTIAL;
+      int fl = DB_SET_RANGE;
+      while (c_get(curs, &k, &v, fl)){
+        fl = DB_NEXT;
+        if (!is_tstamp(&k)) continue;
+        if (graphene_time_cmp(dbt2str(&k),t2p,ttype)>0) break;
+        ret++;
+      }
+    }
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+  return ret;
+}
+
 /************************************/
 // delete data data from the database -- del
 void
 GrapheneDB::del(const string &t1){
   int ret;
   string t1p = graphene_time_parse(t1, ttype);
+  if (pt_period) return pt_del(t1p);
+  if (fr_period) {
+    string last;
+    bool more;
+    fr_del_range(t1p, t1p, true, 0, 0, last, more);
+    return;
+  }
   DBT k = mk_dbt(t1p);
 
   DB_TXN *txn = txn_begin();
   try{
+    ar_check(txn, t1p);
+
+    // statistics (if the database has it): read the old value
+    GrapheneStats st;
+    bool use_st = stats_read(txn, st);
+    if (use_st){
+      DBT v = mk_dbt();
+      ret = dbp->get(dbp.get(), txn, &k, &v, 0);
+      if (ret == 0) st.del(t1p, graphene_data_values(dbt2str(&v), dtype, quant), ttype);
+    }
+
     ret = dbp->del(dbp.get(), txn, &k, 0);
     if (ret == DB_NOTFOUND)
       throw Err() << name << ".db: No such record: " << t1;
     if (ret != 0)
       throw Err() << name << ".db: " << db_strerror(ret);
     backup_upd(txn, t1p);
+
+    if (use_st){
+      stats_fix_bounds(txn, st);
+      stats_write(txn, st);
+    }
   }
   catch (Err e){
     txn_abort(txn);
@@ -789,12 +1377,37 @@ GrapheneDB::del(const string &t1){
 /************************************/
 // delete data data from the database -- del_range
 void
-GrapheneDB::del_range(const string &t1, const string &t2){
-  int ret;
-  std::string first_del; // for lastmod timestamp
-
+GrapheneDB::del_range(const string &t1, const string &t2,
+                      const uint64_t max_n, const int max_ms, const int pause_ms,
+                      GrapheneDelCB cb){
   string t1p = graphene_time_parse(t1, ttype);
   string t2p = graphene_time_parse(t2, ttype);
+  if (pt_period) return pt_del_range(t1p, t2p, max_n, max_ms, pause_ms, cb);
+  if (graphene_time_cmp(t1p, t2p, ttype)<=0) ar_check(NULL, t1p);
+
+  uint64_t n = 0;
+  while (1){
+    string last;
+    bool more = false;
+    n += fr_period ? fr_del_range(t1p, t2p, false, max_n, max_ms, last, more):
+                     del_range_txn(t1p, t2p, max_n, max_ms, last, more);
+    if (cb && last!="") cb(n, graphene_time_print(last, ttype));
+    if (!more) break;
+    if (last=="") throw Err() << name << ".db: del_range: no points deleted in a transaction";
+    t1p = last; // next transaction starts from the last deleted point
+    if (pause_ms>0) usleep(pause_ms*1000);
+  }
+}
+
+// One transaction of del_range
+uint64_t
+GrapheneDB::del_range_txn(const string &t1p, const string &t2p,
+                          const uint64_t max_n, const int max_ms,
+                          string & last, bool & more, const bool bk){
+  std::string first_del; // for lastmod timestamp
+  uint64_t n = 0;
+  auto t0 = std::chrono::steady_clock::now();
+
   DBT k = mk_dbt(t1p);
   DBT v = mk_dbt();
 
@@ -802,6 +1415,13 @@ GrapheneDB::del_range(const string &t1, const string &t2){
   DBC *curs = NULL;
   try {
 
+    // statistics (if the database has it)
+    // archiving deletes archived points itself (bk=false)
+    if (bk && graphene_time_cmp(t1p, t2p, ttype)<=0) ar_check(txn, t1p);
+
+    GrapheneStats st;
+    bool use_st = stats_read(txn, st);
+
     /* Get a cursor */
     get_cursor(dbp.get(), txn, &curs, 0);
 
@@ -810,6 +1430,13 @@ GrapheneDB::del_range(const string &t1, const string &t2){
 
       string pre = dbt2str(&k);
 
+      // transaction limits (at least one point is deleted)
+      if (n>0 && ((max_n && n>=max_n) || (max_ms>0 && std::chrono::steady_clock::now() - t0 >=
+                                  std::chrono::milliseconds(max_ms)))){
+        more = true;
+        break;
+      }
+
       if (!c_get(curs, &k, &v, fl)) break;
 
       // get packed time value and check the range
@@ -827,13 +1454,22 @@ GrapheneDB::del_range(const string &t1, const string &t2){
       if (res!=0)
         throw Err() << name << ".db: " << db_strerror(res);
       if (first_del=="") first_del = tp;
+      last = tp;
+      n++;
+      if (use_st) st.del(tp, graphene_data_values(dbt2str(&v), dtype, quant), ttype);
 
       // we want to delete every point, so switch to DB_NEXT and repeat
       fl=DB_NEXT;
     }
 
     curs->close(curs);
-    if (first_del!="") backup_upd(txn, first_del);
+    curs = NULL;
+    if (first_del!="" && bk) backup_upd(txn, first_del);
+
+    if (use_st && first_del!=""){
+      stats_fix_bounds(txn, st);
+      stats_write(txn, st);
+    }
   }
   catch (Err e){
     if (curs) curs->close(curs);
@@ -841,6 +1477,97 @@ GrapheneDB::del_range(const string &t1, const string &t2){
     throw e;
   }
   txn_commit(txn);
+  return n;
+}
+
+/************************************/
+void
+GrapheneDB::compact(const uint32_t max_pages, uint64_t & freed, uint64_t & truncated){
+  string start;
+  bool first = true;
+  while (1){
+    DB_COMPACT c;
+    memset(&c, 0, sizeof(c));
+    c.compact_pages = max_pages;
+    DBT s = mk_dbt(start);
+    DBT e = mk_dbt();
+    e.flags = DB_DBT_MALLOC;
+    int res = dbp->compact(dbp.get(), NULL, first? NULL:&s, NULL, &c, DB_FREE_SPACE, &e);
+    if (res!=0) throw Err() << name << ".db: " << db_strerror(res);
+    string end = dbt2str(&e);
+    if (e.data) free(e.data);
+    freed += c.compact_pages_free;
+    truncated += c.compact_pages_truncated;
+
+    // continue from the last key if the step was stopped by max_pages
+    if (!max_pages || c.compact_pages_free < max_pages ||
+        end.size()==0 || (!first && end==start)) break;
+    start = end;
+    first = false;
+  }
+  for (auto k: pt_period? pt_list() : vector<uint64_t>())
+    pt_db(k).compact(max_pages, freed, truncated);
+}
+
+/************************************/
+// Formatter for trim: count points with t <= t2, remember the last one.
+class GrapheneTrimFormatter: public GrapheneFormatter {
+  public:
+  string t2p, k;
+  uint64_t n;
+  GrapheneTrimFormatter(const string & t2p_): t2p(t2p_), n(0) {
+    need_col = 0; need_len = 1; // values are not needed
+  }
+  void proc_point(const string &ks, const string &vs,
+                  const TimeType ttype, const DataType dtype) override {
+    if (graphene_time_cmp(ks, t2p, ttype)>0) return;
+    n++; k = ks;
+  }
+};
+
+uint64_t
+GrapheneDB::trim(const string &t2, const uint64_t n){
+  string t2p = graphene_time_parse(t2, ttype);
+  uint64_t ret = 0;
+
+  // partitioned databases: drop expired partitions
+  if (pt_period){
+    uint64_t u2 = graphene_time_to_units(t2p, ttype);
+    auto l = pt_list();
+    for (auto k: l){
+      if (u2 - k*pt_period < pt_period - 1 || k*pt_period > u2) break;
+      ret += pt_db(k).get_stats().count;
+      pt_drop(k);
+    }
+    if (l.size() && ret){
+      DB_TXN *txn = txn_begin();
+      try { backup_upd(txn, graphene_time_from_units(l[0]*pt_period, ttype)); }
+      catch (Err e){
+        txn_abort(txn);
+        throw e;
+      }
+      txn_commit(txn);
+    }
+    if (ret>=n) return ret;
+  }
+
+  // drop expired archives; if some archives are left, all newer
+  // data is not expired
+  auto al = ar_list();
+  if (al.size()){
+    uint64_t u2 = graphene_time_to_units(t2p, ttype);
+    size_t k = 0;
+    for (; k<al.size() && al[k].first<=u2; k++)
+      ret += ar_open(al[k].second).stats().count;
+    if (k) ar_drop(k);
+    if (k<al.size() || ret>=n) return ret;
+  }
+
+  // find the n-th point and delete everything before it
+  GrapheneTrimFormatter f(t2p);
+  get_count("0", type_to_str(n-ret), f);
+  if (f.n) del_range("0", graphene_time_print(f.k, ttype));
+  return ret + f.n;
 }
 
 /************************************/
@@ -916,6 +1643,8 @@ GrapheneDB::load(const std::string &file){
 //   in readonly mode (see how it is called in graphene.cpp)
 void
 GrapheneDB::dump(const std::string &file){
+  if (pt_period) throw Err() << name << ".db: "
+    << "dump is not supported for partitioned databases, dump partitions instead";
   ofstream ff(file.c_str());
 
   // write header
@@ -11,10 +11,12 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <functional>
 #include <cstring> /* memset */
 #include <db.h>
 
 #include "err/err.h"
+#include "opt/opt.h"
 #include "data.h"
 
 #include <iomanip>
@@ -24,11 +26,17 @@
 //  https://web.stanford.edu/class/cs276a/projects/docs/berkeleydb/reftoc.html
 
 #define GRAPHENE_LOGSIZE 1<<20
+#define GRAPHENE_LOGHOLD "log_hold"
 
 #define KEY_DESCR   0
 #define KEY_VERSION 1
 #define KEY_BACKUP_MAIN  0x10
 #define KEY_BACKUP_TMP   0x11
+#define KEY_STATS        0x12
+#define KEY_OPTS         0x13
+#define KEY_PARTS        0x14
+#define KEY_ARCH         0x15
+#define KEY_ARCH_LOCK    0x16
 
 // Filters occupy MAX_FILTERS keys starting
 // from KEY_FLT. Filter 0 data uses KEY_FLT0DATA key
@@ -40,13 +48,93 @@
 #define DEF_TIMETYPE   TIME_V2
 #define DEF_DATATYPE   DATA_DOUBLE
 
+// Progress callback for del_range: number of deleted points and
+// the last deleted timestamp (printed), called after each transaction.
+typedef std::function<void(const uint64_t, const std::string &)> GrapheneDelCB;
+
+// Scan strategy for get_range with dt>0 (see GrapheneScan in gr_db.cpp)
+enum GrapheneScanMode { SCAN_AUTO, SCAN_SEEK, SCAN_NEXT };
+
 // Base formatter class for GrapheneDB. All get_* methods call
 // GrapheneFormatter::proc_point on each record (without any
-// filtering or column selection).
+// filtering).
+// If the formatter needs only one column (need_col>=0), get_* methods
+// (except get, which does interpolation) read only this column
+// from numerical databases (using DB_DBT_PARTIAL) and set partial flag.
+// Then the value contains one column or nothing if the record is shorter.
+// Similarly, for text databases only first need_len bytes can be read.
+// Quantization parameters for Q16/Q24/Q32 databases are set in quant.
 class GrapheneFormatter {
   public:
+  int need_col;    // column needed by the formatter, -1 for all
+  size_t need_len; // max length of text values, 0 for all
+  bool partial;    // set by GrapheneDB: value is read partially
+  DataQuant quant; // set by GrapheneDB: scale and offset for quantized types
+
+  GrapheneFormatter(): need_col(-1), need_len(0), partial(false) {}
+
   virtual void proc_point(const std::string &k, const std::string &v,
      const TimeType ttype, const DataType dtype) = 0;
+
+  // Called periodically during long database scans which do not
+  // produce points, can throw an error to stop the query.
+  virtual void check_time() {}
+};
+
+// Formatter for queries split into a few parts (partitions, archives):
+// count points, remember the last one, pass points to another
+// formatter (if fwd is set).
+class GrapheneProxyFormatter: public GrapheneFormatter {
+  public:
+  GrapheneFormatter & out;
+  bool fwd;
+  uint64_t n;       // number of points
+  std::string k, v; // last point
+
+  GrapheneProxyFormatter(GrapheneFormatter & out_, const bool fwd_ = true):
+      out(out_), fwd(fwd_), n(0) {
+    if (fwd) { need_col = out.need_col; need_len = out.need_len; }
+  }
+
+  void proc_point(const std::string &ks, const std::string &vs,
+                  const TimeType ttype, const DataType dtype) override {
+    n++; k = ks; v = vs;
+    if (!fwd) return;
+    out.partial = partial;
+    out.quant = quant;
+    out.proc_point(ks, vs, ttype, dtype);
+  }
+
+  void check_time() override { out.check_time(); }
+};
+
+class GrapheneArch; // archive file (see gr_arch.h)
+
+/***********************************************************/
+// Database statistics, stored in KEY_STATS record and updated
+// by put/del/del_range in the same transaction. Old databases
+// have no such record (use GrapheneDB::rebuild_stats).
+struct GrapheneStats {
+  uint64_t count;                    // number of points
+  std::string first, last;           // packed timestamps of the first and last points
+  std::vector<double> min, max, sum; // per-column values (not for TEXT databases)
+  bool exact; // min/max values are exact (false after deleting points with min/max values)
+
+  GrapheneStats(): count(0), exact(true) {}
+
+  // add/remove a point (packed timestamp and unpacked values)
+  void add(const std::string & t, const std::vector<double> & v, const TimeType ttype);
+  void del(const std::string & t, const std::vector<double> & v, const TimeType ttype);
+
+  // add statistics of another set of points
+  void merge(const GrapheneStats & s, const TimeType ttype);
+
+  // convert to/from a string for storing in the database
+  std::string pack(const TimeType ttype) const;
+  void unpack(const std::string & s, const TimeType ttype);
+
+  // print statistics in "<name> <values>" lines
+  void print(std::ostream & out, const TimeType ttype) const;
 };
 
 /***********************************************************/
@@ -76,6 +164,32 @@ class GrapheneDB{
   static std::string dbt2str(DBT *k) {
     return std::string((char *)k->data, (char *)k->data+k->size);}
 
+  // DBT for reading values in get_* methods: read only one
+  // column or beginning of a text if the formatter needs it,
+  // set out.partial flag and quantization parameters.
+  DBT mk_vdbt(GrapheneFormatter & out) const {
+    DBT ret = mk_dbt();
+    out.quant = quant;
+    if (dtype==DATA_TEXT){
+      out.partial = out.need_len>0;
+      if (out.partial){
+        ret.flags = DB_DBT_PARTIAL;
+        ret.doff  = 0;
+        ret.dlen  = out.need_len;
+      }
+    }
+    else {
+      out.partial = out.need_col>=0;
+      if (out.partial){
+        size_t s = graphene_dtype_size(dtype);
+        ret.flags = DB_DBT_PARTIAL;
+        ret.doff  = out.need_col*s;
+        ret.dlen  = s;
+      }
+    }
+    return ret;
+  }
+
   // check if database key is a valid timestamp (not a 1- or 2-byte special keys)
   static bool is_tstamp(DBT *k) { return k->size==sizeof(uint64_t) || k->size==sizeof(uint32_t); }
 
@@ -84,8 +198,24 @@ class GrapheneDB{
     std::shared_ptr<DB> dbp;
     DB_ENV * env;
     std::string name;    // database name
+    std::string path, container; // database folder and container (see constructor)
     uint32_t open_flags; // database open flags
     uint32_t env_flags;  // environment flags
+    bool recnum;         // database is a record-number B-tree (DB_RECNUM)
+    Opt dbopts;          // database options (see set_opts)
+    bool step;           // step option: fold runs of equal values
+    DataQuant quant;     // scale and offset options for quantized types
+    uint64_t fr_t0, fr_period; // fixed-rate databases: time grid t0 + i*period
+                               // in time units (period=0 for normal databases)
+    uint32_t fr_block, fr_cols; // fixed-rate databases: points per block, columns
+    uint64_t pt_period;  // partitioned databases: partition length in time units (0 - no partitions)
+    std::map<uint64_t, std::pair<std::shared_ptr<GrapheneDB>, uint64_t> >
+      pt_cache;          // opened partitions with their last use (pt_use value)
+    uint64_t pt_use;     // counter of partition uses (for LRU eviction)
+    size_t pt_max;       // max number of opened partitions (0 - no limit)
+    std::string ar_dir;  // folder with archive files (database folder if empty)
+    std::map<std::string, std::shared_ptr<GrapheneArch> > ar_cache; // opened archives
+    int scan_mode;       // scan strategy for get_range with dt>0 (GrapheneScanMode)
 
     uint8_t  version;  // database version
     DataType dtype;    // data type
@@ -98,16 +228,28 @@ class GrapheneDB{
   };
 
   /****************************/
-  // Simple transaction wrappers:
-    DB_TXN *txn_begin(int flags=0);
+  // Simple transaction wrappers (parent is used for nested transactions):
+    DB_TXN *txn_begin(int flags=0, DB_TXN *parent=NULL);
     void txn_commit(DB_TXN *txn);
     void txn_abort(DB_TXN *txn);
 
+  // Sync the database after writing database information.
+  // Skipped if the environment does not sync logs on commit
+  // (group and nosync durability modes, see GrapheneEnv).
+    void sync_info();
+
   /****************************/
   // Simple wrappers for cursor operations:
     void get_cursor(DB *dbp, DB_TXN *txn, DBC **curs, int flags);
     bool c_get(DBC *curs, DBT *k, DBT *v, int flags);
 
+  // Record number of the cursor position (DB_RECNUM databases only).
+    db_recno_t c_recno(DBC *curs);
+
+  // Record number of the first record with timestamp >= t (incl=true)
+  // or > t (incl=false); number of records + 1 if there is no such record.
+    db_recno_t c_recno_at(DBC *curs, const std::string & tp, const bool incl);
+
   /****************************/
   // Simple del/put/set operations for database information
     void del_key(DB_TXN *txn, uint8_t key);
@@ -119,19 +261,167 @@ class GrapheneDB{
   // Read/Write database information.
   // key = (uint8_t)0 (1byte),  value = data_fmt (1byte) + description
   // key = (uint8_t)1 (1byte),  value = version  (1byte)
-    void write_info();
+  // key = KEY_OPTS (1byte), value = database options (JSON, if not empty)
+    void write_info(DB_TXN *ptxn=NULL);
     void read_info();
 
+  // Set step, quant, fr_* parameters from dbopts.
+    void apply_opts();
+
+  /****************************/
+  // Read/write statistics record (KEY_STATS).
+  // stats_read returns false if the record does not exist.
+    bool stats_read(DB_TXN *txn, GrapheneStats & st);
+    void stats_write(DB_TXN *txn, const GrapheneStats & st);
+
+  // Update first/last timestamps after deleting points.
+    void stats_fix_bounds(DB_TXN *txn, GrapheneStats & st);
+
+  /****************************/
+  // Step databases: if a new point (ks,vs) has the same value as two
+  // previous points remove the middle one, return its timestamp.
+  // Return empty string if nothing was removed or the point ks exists.
+    std::string step_fold(DB_TXN *txn, const std::string & ks, const std::string & vs);
+
+  // One transaction of del_range (packed timestamps, see del_range for limits).
+  // Return number of deleted points, the last deleted timestamp and
+  // a flag that the range was not finished because of limits.
+  // Backup timers are not updated if bk is false (moving data to archives).
+    uint64_t del_range_txn(const std::string & t1p, const std::string & t2p,
+                           const uint64_t max_n, const int max_ms,
+                           std::string & last, bool & more, const bool bk = true);
+
+  // get for data split into a few parts (partitions, archives):
+  // previous and next points are found by get_prev/get_next.
+    void get_split(const std::string & tp, GrapheneFormatter & out);
+
+  /****************************/
+  // Fixed-rate databases (see gr_fixed.cpp).
+  // Points with timestamps t0 + i*period are kept in blocks of fr_block
+  // points. Block key is the timestamp of its first point, value is a
+  // bitmap of existing points followed by data of all points.
+
+  // Point index for a packed timestamp. Timestamps between grid points are
+  // rounded: rnd<0 - down, rnd>0 - up, rnd=0 - to the nearest point.
+  // Result is -1 for timestamps before t0 (rounded down).
+    int64_t fr_idx(const std::string & tp, const int rnd) const;
+
+  // Index of the last point which can be stored (before "inf" timestamp).
+    int64_t fr_imax() const;
+
+  // Packed timestamp of the point i.
+    std::string fr_time(const int64_t i) const;
+
+  // Sizes of a point and a block.
+    size_t fr_psize() const { return fr_cols*graphene_dtype_size(dtype); }
+    size_t fr_bsize() const { return (fr_block+7)/8 + fr_block*fr_psize(); }
+
+  // Call cb(i, packed value) for existing points with i1<=i<=i2.
+  // cb returns index of the next point it is interested in (>i).
+    void fr_scan(DB_TXN *txn, int64_t i1, int64_t i2,
+      const std::function<int64_t(const int64_t, const std::string &)> & cb);
+
+  // Find the last existing point with index <= i, return -1 if there is none.
+    int64_t fr_prev(DB_TXN *txn, const int64_t i, std::string & val);
+
+  // Prepare the formatter (full values are used, no partial reads).
+    void fr_prep(GrapheneFormatter & out) const { out.partial = false; out.quant = quant; }
+
+  // Fixed-rate versions of public put/get/del methods. Timestamps are packed.
+    void fr_put(const std::string & tp, const std::string & vs, const std::string & dpolicy);
+    void fr_get_next(const std::string & t1p, GrapheneFormatter & out);
+    void fr_get_prev(const std::string & t2p, GrapheneFormatter & out);
+    void fr_get(const std::string & tp, GrapheneFormatter & out);
+    void fr_get_range(const std::string & t1p, const std::string & t2p,
+                      const std::string & dtp, const uint64_t cnt, GrapheneFormatter & out);
+    uint64_t fr_count_range(const std::string & t1p, const std::string & t2p);
+    uint64_t fr_del_range(const std::string & t1p, const std::string & t2p, const bool single,
+                          const uint64_t max_n, const int max_ms, std::string & last, bool & more);
+    void fr_rebuild_stats();
+
+  /****************************/
+  // Partitioned databases (see gr_part.cpp).
+  // Data is kept in partition databases <name>%p<k> with points
+  // k*period <= t < (k+1)*period. This database contains only
+  // information records and the list of partitions (KEY_PARTS).
+
+  // Partition number for a packed timestamp.
+    uint64_t pt_idx(const std::string & tp) const;
+
+  // List of existing partitions (sorted).
+    std::vector<uint64_t> pt_list();
+
+  // Get partition database, create it if needed (new partition, which
+  // is not in the list, is initialized). Other partitions can be closed
+  // to keep pt_max of them open (least recently used are closed first),
+  // the reference is valid until the next call.
+    GrapheneDB & pt_db(const uint64_t k, const bool create = false);
+
+  // Remove a partition database.
+    void pt_drop(const uint64_t k);
+
+  // Partitioned versions of public methods. Timestamps are packed.
+    void pt_put(const std::string & tp, const std::vector<std::string> & dat,
+                const std::string & dpolicy);
+    void pt_get_next(const std::string & t1p, GrapheneFormatter & out);
+    void pt_get_prev(const std::string & t2p, GrapheneFormatter & out);
+    void pt_get_range(const std::string & t1p, const std::string & t2p,
+                      const std::string & dtp, uint64_t cnt, GrapheneFormatter & out);
+    uint64_t pt_count_range(const std::string & t1p, const std::string & t2p);
+    void pt_del(const std::string & tp);
+    void pt_del_range(const std::string & t1p, const std::string & t2p,
+                      const uint64_t max_n, const int max_ms, const int pause_ms, GrapheneDelCB cb);
+    GrapheneStats pt_get_stats();
+    void pt_rebuild_stats();
+
+  /****************************/
+  // Archives (see gr_arch.cpp).
+  // Old points can be moved to immutable archive files. KEY_ARCH record
+  // contains the list of archives, "<t2> <file>" lines: archive contains
+  // points with t2 of the previous archive < t <= t2 (time units).
+  // Newer points are kept in the database. KEY_ARCH_LOCK record contains
+  // t2 of an archive being written, writes up to it are rejected.
+
+  // List of archives, empty if there are none.
+    std::vector<std::pair<uint64_t, std::string> > ar_list(DB_TXN *txn = NULL);
+
+  // Open an archive file.
+    GrapheneArch & ar_open(const std::string & file);
+
+  // Throw an error if the packed timestamp is in the archived range
+  // or in the range being archived. Writers call it in their transaction.
+    void ar_check(DB_TXN *txn, const std::string & tp);
+
+  // Remove the first k archives.
+    void ar_drop(const size_t k);
+
+  // Archive parts of get_* queries. Timestamps are packed. If archived
+  // range is used, t1p is moved to the first timestamp after it.
+  // ar_get_next and ar_get_range return true if the query is finished.
+    bool ar_get_next(std::string & t1p, GrapheneFormatter & out);
+    void ar_get_prev(const std::string & t2p, GrapheneFormatter & out);
+    bool ar_get_range(std::string & t1p, const std::string & t2p,
+                      const std::string & dtp, uint64_t & cnt, GrapheneFormatter & out);
+    uint64_t ar_count_range(std::string & t1p, const std::string & t2p);
+
   public:
 
   /************************************/
   // Constructor -- open a database
   // Path is a path to the database foolder.
   // Name is a database name, it can not contain some symbols (.|+ \n\t)
+  // db_flags are used for DB->set_flags when a new database is created
+  // (e.g. DB_RECNUM).
+  // If container is not empty the database is a subdatabase <name>
+  // in the <container>.db file (environment is needed).
+  // If txn is not NULL the database is opened in this transaction.
   GrapheneDB(DB_ENV *env,
        const std::string & path_,
        const std::string & name_,
-       const int flags);
+       const int flags,
+       const uint32_t db_flags = 0,
+       const std::string & container = "",
+       DB_TXN *txn = NULL);
 
   // change database description
   void set_descr(const std::string & d){ descr = d; write_info(); }
@@ -139,6 +429,30 @@ class GrapheneDB{
   // Set data type. Do it only after creating a new database.
   void set_dtype(const DataType & t){ dtype = t; write_info(); }
 
+  // Set database options. Do it only after creating a new database.
+  // Options are not checked here, see GrapheneEnv::dbcreate.
+  // Known options:
+  //   step -- fold runs of equal values: if a new point has the same
+  //           value as two previous ones, the middle point is removed.
+  //           Each run is stored as its first and last points, get and
+  //           interpolation give same values as without folding, get_prev
+  //           inside a run returns the run value at the requested time.
+  //   scale, offset -- quantization parameters for Q16, Q24, Q32 data types:
+  //           value = offset + scale*code (default 1 and 0).
+  //   period -- fixed-rate database with points at t0 + i*period,
+  //           only these timestamps can be written, others are rounded
+  //           to the nearest grid point.
+  //   t0     -- start of the time grid for fixed-rate databases (default 0)
+  //   block  -- number of points in a block for fixed-rate databases (default 256)
+  //   cols   -- number of data columns for fixed-rate databases (default 1)
+  //   partition -- keep data in partition databases, one per this time period
+  //   retention -- keep only data newer then this time (see GrapheneEnv::trim)
+  //   archive   -- move data older then this time to archives (see GrapheneEnv::archive_all)
+  void set_opts(const Opt & o);
+
+  // get database options
+  Opt get_opts() const { return dbopts; }
+
   // get database description
   std::string get_descr() const { return descr; }
 
@@ -148,9 +462,53 @@ class GrapheneDB{
   // get timestamp type
   TimeType get_ttype() const { return ttype; }
 
+  // get quantization parameters
+  DataQuant get_quant() const { return quant; }
+
+  // get database version
+  int get_version() const { return version; }
+
   // is the database opened readonly?
   bool is_readonly() const {return open_flags & DB_RDONLY;}
 
+  // is the database a record-number B-tree?
+  bool is_recnum() const {return recnum;}
+
+  // is it a fixed-rate database?
+  bool is_fixed() const {return fr_period>0;}
+
+  // is it a partitioned database?
+  bool is_partitioned() const {return pt_period>0;}
+
+  // names of partition databases
+  std::vector<std::string> part_names();
+
+  // folder with archive files (default: database folder)
+  void set_arch_dir(const std::string & d) { ar_dir = d; }
+
+  // Scan strategy for get_range with dt>0 (GrapheneScanMode,
+  // SCAN_AUTO by default, fixed strategies are used for benchmarks).
+  void set_scan_mode(const int m) { scan_mode = m; }
+
+  // Limit number of open partitions (0 - no limit), number of open
+  // database handles (the database and its partitions).
+  void set_max_parts(const size_t n) { pt_max = n; }
+  size_t open_count() const { return 1 + pt_cache.size(); }
+
+  // names of archive files
+  std::vector<std::string> arch_files();
+
+  // rename archive files of a renamed database to its current name
+  void arch_rename();
+
+  // name of a partition database, check if a name is a partition name
+  static std::string part_name(const std::string & name, const uint64_t k);
+  static bool is_part_name(const std::string & name);
+
+  // check a database name; unlike check_name() allow partition names
+  // (for databases which are created by the program itself)
+  static void check_int_name(const std::string & name);
+
   // clear a filter
   void clear_filter(const int N);
 
@@ -194,6 +552,15 @@ class GrapheneDB{
   // database modification.
   void backup_upd(DB_TXN *txn, const std::string &t);
 
+  /****************************/
+  // Statistics:
+
+  // get database statistics; throw an error if it is not available
+  GrapheneStats get_stats();
+
+  // calculate statistics by reading all data and write it to the database
+  void rebuild_stats();
+
   /****************************/
   // Put data to the database
   // input: timestamp + vector of strings + dpolicy
@@ -204,6 +571,13 @@ class GrapheneDB{
   void put(const std::string &t, const std::vector<std::string> & dat,
            const std::string &dpolicy);
 
+  // Write many points with bulk puts (see gr_dump.cpp), replacing
+  // existing ones. Input: packed timestamps and values, sorted by time,
+  // without duplicated timestamps. Not supported for fixed-rate,
+  // partitioned and step databases (see can_put_bulk).
+  void put_bulk(const std::vector<std::pair<std::string, std::string> > & recs);
+  bool can_put_bulk() const { return !fr_period && !pt_period && !step; }
+
   // All get* functions get some data from the database
   // and call cb for each key-value pair
 
@@ -224,15 +598,50 @@ class GrapheneDB{
   void get_count(const std::string &t1,
                  const std::string &count, GrapheneFormatter & out);
 
+  // get every k-th point in the range (DB_RECNUM databases only)
+  void get_range_idx(const std::string &t1, const std::string &t2,
+                     const uint64_t k, GrapheneFormatter & out);
+
+  // count points in the range. For DB_RECNUM databases it
+  // takes logarithmic time, for others all keys are read.
+  uint64_t count_range(const std::string &t1, const std::string &t2);
+
   // delete data data from the database -- del_range
   void del(const std::string &t1);
 
   // delete data data from the database -- del_range
-  void del_range(const std::string &t1, const std::string &t2);
+  // Points can be deleted in a few transactions: each one deletes at most
+  // max_n points (0 - no limit; fixed-rate databases are processed by
+  // whole blocks) and lasts at most max_ms milliseconds (0 - no limit),
+  // with pause_ms ms pause between transactions. Every transaction updates
+  // statistics and backup timers, an interrupted deletion can be repeated.
+  void del_range(const std::string &t1, const std::string &t2,
+                 const uint64_t max_n = 0, const int max_ms = 0, const int pause_ms = 0,
+                 GrapheneDelCB cb = GrapheneDelCB());
+
+  // delete at most n oldest points with timestamps <= t2 (one
+  // del_range call, expired partitions are dropped as a whole),
+  // return number of deleted points. Used for retention (see GrapheneEnv::trim).
+  uint64_t trim(const std::string &t2, const uint64_t n);
+
+  // Move points with timestamps <= t2 to a new archive file (see gr_arch.cpp).
+  // Points are removed from the database in transactions of at most n points
+  // with pause_ms pauses between them. Archived data is read by all get*
+  // methods, it can not be modified, expired archives are removed by trim.
+  // Return number of archived points. Not supported for fixed-rate,
+  // partitioned and recnum databases.
+  uint64_t archive(const std::string &t2, const uint64_t n, const int pause_ms = 0);
 
   // sync the database
   void sync() {dbp->sync(dbp.get(), 0);}
 
+  // Compact the database and return free pages at the end of the file to
+  // the file system (DB->compact with DB_FREE_SPACE). Work is done in steps
+  // which free at most max_pages pages (0 - no limit), in txn environment
+  // each step uses short internal transactions. Partitions are also compacted.
+  // Numbers of freed and truncated pages are added to freed and truncated.
+  void compact(const uint32_t max_pages, uint64_t & freed, uint64_t & truncated);
+
   // load file in a db_dump format
   // (we can not use db_load because of user-defined comparison function)
   void load(const std::string &file);
@@ -241,6 +650,27 @@ class GrapheneDB{
   // (db_dump utility can be used instead)
   void dump(const std::string &file);
 
+  // Binary dump with checksums and optional zlib compression,
+  // file "-" is stdout/stdin (see gr_dump.cpp).
+  // load_bin should be used with an empty database.
+  void dump_bin(const std::string &file, const bool zlib = false);
+  void load_bin(const std::string &file);
+
+  // Incremental backup (see gr_dump.cpp): write points with timestamps
+  // >= main backup timer to an increment file, then commit the backup
+  // timer (same as backup_start/backup_end). Return number of points.
+  uint64_t backup_inc(const std::string &file, const bool zlib = true);
+
+  // Apply an increment: delete points with timestamps >= its start time
+  // (del_range with given chunk parameters), write points from the file.
+  // Return number of points.
+  uint64_t restore_inc(const std::string &file, const uint64_t del_n = 0,
+                       const int del_ms = 0, const int del_pause = 0);
+
+  // Read header of an increment file: name, dtype, ttype, t1,
+  // recnum, database options, descr.
+  static Opt inc_header(const std::string &file);
+
 };
 
 #endif
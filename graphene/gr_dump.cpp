@@ -0,0 +1,531 @@
+/* Binary dump format: GrapheneDB::dump_bin and load_bin methods,
+   incremental backups (GrapheneDB::backup_inc and restore_inc),
+   bulk writing (GrapheneDB::put_bulk). Same blocks are used in
+   archive files (gr_arch.cpp).
+
+   File structure (numbers are 32-bit, host byte order):
+     magic "GRDUMP01", flags (GRDUMP_ZLIB), header length, header text,
+     blocks, end block.
+   Header text contains "<key> <value>" lines (name, dtype, ttype, version,
+   descr; newlines and backslashes in values are escaped as "\n" and "\\"),
+   it is for information only: all database records, including
+   information records, are stored in blocks.
+   Block: data size, stored size, CRC32 of the data, stored data (data
+   compressed by zlib if GRDUMP_ZLIB flag is set). Data is a sequence of
+   records: key size, value size, key, value. End block has zero sizes.
+
+   Increment files have same structure with magic "GRINC001". Header
+   contains database parameters needed for restoring (name, dtype,
+   ttype, start time t1, recnum, database options, descr is the last
+   line), blocks contain data points with timestamps >= t1.
+*/
+
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <zlib.h>
+#include "gr_db.h"
+#include "gr_arch.h"
+
+using namespace std;
+
+#define GRDUMP_MAGIC "GRDUMP01"
+#define GRINC_MAGIC  "GRINC001"
+#define GRDUMP_ZLIB  1
+#define GRDUMP_BLOCK (1<<20) // block size
+#define GRDUMP_BULK  (4<<20) // buffer size for bulk puts
+
+/************************************/
+// Open/close input or output file ("-" for stdin/stdout)
+static FILE *
+grdump_open(const string & file, const bool wr){
+  if (file == "-") return wr? stdout:stdin;
+  FILE *f = fopen(file.c_str(), wr? "wb":"rb");
+  if (!f) throw Err() << file << ": " << strerror(errno);
+  return f;
+}
+
+static void
+grdump_close(FILE *f, const string & file){
+  if (f==stdout) { fflush(f); return; }
+  if (f==stdin) return;
+  if (fclose(f)!=0) throw Err() << file << ": " << strerror(errno);
+}
+
+static void
+grdump_write(FILE *f, const string & file, const void *buf, const size_t size){
+  if (size && fwrite(buf, 1, size, f) != size)
+    throw Err() << file << ": write error: " << strerror(errno);
+}
+
+static void
+grdump_write32(FILE *f, const string & file, const uint32_t v){
+  grdump_write(f, file, &v, sizeof(v));
+}
+
+static void
+grdump_read(FILE *f, const string & file, void *buf, const size_t size){
+  if (size && fread(buf, 1, size, f) != size)
+    throw Err() << file << ": unexpected end of file";
+}
+
+static uint32_t
+grdump_read32(FILE *f, const string & file){
+  uint32_t v;
+  grdump_read(f, file, &v, sizeof(v));
+  return v;
+}
+
+// write a block of records
+void
+grdump_write_block(FILE *f, const string & file, const string & data, const bool zlib){
+  uint32_t crc = crc32(0L, (const Bytef *)data.data(), data.size());
+  string buf;
+  if (zlib){
+    uLongf len = compressBound(data.size());
+    buf.resize(len);
+    if (compress2((Bytef *)&buf[0], &len, (const Bytef *)data.data(),
+                  data.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+      throw Err() << file << ": compression error";
+    buf.resize(len);
+  }
+  const string & out = zlib? buf:data;
+  grdump_write32(f, file, data.size());
+  grdump_write32(f, file, out.size());
+  grdump_write32(f, file, crc);
+  grdump_write(f, file, out.data(), out.size());
+}
+
+// read a block of records, return false for the end block
+static bool
+grdump_read_block(FILE *f, const string & file, string & data, const bool zlib){
+  uint32_t size  = grdump_read32(f, file);
+  uint32_t ssize = grdump_read32(f, file);
+  uint32_t crc   = grdump_read32(f, file);
+  if (size==0 && ssize==0) return false;
+  if (!zlib && size!=ssize) throw Err() << file << ": broken block";
+
+  string buf(ssize, '\0');
+  grdump_read(f, file, &buf[0], ssize);
+  grdump_decode_block(file, buf, size, crc, zlib, data);
+  return true;
+}
+
+// decode stored data of a block, check the checksum
+void
+grdump_decode_block(const string & file, string & buf, const uint32_t size,
+                    const uint32_t crc, const bool zlib, string & data){
+  if (zlib){
+    data.resize(size);
+    uLongf len = size;
+    if (uncompress((Bytef *)&data[0], &len, (const Bytef *)buf.data(), buf.size()) != Z_OK ||
+        len!=size)
+      throw Err() << file << ": decompression error";
+  }
+  else data.swap(buf);
+  if (crc32(0L, (const Bytef *)data.data(), data.size()) != crc)
+    throw Err() << file << ": checksum error";
+}
+
+// write file header
+static void
+grdump_write_head(FILE *f, const string & file, const char *magic,
+                  const string & h, const bool zlib){
+  grdump_write(f, file, magic, 8);
+  grdump_write32(f, file, zlib? GRDUMP_ZLIB:0);
+  grdump_write32(f, file, h.size());
+  grdump_write(f, file, h.data(), h.size());
+}
+
+// read file header, return header text
+static string
+grdump_read_head(FILE *f, const string & file, const char *magic,
+                 const char *descr, bool & zlib){
+  char m[8];
+  grdump_read(f, file, m, 8);
+  if (string(m, 8) != magic)
+    throw Err() << file << ": not a graphene " << descr;
+  zlib = grdump_read32(f, file) & GRDUMP_ZLIB;
+  string h(grdump_read32(f, file), '\0');
+  grdump_read(f, file, &h[0], h.size());
+  return h;
+}
+
+// escape/unescape header values: "\\" for backslash, "\\n" for newline
+static string
+grdump_esc(const string & s){
+  string ret;
+  for (auto c: s){
+    if (c=='\\') ret += "\\\\";
+    else if (c=='\n') ret += "\\n";
+    else ret += c;
+  }
+  return ret;
+}
+
+static string
+grdump_unesc(const string & file, const string & s){
+  string ret;
+  for (size_t i=0; i<s.size(); i++){
+    if (s[i]!='\\') { ret += s[i]; continue; }
+    if (++i==s.size()) throw Err() << file << ": broken header";
+    if (s[i]=='n') ret += '\n';
+    else if (s[i]=='\\') ret += '\\';
+    else throw Err() << file << ": broken header";
+  }
+  return ret;
+}
+
+// get next record from block data (key and value sizes in s),
+// return false at the end of the block
+static bool
+grdump_get_rec(const string & file, string & data, size_t & pos,
+               char **kd, char **vd, uint32_t s[2]){
+  if (pos >= data.size()) return false;
+  if (pos + 2*sizeof(uint32_t) > data.size()) throw Err() << file << ": broken block";
+  memcpy(s, data.data()+pos, 2*sizeof(uint32_t));
+  pos += 2*sizeof(uint32_t);
+  if (pos + s[0] + s[1] > data.size()) throw Err() << file << ": broken block";
+  *kd = &data[pos];
+  *vd = &data[pos+s[0]];
+  pos += s[0] + s[1];
+  return true;
+}
+
+/************************************/
+void
+GrapheneDB::dump_bin(const string & file, const bool zlib){
+  if (pt_period) throw Err() << name << ".db: "
+    << "dump is not supported for partitioned databases, dump partitions instead";
+  FILE *f = grdump_open(file, true);
+
+  DBC *curs = NULL;
+  try {
+    // header
+    ostringstream hs;
+    hs << "name "    << name << "\n"
+       << "dtype "   << graphene_dtype_name(dtype) << "\n"
+       << "ttype "   << graphene_ttype_name(ttype) << "\n"
+       << "version " << (int)version << "\n"
+       << "descr "   << grdump_esc(descr) << "\n";
+    grdump_write_head(f, file, GRDUMP_MAGIC, hs.str(), zlib);
+
+    // all records in the key order
+    get_cursor(dbp.get(), NULL, &curs, 0);
+    DBT k = mk_dbt();
+    DBT v = mk_dbt();
+    string data;
+    while (c_get(curs, &k, &v, DB_NEXT)){
+      uint32_t s[2] = {k.size, v.size};
+      data.append((char *)s, sizeof(s));
+      data.append((char *)k.data, k.size);
+      data.append((char *)v.data, v.size);
+      if (data.size() >= GRDUMP_BLOCK){
+        grdump_write_block(f, file, data, zlib);
+        data.clear();
+      }
+    }
+    curs->close(curs);
+    curs = NULL;
+    if (data.size()) grdump_write_block(f, file, data, zlib);
+
+    // end block
+    for (int i=0; i<3; i++) grdump_write32(f, file, 0);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    if (f!=stdout) fclose(f);
+    throw e;
+  }
+  grdump_close(f, file);
+}
+
+/************************************/
+// Records are written with bulk puts (DB_MULTIPLE_KEY), one
+// transaction for each buffer. Records in the dump are sorted,
+// B-tree pages are filled sequentially.
+void
+GrapheneDB::load_bin(const string & file){
+  FILE *f = grdump_open(file, false);
+
+  // bulk buffer
+  string buf(GRDUMP_BULK, '\0');
+  DBT bulk = mk_dbt();
+  bulk.data = &buf[0];
+  bulk.ulen = buf.size();
+  bulk.flags = DB_DBT_USERMEM;
+  void *p;
+  size_t nrec = 0;
+
+  // write the buffer, start a new one
+  auto bulk_put = [&](){
+    if (nrec){
+      DBT v = mk_dbt();
+      DB_TXN *txn = txn_begin();
+      int res = dbp->put(dbp.get(), txn, &bulk, &v, DB_MULTIPLE_KEY);
+      if (res!=0){
+        txn_abort(txn);
+        throw Err() << name << ".db: " << db_strerror(res);
+      }
+      txn_commit(txn);
+    }
+    DB_MULTIPLE_WRITE_INIT(p, &bulk);
+    nrec = 0;
+  };
+
+  try {
+    bool zlib;
+    grdump_read_head(f, file, GRDUMP_MAGIC, "binary dump", zlib);
+
+    DB_MULTIPLE_WRITE_INIT(p, &bulk);
+    string data;
+    while (grdump_read_block(f, file, data, zlib)){
+      size_t pos = 0;
+      uint32_t s[2];
+      char *kd, *vd;
+      while (grdump_get_rec(file, data, pos, &kd, &vd, s)){
+        DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk, kd, s[0], vd, s[1]);
+        if (p) { nrec++; continue; }
+
+        // buffer is full
+        bulk_put();
+        DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk, kd, s[0], vd, s[1]);
+        if (p) { nrec++; continue; }
+
+        // record is larger then the buffer
+        DBT k1 = mk_dbt(), v1 = mk_dbt();
+        k1.data = kd; k1.size = s[0];
+        v1.data = vd; v1.size = s[1];
+        DB_TXN *txn = txn_begin();
+        int res = dbp->put(dbp.get(), txn, &k1, &v1, 0);
+        if (res!=0){
+          txn_abort(txn);
+          throw Err() << name << ".db: " << db_strerror(res);
+        }
+        txn_commit(txn);
+        DB_MULTIPLE_WRITE_INIT(p, &bulk);
+      }
+    }
+    bulk_put();
+  }
+  catch (Err e){
+    if (f!=stdin) fclose(f);
+    throw e;
+  }
+  grdump_close(f, file);
+}
+
+/************************************/
+// Formatter for writing points to an increment file
+class GrapheneIncFormatter: public GrapheneFormatter {
+  FILE *f;
+  const string & file;
+  bool zlib;
+  string data;
+  public:
+  uint64_t n;
+  GrapheneIncFormatter(FILE *f_, const string & file_, const bool zlib_):
+    f(f_), file(file_), zlib(zlib_), n(0) {}
+
+  void proc_point(const string &k, const string &v,
+                  const TimeType ttype, const DataType dtype) override {
+    uint32_t s[2] = {(uint32_t)k.size(), (uint32_t)v.size()};
+    data.append((char *)s, sizeof(s));
+    data.append(k);
+    data.append(v);
+    n++;
+    if (data.size() >= GRDUMP_BLOCK) flush();
+  }
+
+  void flush(){
+    if (data.size()) grdump_write_block(f, file, data, zlib);
+    data.clear();
+  }
+};
+
+// Points are read by get_range, so partitions and archives are
+// included. The file is written through a temporary one; backup
+// timer is committed only after it is renamed.
+uint64_t
+GrapheneDB::backup_inc(const string & file, const bool zlib){
+  string t1 = backup_start();
+  string tmp = file + ".tmp";
+  FILE *f = grdump_open(tmp, true);
+  uint64_t n = 0;
+  try {
+    ostringstream hs;
+    hs << "name "  << name << "\n"
+       << "dtype " << graphene_dtype_name(dtype) << "\n"
+       << "ttype " << graphene_ttype_name(ttype) << "\n"
+       << "t1 "    << t1 << "\n";
+    if (recnum) hs << "recnum 1\n";
+    for (auto const & o: dbopts) hs << o.first << " " << grdump_esc(o.second) << "\n";
+    hs << "descr " << grdump_esc(descr) << "\n";
+    grdump_write_head(f, tmp, GRINC_MAGIC, hs.str(), zlib);
+
+    GrapheneIncFormatter out(f, tmp, zlib);
+    get_range(t1, "inf", "0", out);
+    out.flush();
+    n = out.n;
+
+    // end block
+    for (int i=0; i<3; i++) grdump_write32(f, tmp, 0);
+    if (fflush(f)!=0 || fsync(fileno(f))!=0)
+      throw Err() << tmp << ": " << strerror(errno);
+  }
+  catch (Err e){
+    fclose(f);
+    remove(tmp.c_str());
+    throw e;
+  }
+  grdump_close(f, tmp);
+  if (rename(tmp.c_str(), file.c_str())!=0){
+    int e = errno;
+    remove(tmp.c_str());
+    throw Err() << file << ": " << strerror(e);
+  }
+  backup_end("inf");
+  return n;
+}
+
+Opt
+GrapheneDB::inc_header(const string & file){
+  FILE *f = grdump_open(file, false);
+  string h;
+  try {
+    bool zlib;
+    h = grdump_read_head(f, file, GRINC_MAGIC, "increment", zlib);
+  }
+  catch (Err e){
+    fclose(f);
+    throw e;
+  }
+  grdump_close(f, file);
+
+  Opt ret;
+  istringstream hs(h);
+  string l;
+  while (getline(hs, l)){
+    size_t p = l.find(' ');
+    if (p==string::npos) throw Err() << file << ": broken header";
+    ret[l.substr(0,p)] = grdump_unesc(file, l.substr(p+1));
+  }
+  return ret;
+}
+
+// Timestamps are converted if time types are different,
+// points are written by bulk puts if possible. Applying an
+// increment can be repeated if it was interrupted.
+uint64_t
+GrapheneDB::restore_inc(const string & file, const uint64_t del_n,
+                        const int del_ms, const int del_pause){
+  Opt h = inc_header(file);
+  if (graphene_dtype_parse(h.get<string>("dtype")) != dtype)
+    throw Err() << file << ": data type differs from " << name << ".db";
+  if (graphene_dtype_quant(dtype) && (h.get("scale", 1.0)!=quant.scale ||
+      h.get("offset", 0.0)!=quant.offset))
+    throw Err() << file << ": quantization differs from " << name << ".db";
+  TimeType tt = graphene_ttype_parse(h.get<string>("ttype"));
+
+  del_range(h.get<string>("t1"), "inf", del_n, del_ms, del_pause);
+
+  FILE *f = grdump_open(file, false);
+  uint64_t n = 0;
+  try {
+    bool zlib;
+    grdump_read_head(f, file, GRINC_MAGIC, "increment", zlib);
+    string data;
+    vector<pair<string, string> > recs;
+    while (grdump_read_block(f, file, data, zlib)){
+      recs.clear();
+      size_t pos = 0;
+      uint32_t s[2];
+      char *kd, *vd;
+      while (grdump_get_rec(file, data, pos, &kd, &vd, s)){
+        string k(kd, s[0]);
+        if (tt!=ttype) k = graphene_time_parse(graphene_time_print(k, tt), ttype);
+        if (recs.size() && recs.back().first == k) recs.back().second = string(vd, s[1]);
+        else recs.emplace_back(k, string(vd, s[1]));
+      }
+      if (can_put_bulk()) put_bulk(recs);
+      else
+        for (auto const & r: recs)
+          put(graphene_time_print(r.first, ttype),
+              graphene_data_print(r.second, -1, dtype, quant), "replace");
+      n += recs.size();
+    }
+  }
+  catch (Err e){
+    fclose(f);
+    throw e;
+  }
+  grdump_close(f, file);
+  return n;
+}
+
+/************************************/
+// Same bulk puts for sorted points. Statistics is updated in
+// the same transactions if new points do not overlap with
+// existing data, otherwise it is rebuilt at the end.
+void
+GrapheneDB::put_bulk(const vector<pair<string, string> > & recs){
+  if (!can_put_bulk())
+    throw Err() << name << ".db: bulk writing is not supported for this database";
+  if (recs.empty()) return;
+
+  GrapheneStats st;
+  bool use_st = stats_read(NULL, st);
+  bool st_inc = use_st && (st.count==0 ||
+    graphene_time_cmp(recs.back().first, st.first, ttype)<0 ||
+    graphene_time_cmp(recs.front().first, st.last, ttype)>0);
+
+  string buf(GRDUMP_BULK, '\0');
+  DBT bulk = mk_dbt();
+  bulk.data = &buf[0];
+  bulk.ulen = buf.size();
+  bulk.flags = DB_DBT_USERMEM;
+  void *p;
+
+  size_t i = 0;
+  while (i < recs.size()){
+    // fill the buffer
+    size_t i0 = i;
+    DB_MULTIPLE_WRITE_INIT(p, &bulk);
+    for (; i<recs.size(); i++){
+      DB_MULTIPLE_KEY_WRITE_NEXT(p, &bulk,
+        (void *)recs[i].first.data(), recs[i].first.size(),
+        (void *)recs[i].second.data(), recs[i].second.size());
+      if (!p) break;
+    }
+
+    DB_TXN *txn = txn_begin();
+    try {
+      ar_check(txn, recs[i0].first);
+      int res;
+      if (i==i0){ // record is larger then the buffer
+        DBT k = mk_dbt(recs[i].first);
+        DBT v = mk_dbt(recs[i].second);
+        res = dbp->put(dbp.get(), txn, &k, &v, 0);
+        i++;
+      }
+      else {
+        DBT v = mk_dbt();
+        res = dbp->put(dbp.get(), txn, &bulk, &v, DB_MULTIPLE_KEY);
+      }
+      if (res!=0) throw Err() << name << ".db: " << db_strerror(res);
+      backup_upd(txn, recs[i0].first);
+      if (st_inc){
+        stats_read(txn, st);
+        for (size_t j=i0; j<i; j++)
+          st.add(recs[j].first, graphene_data_values(recs[j].second, dtype, quant), ttype);
+        stats_write(txn, st);
+      }
+    }
+    catch (Err e){
+      txn_abort(txn);
+      throw e;
+    }
+    txn_commit(txn);
+  }
+  if (use_st && !st_inc) rebuild_stats();
+}
@@ -2,23 +2,50 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <sstream>
 #include <algorithm>
 #include <cstring> /* memset */
 #include <db.h>
 #include <dirent.h>
 #include <errno.h>
+#include <csignal>
+#include <iostream>
+#include <fstream>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 #include "gr_env.h"
 #include "gr_db.h"
+#include "gr_metrics.h"
+#include "gr_snap.h"
 #include "err/err.h"
 
 
+DataType
+graphene_create_fmt_parse(const std::string & fmt, Opt & opts){
+  std::istringstream in(fmt);
+  std::string s;
+  std::getline(in, s, ',');
+  DataType dtype = graphene_dtype_parse(s);
+  while (std::getline(in, s, ',')){
+    if (s=="") continue;
+    size_t p = s.find('=');
+    if (p==std::string::npos) opts[s] = "1";
+    else opts[s.substr(0,p)] = s.substr(p+1);
+  }
+  return dtype;
+}
+
 GrapheneEnvFormatter::GrapheneEnvFormatter(GrapheneTCL & tcl_,
           const std::string & ext_name, GrapheneEnv & env_):
           col(-1), flt_num(-1), timefmt(TFMT_DEF), list(false),
-          fmt_cb(NULL), fmt_cb_data(NULL), tcl(tcl_), env(env_) {
+          fmt_cb(NULL), fmt_cb_data(NULL), tcl(tcl_), env(env_),
+          npoints(0), nbytes(0), flt_time(0) {
+
+  query_time = env.get_query_time();
+  gettimeofday(&tstart, NULL);
 
   // split secondary database names using '+' delimiter
   name = ext_name;
@@ -31,6 +58,14 @@ GrapheneEnvFormatter::GrapheneEnvFormatter(GrapheneTCL & tcl_,
 
   name = parse_ext_name(name, col, flt_num);
   if (flt_num>0) filter = env.getdb(name, DB_RDONLY).get_filter(flt_num);
+
+  // without filters only one column can be read from the database
+  if (filter=="") need_col = col;
+}
+
+GrapheneEnvFormatter::~GrapheneEnvFormatter(){
+  if (npoints) metrics_read(name, npoints, nbytes);
+  if (filter!="") metrics_filter(name, flt_time);
 }
 
 
@@ -51,16 +86,40 @@ GrapheneTCLGet::run(const std::vector<std::string> & args) {
 }
 
 
+int
+GrapheneEnvFormatter::time_left(){
+  if (query_time<=0) return 0;
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int tmax = query_time - (tv.tv_sec-tstart.tv_sec)*1000
+                        - (tv.tv_usec-tstart.tv_usec)/1000;
+  if (tmax<=0) throw Err() << "query time limit exceeded: " << query_time << " ms";
+  return tmax;
+}
+
 void
 GrapheneEnvFormatter::proc_point(const std::string &ks, const std::string &vs,
     const TimeType ttype, const DataType dtype) {
 
+  // check the query time budget
+  int tmax = time_left();
+
   auto t = graphene_time_print(ks, ttype, timefmt, time0);
-  auto d = graphene_data_print(vs, (filter == "" ? col:-1), dtype); // use all columns for filters
+  // use all columns for filters; if the value was read partially
+  // it contains only the needed column (or beginning of a text,
+  // without a cut UTF-8 character at the end)
+  auto d = graphene_data_print((partial && dtype==DATA_TEXT)? graphene_utf8_cut(vs) : vs,
+     (partial && dtype!=DATA_TEXT)? 0 : (filter == "" ? col:-1), dtype, quant);
 
-  // run filters
+  // run filters (filter time is limited by the rest of the query budget)
   std::string storage; // output filters do not use storage, but we need to provide the variable
-  if (!tcl.run(filter, t,d,storage)) return;
+  if (filter!=""){
+    auto t0 = std::chrono::steady_clock::now();
+    bool res = tcl.run(filter, t,d,storage, tmax);
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    flt_time += dt.count();
+    if (!res) return;
+  }
 
   // add data from secondary databases
   for (const auto & s:secondary){
@@ -75,6 +134,10 @@ GrapheneEnvFormatter::proc_point(const std::string &ks, const std::string &vs,
     if (n!=std::string::npos) d[0].resize(n);
   }
 
+  npoints++;
+  nbytes += t.size() + 1;
+  for (auto const & v:d) nbytes += v.size() + 1;
+
   if (fmt_cb) (fmt_cb)(t, d, fmt_cb_data);
 }
 
@@ -87,8 +150,79 @@ GrapheneEnvFormatter::proc_point(const std::string &ks, const std::string &vs,
 
 // Constructor: open DB environment
 GrapheneEnv::GrapheneEnv(const std::string & dbpath_, const bool readonly_,
-                         const std::string & env_type_, const std::string & tcl_libdir):
-    dbpath(dbpath_), env_type(env_type_), readonly(readonly_), tcl(tcl_libdir), tcl_get_cmd(*this) {
+                         const std::string & env_type_, const std::string & tcl_libdir,
+                         const Opt & opts):
+    dbpath(dbpath_), env_type(env_type_), readonly(readonly_), tcl(tcl_libdir), tcl_get_cmd(*this),
+    durability("sync"), bg_stop(false), cat_names(false), cat_changed(false), cat_fd(-1) {
+
+  // resource limits for filters and queries
+  tcl.set_limits(opts.get("filter_time", 0), opts.get("filter_cmds", 0));
+  query_time = opts.get("query_time", 0);
+  if (query_time<0) throw Err() << "bad query time limit: " << query_time;
+  list_len = opts.get("list_len", 1024);
+  if (list_len<0) throw Err() << "bad list_len setting: " << list_len;
+
+  group_time = opts.get("group_time", 100);
+  if (group_time<=0) throw Err() << "bad group_time setting: " << group_time;
+
+  maintain_time  = opts.get("maintain_time", 0);
+  checkpoint_kb  = opts.get("checkpoint_kb", 1024);
+  checkpoint_min = opts.get("checkpoint_min", 10);
+  if (maintain_time<0) throw Err() << "bad maintain_time setting: " << maintain_time;
+  if (checkpoint_kb<0) throw Err() << "bad checkpoint_kb setting: " << checkpoint_kb;
+  if (checkpoint_min<0) throw Err() << "bad checkpoint_min setting: " << checkpoint_min;
+  if (maintain_time>0 && env_type!="txn")
+    throw Err() << "maintenance can be used only in txn environment";
+
+  trim_chunk = opts.get("trim_chunk", 1000);
+  trim_pause = opts.get("trim_pause", 10);
+  if (trim_chunk<=0) throw Err() << "bad trim_chunk setting: " << trim_chunk;
+  if (trim_pause<0) throw Err() << "bad trim_pause setting: " << trim_pause;
+
+  del_chunk = opts.get("del_chunk", 0);
+  del_time  = opts.get("del_time", 0);
+  del_pause = opts.get("del_pause", 0);
+  if (del_chunk<0) throw Err() << "bad del_chunk setting: " << del_chunk;
+  if (del_time<0)  throw Err() << "bad del_time setting: " << del_time;
+  if (del_pause<0) throw Err() << "bad del_pause setting: " << del_pause;
+
+  compact_pages = opts.get("compact_pages", 1000);
+  if (compact_pages<0) throw Err() << "bad compact_pages setting: " << compact_pages;
+
+  import_threads = opts.get("import_threads", (int)std::thread::hardware_concurrency());
+  if (import_threads<0) throw Err() << "bad import_threads setting: " << import_threads;
+  if (import_threads==0) import_threads = 1;
+
+  int log_size = opts.get("log_size", GRAPHENE_LOGSIZE);
+  if (log_size<=0) throw Err() << "bad log_size setting: " << log_size;
+
+  int mo = opts.get("max_open", 0);
+  if (mo<0) throw Err() << "bad max_open setting: " << mo;
+  max_open = mo;
+
+  container = opts.get("container", std::string());
+  arch_dir = opts.get("arch_dir", dbpath);
+  std::string sm = opts.get("scan_mode", std::string("auto"));
+  if      (sm=="auto") scan_mode = SCAN_AUTO;
+  else if (sm=="seek") scan_mode = SCAN_SEEK;
+  else if (sm=="next") scan_mode = SCAN_NEXT;
+  else throw Err() << "bad scan_mode setting: " << sm;
+  if (container!=""){
+    check_name(container);
+    if (env_type == "none")
+      throw Err() << "container can not be used without DB environment";
+  }
+
+  // database catalog: load saved entries, watch the directory
+  if (container==""){
+    cat_load();
+    cat_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cat_fd>=0 && inotify_add_watch(cat_fd, dbpath.c_str(),
+          IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0){
+      ::close(cat_fd);
+      cat_fd = -1;
+    }
+  }
 
   if (env_type == "none"){
     // no invironment
@@ -103,10 +237,42 @@ GrapheneEnv::GrapheneEnv(const std::string & dbpath_, const bool readonly_,
   env = std::shared_ptr<DB_ENV>(e, GrapheneEnv::D());
 
   // set logfile size
-  res = env->set_lg_max(env.get(), GRAPHENE_LOGSIZE);
+  res = env->set_lg_max(env.get(), log_size);
   if (res != 0)
     throw Err() << "set_lg_max failed: " << db_strerror(res);
 
+  // cache size
+  int cache_size = opts.get("cache_size", 0);
+  if (cache_size<0) throw Err() << "bad cache_size setting: " << cache_size;
+  if (cache_size>0) {
+    res = env->set_cachesize(env.get(), cache_size/1024, (cache_size%1024)<<20, 1);
+    if (res != 0) throw Err() << "set_cachesize failed: " << db_strerror(res);
+  }
+
+  // max size of memory-mapped files
+  int mmap_size = opts.get("mmap_size", 0);
+  if (mmap_size<0) throw Err() << "bad mmap_size setting: " << mmap_size;
+  if (mmap_size>0) {
+    res = env->set_mp_mmapsize(env.get(), (size_t)mmap_size<<20);
+    if (res != 0) throw Err() << "set_mp_mmapsize failed: " << db_strerror(res);
+  }
+
+  // lock table sizes
+  int lk = opts.get("lk_max_locks", 0);
+  if (lk<0) throw Err() << "bad lk_max_locks setting: " << lk;
+  if (lk>0 && (res = env->set_lk_max_locks(env.get(), lk)) != 0)
+    throw Err() << "set_lk_max_locks failed: " << db_strerror(res);
+
+  lk = opts.get("lk_max_lockers", 0);
+  if (lk<0) throw Err() << "bad lk_max_lockers setting: " << lk;
+  if (lk>0 && (res = env->set_lk_max_lockers(env.get(), lk)) != 0)
+    throw Err() << "set_lk_max_lockers failed: " << db_strerror(res);
+
+  lk = opts.get("lk_max_objects", 0);
+  if (lk<0) throw Err() << "bad lk_max_objects setting: " << lk;
+  if (lk>0 && (res = env->set_lk_max_objects(env.get(), lk)) != 0)
+    throw Err() << "set_lk_max_objects failed: " << db_strerror(res);
+
   // deadlock detection
   res = env->set_lk_detect(env.get(), DB_LOCK_MINWRITE);
   if (res != 0)
@@ -121,7 +287,8 @@ GrapheneEnv::GrapheneEnv(const std::string & dbpath_, const bool readonly_,
             DB_INIT_TXN |     // transactions
             DB_REGISTER |     // register processes to know when recover is possible/needed
             DB_RECOVER  |     // run recover if possible/needed
-            DB_MULTIVERSION;  // for snapshot isolation
+            DB_MULTIVERSION | // for snapshot isolation
+            DB_THREAD;        // environment handle is used by the background thread
 
   else if (env_type == "lock")
     flags = DB_CREATE |
@@ -135,34 +302,391 @@ GrapheneEnv::GrapheneEnv(const std::string & dbpath_, const bool readonly_,
   if (res != 0)
     throw Err() << "opening DB_ENV: " << dbpath << ": " << db_strerror(res);
 
+  // set logfile size again: the value set before opening is
+  // used only if the environment is created
+  if (env_type == "txn"){
+    res = env->set_lg_max(env.get(), log_size);
+    if (res != 0)
+      throw Err() << "set_lg_max failed: " << db_strerror(res);
+  }
+
   // add commands to TCL interpeter
   tcl.add_cmd("graphene_get", &tcl_get_cmd);
 
+  set_durability(opts.get("durability", "sync"));
+  if (maintain_time>0 && !readonly) bg_start();
 }
 
 // Destructor: close the DB environment
 GrapheneEnv::~GrapheneEnv(){
   close();
+  bg_finish();
+  cat_save();
+  if (cat_fd>=0) ::close(cat_fd);
+}
+
+void
+GrapheneEnv::stats(std::ostream & out){
+  int ret;
+  if (!env) throw Err() << "Command can not be run without DB environment";
+
+  // memory pool (cache)
+  DB_MPOOL_STAT *ms;
+  if ((ret = env->memp_stat(env.get(), &ms, NULL, 0)) != 0)
+    throw Err() << "memp_stat failed: " << db_strerror(ret);
+  out << "cache_size "      << ((uint64_t)ms->st_gbytes<<30) + ms->st_bytes << "\n"
+      << "cache_pages "     << ms->st_pages      << "\n"
+      << "cache_dirty "     << ms->st_page_dirty << "\n"
+      << "cache_hit "       << ms->st_cache_hit  << "\n"
+      << "cache_miss "      << ms->st_cache_miss << "\n"
+      << "cache_page_in "   << ms->st_page_in    << "\n"
+      << "cache_page_out "  << ms->st_page_out   << "\n"
+      << "cache_ro_evict "  << ms->st_ro_evict   << "\n"
+      << "cache_rw_evict "  << ms->st_rw_evict   << "\n"
+      << "cache_mmap "      << ms->st_map        << "\n"
+      << "cache_mmap_size " << ms->st_mmapsize   << "\n";
+  free(ms);
+
+  // locks
+  DB_LOCK_STAT *ls;
+  if ((ret = env->lock_stat(env.get(), &ls, 0)) != 0)
+    throw Err() << "lock_stat failed: " << db_strerror(ret);
+  out << "lock_max_locks "    << ls->st_maxlocks    << "\n"
+      << "lock_max_lockers "  << ls->st_maxlockers  << "\n"
+      << "lock_max_objects "  << ls->st_maxobjects  << "\n"
+      << "lock_locks "        << ls->st_nlocks      << "\n"
+      << "lock_lockers "      << ls->st_nlockers    << "\n"
+      << "lock_objects "      << ls->st_nobjects    << "\n"
+      << "lock_maxn_locks "   << ls->st_maxnlocks   << "\n"
+      << "lock_maxn_lockers " << ls->st_maxnlockers << "\n"
+      << "lock_maxn_objects " << ls->st_maxnobjects << "\n"
+      << "lock_requests "     << ls->st_nrequests   << "\n"
+      << "lock_releases "     << ls->st_nreleases   << "\n"
+      << "lock_wait "         << ls->st_lock_wait   << "\n"
+      << "lock_nowait "       << ls->st_lock_nowait << "\n"
+      << "lock_deadlocks "    << ls->st_ndeadlocks  << "\n";
+  free(ls);
+
+  if (env_type != "txn") return;
+
+  // transactions
+  DB_TXN_STAT *ts;
+  if ((ret = env->txn_stat(env.get(), &ts, 0)) != 0)
+    throw Err() << "txn_stat failed: " << db_strerror(ret);
+  out << "txn_begins "     << ts->st_nbegins    << "\n"
+      << "txn_commits "    << ts->st_ncommits   << "\n"
+      << "txn_aborts "     << ts->st_naborts    << "\n"
+      << "txn_active "     << ts->st_nactive    << "\n"
+      << "txn_max_active " << ts->st_maxnactive << "\n"
+      << "txn_snapshot "   << ts->st_nsnapshot  << "\n"
+      << "txn_last_ckp "   << ts->st_last_ckp.file << "/" << ts->st_last_ckp.offset << "\n"
+      << "txn_time_ckp "   << ts->st_time_ckp   << "\n";
+  free(ts);
+
+  // log
+  DB_LOG_STAT *gs;
+  if ((ret = env->log_stat(env.get(), &gs, 0)) != 0)
+    throw Err() << "log_stat failed: " << db_strerror(ret);
+  out << "log_file_size "   << gs->st_lg_size << "\n"
+      << "log_written "     << ((uint64_t)gs->st_w_mbytes<<20) + gs->st_w_bytes << "\n"
+      << "log_written_ckp " << ((uint64_t)gs->st_wc_mbytes<<20) + gs->st_wc_bytes << "\n"
+      << "log_writes "      << gs->st_wcount << "\n"
+      << "log_syncs "       << gs->st_scount << "\n"
+      << "log_cur_file "    << gs->st_cur_file << "\n"
+      << "log_disk_file "   << gs->st_disk_file << "\n";
+  free(gs);
+}
+
+/****************/
+
+void
+GrapheneEnv::set_durability(const std::string & mode){
+  if (mode!="sync" && mode!="group" && mode!="nosync")
+    throw Err() << "unknown durability mode: " << mode;
+  if (env_type != "txn"){
+    if (mode!="sync") throw Err() << "durability mode "
+      << mode << " can be used only in txn environment";
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk(bg_mutex);
+
+  // group and nosync: log is written (but not flushed) on commit
+  int res = env->set_flags(env.get(), DB_TXN_WRITE_NOSYNC, mode!="sync");
+  if (res != 0) throw Err() << "set_flags failed: " << db_strerror(res);
+
+  // flush transactions which were committed without sync
+  if (durability!="sync"){
+    res = env->log_flush(env.get(), NULL);
+    if (res != 0) throw Err() << "log_flush failed: " << db_strerror(res);
+  }
+  durability = mode;
+  lk.unlock();
+
+  if (mode=="group") bg_start();
+}
+
+void
+GrapheneEnv::bg_start(){
+  if (bg_thread.joinable()) return;
+  bg_stop = false;
+  bg_thread = std::thread(&GrapheneEnv::bg_loop, this);
+}
+
+void
+GrapheneEnv::bg_finish(){
+  if (!bg_thread.joinable()) return;
+  {
+    std::unique_lock<std::mutex> lk(bg_mutex);
+    bg_stop = true;
+  }
+  bg_cond.notify_all();
+  bg_thread.join();
+
+  // final flush for the group mode
+  if (env && durability=="group") env->log_flush(env.get(), NULL);
+}
+
+void
+GrapheneEnv::bg_loop(){
+  // Signals should be processed in the main thread
+  // (see signal handlers in graphene.cpp and graphene_http.cpp).
+  sigset_t ss;
+  sigfillset(&ss);
+  pthread_sigmask(SIG_BLOCK, &ss, NULL);
+
+  typedef std::chrono::steady_clock clock;
+  auto next_flush = clock::now() + std::chrono::milliseconds(group_time);
+  auto next_maint = clock::now() + std::chrono::seconds(maintain_time);
+
+  std::unique_lock<std::mutex> lk(bg_mutex);
+  while (!bg_stop){
+    auto wake = next_flush;
+    if (maintain_time>0 && (durability!="group" || next_maint < wake))
+      wake = next_maint;
+    bg_cond.wait_until(lk, wake);
+    if (bg_stop) break;
+
+    // group commit: make all transactions committed
+    // since the last flush durable with a single log flush.
+    auto now = clock::now();
+    if (now >= next_flush){
+      if (durability=="group"){
+        int res = env->log_flush(env.get(), NULL);
+        if (res != 0) std::cerr << "graphene: log_flush failed: " << db_strerror(res) << "\n";
+      }
+      next_flush = now + std::chrono::milliseconds(group_time);
+    }
+
+    // checkpoint and log removal (without holding the lock)
+    if (maintain_time>0 && now >= next_maint){
+      lk.unlock();
+      try { maintain(); }
+      catch (Err & e){ std::cerr << "graphene: maintenance failed: " << e.str() << "\n"; }
+      lk.lock();
+      next_maint = clock::now() + std::chrono::seconds(maintain_time);
+    }
+  }
+}
+
+void
+GrapheneEnv::maintain(const bool force){
+  if (env_type!="txn")
+    throw Err() << "maintenance can be used only in txn environment";
+  if (readonly) throw Err() << "maintenance can not be done in read-only mode";
+
+  int res = env->txn_checkpoint(env.get(), checkpoint_kb, checkpoint_min, force? DB_FORCE:0);
+  if (res != 0) throw Err() << "txn_checkpoint failed: " << db_strerror(res);
+
+  struct stat st;
+  if (stat((dbpath + "/" + GRAPHENE_LOGHOLD).c_str(), &st) == 0) return;
+
+  res = env->log_archive(env.get(), NULL, DB_ARCH_REMOVE);
+  if (res != 0) throw Err() << "log_archive failed: " << db_strerror(res);
+}
+
+void
+GrapheneEnv::trim(std::ostream & out){
+  if (readonly) throw Err() << "can't trim databases in readonly mode";
+  for (auto const & name: dblist()){
+    auto & db = getdb(name, DB_RDONLY);
+    std::string r = db.get_opts().get<std::string>("retention", "");
+    if (r=="") continue;
+    TimeType tt = db.get_ttype();
+    uint64_t now = graphene_time_to_units(graphene_time_parse("now", tt), tt);
+    uint64_t ret = graphene_time_to_units(graphene_time_parse(r, tt), tt);
+    if (ret>=now) continue;
+    std::string t2 = graphene_time_print(graphene_time_from_units(now - ret, tt), tt);
+
+    // bounded transactions with pauses between them
+    uint64_t n, sum = 0;
+    do {
+      n = getdb(name).trim(t2, trim_chunk);
+      sum += n;
+      if (n>=trim_chunk && trim_pause>0) usleep(trim_pause*1000);
+    } while (n>=trim_chunk);
+    if (sum) { cat_reset(name); out << name << " " << sum << "\n"; }
+  }
+}
+
+void
+GrapheneEnv::archive(const std::string & name, const std::string & t2, std::ostream & out){
+  uint64_t n = getdb(name).archive(t2, trim_chunk, trim_pause);
+  cat_reset(name);
+  out << name << " " << n << "\n";
+  out.flush();
+}
+
+void
+GrapheneEnv::archive_all(std::ostream & out){
+  if (readonly) throw Err() << "can't archive databases in readonly mode";
+  for (auto const & name: dblist()){
+    auto & db = getdb(name, DB_RDONLY);
+    std::string a = db.get_opts().get<std::string>("archive", "");
+    if (a=="") continue;
+    TimeType tt = db.get_ttype();
+    uint64_t now = graphene_time_to_units(graphene_time_parse("now", tt), tt);
+    uint64_t age = graphene_time_to_units(graphene_time_parse(a, tt), tt);
+    if (age >= now) continue;
+    std::string t2 = graphene_time_print(graphene_time_from_units(now - age, tt), tt);
+    uint64_t n = getdb(name).archive(t2, trim_chunk, trim_pause);
+    if (n) { cat_reset(name); out << name << " " << n << "\n"; }
+  }
+}
+
+void
+GrapheneEnv::del_range(const std::string & name, const std::string & t1,
+                       const std::string & t2, std::ostream & out){
+  if (del_chunk==0 && del_time==0)
+    getdb(name).del_range(t1, t2);
+  else
+    getdb(name).del_range(t1, t2, del_chunk, del_time, del_pause,
+      [&out](const uint64_t n, const std::string & t){
+        out << n << " " << t << "\n";
+        out.flush();
+      });
+  cat_reset(name);
+}
+
+void
+GrapheneEnv::compact(const std::string & name, std::ostream & out){
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t freed = 0, truncated = 0;
+  getdb(name).compact(compact_pages, freed, truncated);
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  out << name << " " << freed << " " << truncated << " " << dt.count() << "\n";
+  out.flush();
+}
+
+// Formatter for export_snapshot: pass points to a snapshot writer.
+class GrapheneSnapFormatter: public GrapheneFormatter {
+  public:
+  GrapheneSnapWriter & w;
+
+  GrapheneSnapFormatter(GrapheneSnapWriter & w_): w(w_) {}
+
+  void proc_point(const std::string &k, const std::string &vs,
+                  const TimeType ttype, const DataType dtype) override {
+    auto vv = graphene_data_values(vs, dtype, quant);
+    w.add(graphene_time_to_units(k, ttype), vv.data(), vv.size());
+  }
+};
+
+void
+GrapheneEnv::export_snapshot(const std::string & name, const std::string & t1,
+                             const std::string & t2, const std::string & file){
+  auto & db = getdb(name, DB_RDONLY);
+  if (db.get_dtype() == DATA_TEXT)
+    throw Err() << name << ".db: snapshots are not supported for TEXT databases";
+
+  GrapheneSnapWriter w(file, db.get_ttype());
+  GrapheneSnapFormatter f(w);
+  db.get_range(t1, t2, "0", f);
+  w.finish();
+}
+
+void
+GrapheneEnv::load_bin(const std::string & name, const std::string & fname){
+  auto & db = getdb(name, DB_CREATE | DB_EXCL);
+  try { db.load_bin(fname); }
+  catch (Err & e){
+    try { dbremove(name); } catch (Err & e1) {}
+    throw e;
+  }
+  close(name);
+  cat_reset(name);
+}
+
+void
+GrapheneEnv::set_age_opt(const std::string & name, const std::string & opt, const std::string & dt){
+  auto & db = getdb(name);
+  Opt o = db.get_opts();
+  if (graphene_time_zero(graphene_time_parse(dt, db.get_ttype()), db.get_ttype()))
+    o.erase(opt);
+  else
+    o.put(opt, dt);
+  db.set_opts(o);
+}
+
+void
+GrapheneEnv::log_hold(const bool hold){
+  std::string fname = dbpath + "/" + GRAPHENE_LOGHOLD;
+  if (hold){
+    FILE *f = fopen(fname.c_str(), "w");
+    if (!f) throw Err() << "can't create file: " << fname << ": " << strerror(errno);
+    fclose(f);
+  }
+  else {
+    if (unlink(fname.c_str())!=0 && errno!=ENOENT)
+      throw Err() << "can't remove file: " << fname << ": " << strerror(errno);
+  }
 }
 
 
 // find database in the pool. Open/Reopen if needed
-GrapheneDB &
-GrapheneEnv::getdb(const std::string & name, const int fl){
+std::shared_ptr<GrapheneDB>
+GrapheneEnv::getdb_pin(const std::string & name, const int fl, const uint32_t db_flags){
 
   if (readonly && !(fl & DB_RDONLY)) throw Err() << "can't write to database in readonly mode";
-  std::map<std::string, GrapheneDB>::iterator i = pool.find(name);
+  auto i = pool_idx.find(name);
 
   // if database was opened with wrong flags close it
-  if (!(fl & DB_RDONLY) && i!=pool.end() && i->second.is_readonly()){
-    pool.erase(i); i=pool.end();
+  if (!(fl & DB_RDONLY) && i!=pool_idx.end() && i->second->second->is_readonly()){
+    pool.erase(i->second); pool_idx.erase(i); i=pool_idx.end();
+  }
+
+  // found: move it to the beginning of the LRU list
+  if (i != pool_idx.end()){
+    metrics_pool(POOL_HIT);
+    pool.splice(pool.begin(), pool, i->second);
   }
 
   // if database is not opened, open it
-  if (i == pool.end())
-    i = pool.insert(std::pair<std::string, GrapheneDB>(name, GrapheneDB(env.get(), dbpath, name, fl))).first;
+  else {
+    metrics_pool(POOL_MISS);
+    pool.push_front(std::make_pair(name, std::make_shared<GrapheneDB>(
+      env.get(), dbpath, name, fl, db_flags, container)));
+    pool_idx[name] = pool.begin();
+    pool.front().second->set_arch_dir(arch_dir);
+    pool.front().second->set_scan_mode(scan_mode);
+    pool.front().second->set_max_parts(max_open>1 ? max_open-1 : max_open);
+  }
 
-  return i->second;
+  // close least recently used databases (open partitions are counted),
+  // skip databases which are in use
+  if (max_open>0){
+    size_t n = 0;
+    for (auto const & p: pool) n += p.second->open_count();
+    auto j = pool.end();
+    while (n>max_open && --j != pool.begin()){
+      if (j->second.use_count()>1) continue;
+      n -= j->second->open_count();
+      pool_idx.erase(j->first);
+      j = pool.erase(j);
+      metrics_pool(POOL_EVICT);
+    }
+  }
+  return pool.front().second;
 }
 
 /****************/
@@ -171,28 +695,263 @@ GrapheneEnv::getdb(const std::string & name, const int fl){
 std::vector<std::string>
 GrapheneEnv::dblist(){
   std::vector<std::string> ret;
+
+  // container: names of subdatabases are keys of the master database
+  if (container!=""){
+    struct stat buf;
+    std::string file = container + ".db";
+    if (stat((dbpath + "/" + file).c_str(), &buf)!=0) return ret;
+    DB *dbp;
+    int res = db_create(&dbp, env.get(), 0);
+    if (res != 0) throw Err() << file << ": " << db_strerror(res);
+    std::shared_ptr<DB> dbh(dbp, [](DB *p){ p->close(p, 0); });
+    res = dbp->open(dbp, NULL, file.c_str(), NULL, DB_BTREE, DB_RDONLY, 0);
+    if (res != 0) throw Err() << file << ": " << db_strerror(res);
+
+    DBC *curs;
+    res = dbp->cursor(dbp, NULL, &curs, 0);
+    if (res != 0) throw Err() << file << ": " << db_strerror(res);
+    DBT k, v;
+    memset(&k, 0, sizeof(DBT));
+    memset(&v, 0, sizeof(DBT));
+    while ((res = curs->get(curs, &k, &v, DB_NEXT)) == 0){
+      std::string n((char *)k.data, (char *)k.data + k.size);
+      if (!GrapheneDB::is_part_name(n)) ret.push_back(n);
+    }
+    curs->close(curs);
+    if (res != DB_NOTFOUND) throw Err() << file << ": " << db_strerror(res);
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }
+
+  cat_update();
+  for (auto const & c:catalog)
+    if (!GrapheneDB::is_part_name(c.first)) ret.push_back(c.first);
+  return ret;
+}
+
+void
+GrapheneEnv::print_info_all(std::ostream & out){
+  // Write modified pages of opened databases (and of the shared
+  // cache) to the files: modification times are used to find
+  // changed databases.
+  sync();
+  if (env) env->memp_sync(env.get(), NULL);
+
+  for (auto const & n: dblist()){
+    auto const & e = cat_entry(n);
+    out << n << "\t" << graphene_dtype_name(e.dtype) << "\t" << e.version << "\t";
+    if (e.count<0) out << "-\t-\t-";
+    else out << e.count << "\t" << (e.count? e.first:"-") << "\t" << (e.count? e.last:"-");
+    if (e.descr!="") out << "\t" << e.descr;
+    out << "\n";
+  }
+  cat_save();
+}
+
+/****************/
+// Database catalog
+
+// update names in the catalog
+void
+GrapheneEnv::cat_update(){
+
+  // process inotify events
+  if (cat_fd>=0){
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(cat_fd, buf, sizeof(buf))) > 0){
+      const struct inotify_event *ev;
+      for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+        ev = (const struct inotify_event *) p;
+        if (ev->mask & IN_Q_OVERFLOW) cat_names = false;
+        if (ev->len == 0) continue;
+        std::string name(ev->name);
+        if (name.size()<=3 || name.compare(name.size()-3, 3, ".db")!=0) continue;
+        name.resize(name.size()-3);
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) catalog[name];
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) catalog.erase(name);
+        cat_changed = true;
+      }
+    }
+  }
+  if (cat_names) return;
+
+  // read the directory
   DIR *dir = opendir(dbpath.c_str());
   if (!dir) throw Err() << "can't open database directory: " << strerror(errno);
   struct dirent *ent;
-  std::vector<std::string> names;
+  std::set<std::string> names;
   while ((ent = readdir (dir)) != NULL) {
     std::string name(ent->d_name);
     size_t p = name.find(".db");
     if (name.size()>3 && p == name.size()-3)
-      ret.push_back(name.substr(0,p));
+      names.insert(name.substr(0,p));
   }
   closedir(dir);
-  std::sort(ret.begin(), ret.end());
-  return ret;
+
+  for (auto i = catalog.begin(); i!=catalog.end();){
+    if (names.count(i->first)) ++i;
+    else i = catalog.erase(i);
+  }
+  for (auto const & n:names) catalog[n];
+  cat_names = cat_fd>=0;
+}
+
+// get catalog entry, re-read it if the database file was modified
+const GrapheneCatEntry &
+GrapheneEnv::cat_entry(const std::string & name){
+  auto & e = catalog[name];
+  uint64_t mt = 0;
+  if (container==""){
+    struct stat st;
+    if (stat((dbpath + "/" + name + ".db").c_str(), &st)!=0)
+      throw Err() << name << ".db: " << strerror(errno);
+    mt = (uint64_t)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+    if (e.mtime == mt) return e;
+  }
+
+  auto & db = getdb(name, DB_RDONLY);
+  e.dtype = db.get_dtype();
+  e.version = db.get_version();
+  e.descr = db.get_descr();
+  e.count = -1;
+  e.first = e.last = "";
+  try {
+    auto st = db.get_stats();
+    e.count = st.count;
+    if (st.count){
+      e.first = graphene_time_print(st.first, db.get_ttype());
+      e.last  = graphene_time_print(st.last, db.get_ttype());
+    }
+  }
+  catch (Err & er) {} // no statistics
+  e.mtime = mt;
+  cat_changed = true;
+  return e;
+}
+
+// load/save catalog file; lines: name, mtime, dtype, version, count,
+// first, last, description (with escaped \\, \t, \n)
+void
+GrapheneEnv::cat_load(){
+  std::ifstream f(dbpath + "/" + GRAPHENE_CATALOG);
+  std::string l;
+  while (std::getline(f, l)){
+    std::istringstream ss(l);
+    std::string name, mt, dt, ver, cnt, descr;
+    GrapheneCatEntry e;
+    std::getline(ss, name, '\t');
+    std::getline(ss, mt, '\t');
+    std::getline(ss, dt, '\t');
+    std::getline(ss, ver, '\t');
+    std::getline(ss, cnt, '\t');
+    std::getline(ss, e.first, '\t');
+    std::getline(ss, e.last, '\t');
+    std::getline(ss, descr);
+    if (!ss.eof() && !ss) continue;
+    try {
+      e.mtime   = str_to_type<uint64_t>(mt);
+      e.dtype   = graphene_dtype_parse(dt);
+      e.version = str_to_type<int>(ver);
+      e.count   = str_to_type<int64_t>(cnt);
+    }
+    catch (Err & er) { continue; } // broken line
+    for (size_t i=0; i<descr.size(); i++){
+      if (descr[i]=='\\' && i+1<descr.size()){
+        i++;
+        e.descr += descr[i]=='n'? '\n' : descr[i]=='t'? '\t' : descr[i];
+      }
+      else e.descr += descr[i];
+    }
+    catalog[name] = e;
+  }
+}
+
+void
+GrapheneEnv::cat_save(){
+  if (!cat_changed || readonly || container!="") return;
+  std::string fname = dbpath + "/" + GRAPHENE_CATALOG;
+  std::string tmp = fname + "." + type_to_str(getpid()) + ".tmp";
+  std::ofstream f(tmp);
+  if (!f) return; // the directory is not writable, do not save the catalog
+  for (auto const & c:catalog){
+    auto const & e = c.second;
+    if (e.mtime==0) continue;
+    f << c.first << "\t" << e.mtime << "\t" << graphene_dtype_name(e.dtype) << "\t"
+      << e.version << "\t" << e.count << "\t" << e.first << "\t" << e.last << "\t";
+    for (auto ch: e.descr){
+      if      (ch=='\\') f << "\\\\";
+      else if (ch=='\n') f << "\\n";
+      else if (ch=='\t') f << "\\t";
+      else f << ch;
+    }
+    f << "\n";
+  }
+  f.close();
+  if (!f || rename(tmp.c_str(), fname.c_str())!=0){
+    unlink(tmp.c_str());
+    return;
+  }
+  cat_changed = false;
+}
+
+void
+GrapheneEnv::cat_reset(const std::string & name){
+  auto i = catalog.find(name);
+  if (i!=catalog.end()) i->second.mtime = 0;
 }
 
 // create new database
 void
 GrapheneEnv::dbcreate(const std::string & name, const std::string & descr,
-                    const DataType dtype){
-  GrapheneDB & db = getdb(name, DB_CREATE | DB_EXCL);
+                    const DataType dtype, const Opt & opts){
+  opts.check_unknown({"recnum", "step", "scale", "offset", "period", "t0", "block", "cols", "partition",
+                      "retention", "archive"});
+  if (!graphene_dtype_quant(dtype) && (opts.exists("scale") || opts.exists("offset")))
+    throw Err() << "scale and offset options can be used only with quantized data types";
+  if (opts.get("scale", 1.0) == 0) throw Err() << "bad scale: 0";
+
+  // fixed-rate databases
+  if (opts.exists("period")){
+    std::string p = opts.get<std::string>("period");
+    if (graphene_time_to_units(graphene_time_parse(p, DEF_TIMETYPE), DEF_TIMETYPE) == 0)
+      throw Err() << "bad period: " << p;
+    graphene_time_parse(opts.get<std::string>("t0", "0"), DEF_TIMETYPE);
+    if (dtype==DATA_TEXT)
+      throw Err() << "fixed-rate databases can not have TEXT data type";
+    if (opts.get("step", false) || opts.get("recnum", false))
+      throw Err() << "period option can not be used with step or recnum";
+    if (opts.get("block", 256) <= 0) throw Err() << "bad block: " << opts.get<std::string>("block");
+    if (opts.get("cols", 1) <= 0) throw Err() << "bad cols: " << opts.get<std::string>("cols");
+  }
+  else if (opts.exists("t0") || opts.exists("block") || opts.exists("cols"))
+    throw Err() << "t0, block and cols options can be used only with period option";
+
+  // partitioned databases
+  if (opts.exists("partition")){
+    std::string p = opts.get<std::string>("partition");
+    if (graphene_time_to_units(graphene_time_parse(p, DEF_TIMETYPE), DEF_TIMETYPE) == 0)
+      throw Err() << "bad partition: " << p;
+    if (opts.get("recnum", false))
+      throw Err() << "partition option can not be used with recnum";
+  }
+  if (opts.exists("retention"))
+    graphene_time_parse(opts.get<std::string>("retention"), DEF_TIMETYPE);
+  if (opts.exists("archive")){
+    graphene_time_parse(opts.get<std::string>("archive"), DEF_TIMETYPE);
+    if (opts.exists("period") || opts.exists("partition") || opts.get("recnum", false))
+      throw Err() << "archive option can not be used with period, partition or recnum";
+  }
+  check_name(name); // partition names are not allowed here
+  uint32_t db_flags = 0;
+  if (opts.get("recnum", false)) db_flags |= DB_RECNUM;
+  GrapheneDB & db = getdb(name, DB_CREATE | DB_EXCL, db_flags);
   db.set_dtype(dtype);
   db.set_descr(descr);
+  db.set_opts(opts.clone_known({"step", "scale", "offset", "period", "t0", "block", "cols", "partition",
+                                "retention", "archive"}));
+  db.rebuild_stats(); // write empty statistics
 }
 
 
@@ -200,9 +959,22 @@ GrapheneEnv::dbcreate(const std::string & name, const std::string & descr,
 void
 GrapheneEnv::dbremove(const std::string & name){
   if (readonly) throw Err() << "can't remove database in readonly mode";
-  check_name(name); // check name
+  GrapheneDB::check_int_name(name); // check name
+
+  // partitions of a partitioned database, archive files
+  std::vector<std::string> parts, arch;
+  if (!GrapheneDB::is_part_name(name))
+    try { parts = getdb(name).part_names(); } catch (Err & e) {}
+  try { arch = getdb(name).arch_files(); } catch (Err & e) {}
+
   close(name);
-  if (env) {
+  catalog.erase(name);
+  for (auto const & p: parts) dbremove(p);
+  if (container!=""){
+    int res = env->dbremove(env.get(), NULL, (container + ".db").c_str(), name.c_str(), 0);
+    if (res!=0) throw Err() << name <<  ".db: " << db_strerror(res);
+  }
+  else if (env) {
     int res = env->dbremove(env.get(), NULL, (name + ".db").c_str(), NULL, 0);
     if (res!=0) throw Err() << name <<  ".db: " << db_strerror(res);
   }
@@ -210,14 +982,21 @@ GrapheneEnv::dbremove(const std::string & name){
     int res = remove((dbpath + "/" + name + ".db").c_str());
     if (res) throw Err() << name <<  ".db: " << strerror(errno);
   }
+  for (auto const & a: arch){
+    // files of another database (records loaded from its dump)
+    if (a.compare(0, name.size()+2, name + "%a")!=0) continue;
+    std::string f = arch_dir + "/" + a;
+    if (remove(f.c_str())!=0 && errno!=ENOENT)
+      throw Err() << f << ": " << strerror(errno);
+  }
 }
 
 // rename database file
 void
 GrapheneEnv::dbrename(const std::string & name1, const std::string & name2){
   if (readonly) throw Err() << "can't rename database in readonly mode";
-  check_name(name1); // check name
-  check_name(name2); // check name
+  GrapheneDB::check_int_name(name1); // check name
+  GrapheneDB::check_int_name(name2); // check name
   std::string path1 = name1 + ".db";
   std::string path2 = name2 + ".db";
   std::string fpath1 = dbpath + "/" + path1;
@@ -225,12 +1004,33 @@ GrapheneEnv::dbrename(const std::string & name1, const std::string & name2){
 
   // check destination to avoid additional error messages:
   struct stat buf;
-  int res = stat(fpath2.c_str(), &buf);
-  if (res==0) throw Err() << "renaming " << name1 <<  ".db -> "
-                          << name2 << ".db: " << "Destination exists";
+  int res = 0;
+  if (container!=""){
+    auto l = dblist();
+    if (std::find(l.begin(), l.end(), name2) != l.end())
+      throw Err() << "renaming " << name1 <<  ".db -> "
+                  << name2 << ".db: " << "Destination exists";
+  }
+  else if (stat(fpath2.c_str(), &buf)==0)
+    throw Err() << "renaming " << name1 <<  ".db -> "
+                << name2 << ".db: " << "Destination exists";
+
+  // partitions of a partitioned database, archive files
+  std::vector<std::string> parts, arch;
+  if (!GrapheneDB::is_part_name(name1))
+    try { parts = getdb(name1).part_names(); } catch (Err & e) {}
+  try { arch = getdb(name1).arch_files(); } catch (Err & e) {}
 
   close(name1);
-  if (env) {
+  catalog.erase(name1);
+  for (auto const & p: parts) dbrename(p, name2 + p.substr(name1.size()));
+  if (container!=""){
+    res = env->dbrename(env.get(), NULL, (container + ".db").c_str(),
+                        name1.c_str(), name2.c_str(), 0);
+    if (res!=0) throw Err() << "renaming " << name1 <<  ".db -> "
+                            << name2 << ".db: " << db_strerror(res);
+  }
+  else if (env) {
     res = env->dbrename(env.get(), NULL, path1.c_str(), NULL, path2.c_str(), 0);
     if (res!=0) throw Err() << "renaming " << name1 <<  ".db -> "
                             << name2 << ".db: " << db_strerror(res);
@@ -240,29 +1040,34 @@ GrapheneEnv::dbrename(const std::string & name1, const std::string & name2){
     if (res) throw Err() << "renaming " << name1 <<  ".db -> "
                          << name2 << ".db: " << strerror(errno);
   }
+
+  // archive files
+  if (arch.size()) getdb(name2).arch_rename();
 }
 
 // close one database, close all databases
 void
 GrapheneEnv::close(const std::string & name){
-  auto i = pool.find(name);
-  if (i!=pool.end()) pool.erase(i);
+  auto i = pool_idx.find(name);
+  if (i==pool_idx.end()) return;
+  pool.erase(i->second);
+  pool_idx.erase(i);
 }
 
 void
-GrapheneEnv::close(){ pool.clear(); }
+GrapheneEnv::close(){ pool.clear(); pool_idx.clear(); }
 
 
 // sync one database, sync all databases
 void
 GrapheneEnv::sync(const std::string & name){
-  auto i = pool.find(name);
-  if (i!=pool.end()) i->second.sync();
+  auto i = pool_idx.find(name);
+  if (i!=pool_idx.end()) i->second->second->sync();
 }
 
 void
 GrapheneEnv::sync(){
-  for (auto &db:pool) db.second.sync();
+  for (auto &db:pool) db.second->sync();
 }
 
 void
@@ -307,22 +1112,28 @@ GrapheneEnv::put(const std::string & name, const std::string & t,
          const std::vector<std::string> & dat, const std::string &dpolicy){
   auto & db = getdb(name);
   db.put(t, dat, dpolicy);
+  cat_reset(name);
+  metrics_write(name, 1);
 }
 
 void
 GrapheneEnv::put_flt(const std::string & name, const std::string &t,
              const std::vector<std::string> & dat, const std::string &dpolicy){
-  auto & db = getdb(name);
+  auto db = getdb_pin(name); // filters can open other databases
 
-  auto ttype = db.get_ttype();
-  std::string storage = db.get_f0data();
+  auto ttype = db->get_ttype();
+  std::string storage = db->get_f0data();
   // run input filter
   auto t1 = graphene_time_print(graphene_time_parse(t, ttype),ttype);
   auto d1(dat);
-  if (tcl.run(db.get_filter(0), t1, d1, storage)) db.put(t1,d1,dpolicy);
+  if (tcl.run(db->get_filter(0), t1, d1, storage)) {
+    db->put(t1,d1,dpolicy);
+    cat_reset(name);
+    metrics_write(name, 1);
+  }
 
   // write storage
-  db.write_f0data(storage);
+  db->write_f0data(storage);
 }
 
 /****************/
@@ -332,12 +1143,12 @@ void
 GrapheneEnv::get_next(const std::string & ext_name, const std::string & t,
               const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data) {
   GrapheneEnvFormatter dbo(tcl, ext_name, *this);
-  auto & db = getdb(dbo.name, DB_RDONLY);
+  auto db = getdb_pin(dbo.name, DB_RDONLY); // filters can open other databases
   dbo.timefmt = timefmt;
   dbo.time0   = t;
   dbo.fmt_cb  = fmt_cb;
   dbo.fmt_cb_data  = fmt_cb_data;
-  db.get_next(t, dbo);
+  db->get_next(t, dbo);
 }
 
 // get previous point before t
@@ -345,12 +1156,12 @@ void
 GrapheneEnv::get_prev(const std::string & ext_name, const std::string & t,
               const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data) {
   GrapheneEnvFormatter dbo(tcl, ext_name, *this);
-  auto & db = getdb(dbo.name, DB_RDONLY);
+  auto db = getdb_pin(dbo.name, DB_RDONLY); // filters can open other databases
   dbo.timefmt = timefmt;
   dbo.time0   = t;
   dbo.fmt_cb  = fmt_cb;
   dbo.fmt_cb_data  = fmt_cb_data;
-  db.get_prev(t, dbo);
+  db->get_prev(t, dbo);
 }
 
 // get previous or interpolated point
@@ -358,12 +1169,12 @@ void
 GrapheneEnv::get(const std::string & ext_name, const std::string & t,
          const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data) {
   GrapheneEnvFormatter dbo(tcl, ext_name, *this);
-  auto & db = getdb(dbo.name, DB_RDONLY);
+  auto db = getdb_pin(dbo.name, DB_RDONLY); // filters can open other databases
   dbo.timefmt = timefmt;
   dbo.time0   = t;
   dbo.fmt_cb  = fmt_cb;
   dbo.fmt_cb_data  = fmt_cb_data;
-  db.get(t, dbo);
+  db->get(t, dbo);
 }
 
 // get data range
@@ -372,13 +1183,21 @@ GrapheneEnv::get_range(const std::string & ext_name, const std::string & t1,
                const std::string & t2, const std::string & dt,
                const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data) {
   GrapheneEnvFormatter dbo(tcl, ext_name, *this);
-  auto & db = getdb(dbo.name, DB_RDONLY);
+  auto db = getdb_pin(dbo.name, DB_RDONLY); // filters can open other databases
   dbo.list = true;
+  dbo.need_len = list_len;
   dbo.timefmt = timefmt;
   dbo.time0   = t1;
   dbo.fmt_cb  = fmt_cb;
   dbo.fmt_cb_data  = fmt_cb_data;
-  db.get_range(t1,t2,dt, dbo);
+  if (dt.compare(0, 9, "by_index=")==0){
+    // parse as a signed number: negative steps should not wrap
+    int k = str_to_type<int>(dt.substr(9));
+    if (k<1) throw Err() << "bad index step: " << dt.substr(9);
+    db->get_range_idx(t1,t2, k, dbo);
+  }
+  else
+    db->get_range(t1,t2,dt, dbo);
 }
 
 // get limited number of points starting at t
@@ -387,13 +1206,14 @@ GrapheneEnv::get_count(const std::string & ext_name,
                const std::string & t, const std::string & cnt,
                const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data) {
   GrapheneEnvFormatter dbo(tcl, ext_name, *this);
-  auto & db = getdb(dbo.name, DB_RDONLY);
+  auto db = getdb_pin(dbo.name, DB_RDONLY); // filters can open other databases
   dbo.list = true;
+  dbo.need_len = list_len;
   dbo.timefmt = timefmt;
   dbo.time0   = t;
   dbo.fmt_cb  = fmt_cb;
   dbo.fmt_cb_data  = fmt_cb_data;
-  db.get_count(t,cnt, dbo);
+  db->get_count(t,cnt, dbo);
 }
 
 
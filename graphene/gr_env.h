@@ -7,14 +7,25 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <sstream>
 #include <cstring> /* memset */
+#include <sys/time.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <db.h>
+#include "opt/opt.h"
 #include "gr_db.h"
 #include "gr_tcl.h"
 
 #include "data.h"
 
+// catalog file in the database directory (see GrapheneEnv::catalog)
+#define GRAPHENE_CATALOG "graphene.catalog"
+
 // Formatter callback
 typedef void (*GrapheneFmtCB) (const std::string &t,
      const std::vector<std::string> &d, void * cb_data);
@@ -25,8 +36,25 @@ void out_cb_simple(const std::string &t,
                    const std::vector<std::string> &d, void * cb_data);
 
 
+// Parse database format used in the create command:
+//   <data type>[,<option>[=<value>]]...
+// Options are added to opts (value is "1" if it is not set).
+DataType graphene_create_fmt_parse(const std::string & fmt, Opt & opts);
+
 class GrapheneEnv;
 
+// Database catalog entry (see GrapheneEnv::catalog).
+struct GrapheneCatEntry {
+  uint64_t mtime;     // modification time of the database file, ns (0 - entry not read)
+  DataType dtype;
+  int version;
+  std::string descr;
+  int64_t count;           // number of points, -1 if statistics is not available
+  std::string first, last; // timestamps of the first and last points (printed)
+
+  GrapheneCatEntry(): mtime(0), dtype(DEF_DATATYPE), version(0), count(-1) {}
+};
+
 class GrapheneTCLGet: public GrapheneTCLProc {
   GrapheneEnv & env;
   public:
@@ -64,14 +92,29 @@ class GrapheneEnvFormatter: public GrapheneFormatter {
   TimeFMT timefmt;     // output time format
   std::string time0;   // zero time for relative time output (not parsed)
 
+  int query_time;      // query time budget, ms (0 - no limit)
+  struct timeval tstart; // query start time
+
+  uint64_t npoints, nbytes; // statistics for metrics: points and bytes sent to output
+  double flt_time;          //   and time spent in filters, s
+
   // constructor -- parse the dataset string, create iostream
   GrapheneEnvFormatter(GrapheneTCL & tcl_, const std::string & ext_name, GrapheneEnv & env_);
 
+  // destructor -- report statistics to metrics
+  ~GrapheneEnvFormatter();
+
   // This method is called from GrapheneGB::get_* for each data point
   // It gets unpacked values from the database, do formatting,
   // column selection and filtering and call print_point method.
   void proc_point(const std::string &k, const std::string &v,
      const TimeType ttype, const DataType dtype) override;
+
+  // Rest of the query time budget, ms (0 - no limit).
+  // Throws an error if the budget is exceeded.
+  int time_left();
+
+  void check_time() override { time_left(); }
 };
 
 
@@ -81,13 +124,93 @@ class GrapheneEnvFormatter: public GrapheneFormatter {
 class GrapheneEnv{
   std::string dbpath;
   std::string env_type;
-  std::map<std::string, GrapheneDB> pool;
+  std::string container; // store databases as subdatabases of <container>.db
+  std::string arch_dir;  // folder for archive files (see GrapheneDB::archive)
+  int scan_mode;         // get_range scan strategy (see GrapheneDB::set_scan_mode)
+
+  // Open databases: list in LRU order (most recently used first) and
+  // index by name. Least recently used databases are closed if there are
+  // more then max_open open handles, including partitions (0 - no limit).
+  // Databases which are in use (see getdb_pin) are not closed.
+  typedef std::list<std::pair<std::string, std::shared_ptr<GrapheneDB> > > pool_t;
+  pool_t pool;
+  std::unordered_map<std::string, pool_t::iterator> pool_idx;
+  size_t max_open;
+
+  // Catalog of databases: names, data types, descriptions, statistics.
+  // Names are tracked by inotify on the database directory (the directory
+  // is read only on start or if inotify is not available). Entries are
+  // re-read when the database file is modified. The catalog is saved to
+  // GRAPHENE_CATALOG file in the database directory for fast startup.
+  // Not used with container option.
+  std::map<std::string, GrapheneCatEntry> catalog;
+  bool cat_names;   // names in the catalog are up to date
+  bool cat_changed; // catalog should be saved
+  int  cat_fd;      // inotify descriptor, -1 if not used
+  void cat_update();
+  const GrapheneCatEntry & cat_entry(const std::string & name);
+  void cat_load();
+  void cat_save();
+  void cat_reset(const std::string & name); // re-read entry on next access
   std::shared_ptr<DB_ENV> env; // database environment
   bool readonly;
 
   GrapheneTCL tcl;
   GrapheneTCLGet tcl_get_cmd;
 
+  int query_time; // time budget for a single get_* query, ms (0 - no limit)
+  int list_len;   // text length read in list mode, bytes (0 - full values)
+
+  std::string durability; // durability mode: sync, group, nosync
+  int group_time;         // log flush period for the group mode, ms
+
+  int maintain_time;      // period of background maintenance, s (0 - off)
+  int checkpoint_kb;      // checkpoint thresholds: log size, kbytes
+  int checkpoint_min;     //   and time since last checkpoint, minutes
+
+  int trim_chunk;         // retention and archiving: max number of points deleted in one transaction
+  int trim_pause;         //   and pause between transactions, ms
+
+  int del_chunk;          // del_range: max number of points deleted in one transaction (0 - no limit),
+  int del_time;           //   max time of one transaction, ms (0 - no limit)
+  int del_pause;          //   and pause between transactions, ms
+
+  int compact_pages;      // compact: max number of pages freed in one step
+
+  int import_threads;     // import: number of parsing threads,
+                          //   backup/restore: number of databases processed in parallel (txn env)
+
+  // Run f(i) for i in [0,n) in parallel threads, rethrow
+  // the first error (see gr_import.cpp).
+  static void run_parallel(const size_t n, const std::function<void(const size_t)> & f);
+
+  // Backup/restore: run f(db, i) for databases names[i] opened by open(i)
+  // in groups of import_threads (one by one if the environment is not
+  // free-threaded, i.e. not txn), print "<name> <number of points>" for
+  // successful ones, throw the first error at the end (see gr_backup.cpp).
+  void backup_run(const std::vector<std::string> & names,
+                  const std::function<std::shared_ptr<GrapheneDB> (const size_t)> & open,
+                  const std::function<uint64_t (GrapheneDB &, const size_t)> & f,
+                  std::ostream & out);
+
+  // Import one batch of text chunks (see gr_import.cpp),
+  // add numbers of written points to cnt.
+  void import_batch(const std::vector<std::string> & files,
+                    const std::vector<std::string> & chunks,
+                    std::map<std::string, uint64_t> & cnt);
+
+  // Background thread for environment maintenance
+  // (log flushing in the group durability mode, checkpoints
+  // and log removal, see maintain()).
+  // It uses only the environment handle, not databases.
+  std::thread bg_thread;
+  std::mutex bg_mutex;
+  std::condition_variable bg_cond;
+  bool bg_stop;
+  void bg_start();
+  void bg_finish();
+  void bg_loop();
+
   // Deleter for the environment
   struct D{
     void operator() (DB_ENV* env) {env->close(env, 0);}
@@ -97,22 +220,112 @@ class GrapheneEnv{
 
   // Constructor: open DB environment
   // env_type: "none", "lock", "txn" (default)
+  // opts: additional environment options:
+  //   filter_time -- time limit for a single filter run, ms (0 - no limit)
+  //   filter_cmds -- limit of TCL commands for a single filter run (0 - no limit)
+  //   query_time  -- time budget for a single get_* query, ms (0 - no limit)
+  //   list_len    -- in get_range/get_count only first list_len bytes of
+  //                  text values are read (default 1024, 0 - read full values)
+  //   durability  -- durability mode for transactions (txn environment only):
+  //     sync   -- flush log on every commit (default),
+  //     group  -- log is written on commit (DB_TXN_WRITE_NOSYNC) and flushed
+  //               by a background thread every group_time ms,
+  //     nosync -- log is written but not flushed on commit (DB_TXN_WRITE_NOSYNC),
+  //               data is flushed by the system or by checkpoints.
+  //   group_time  -- log flush period for the group durability mode, ms (default 100)
+  //   log_size    -- log file size, bytes (default GRAPHENE_LOGSIZE)
+  //   maintain_time  -- period of background maintenance (see maintain()), s (default 0, off)
+  //   checkpoint_kb  -- do checkpoint if more then this amount of log was written (default 1024)
+  //   checkpoint_min -- do checkpoint if this time passed since the last one, minutes (default 10)
+  //   cache_size     -- size of BerkeleyDB cache (mpool), MB (default: libdb setting)
+  //   mmap_size      -- max size of read-only files mapped to memory, MB (default: libdb setting)
+  //   lk_max_locks, lk_max_lockers, lk_max_objects -- sizes of lock tables (default: libdb settings)
+  //   max_open    -- max number of open databases, least recently used ones
+  //                  are closed (default 0, no limit)
+  //   trim_chunk  -- max number of points deleted in one transaction by trim() and archive() (default 1000)
+  //   trim_pause  -- pause between trim() and archive() transactions, ms (default 10)
+  //   arch_dir    -- folder for archive files (default: database folder)
+  //   scan_mode   -- get_range scan strategy for dt>0: auto, seek, next (default auto)
+  //   del_chunk   -- del_range deletes at most this number of points in
+  //                  one transaction (default 0, no limit)
+  //   del_time    -- max time of one del_range transaction, ms (default 0, no limit)
+  //   del_pause   -- pause between del_range transactions, ms (default 0)
+  //   compact_pages -- max number of pages freed in one compaction step (default 1000, 0 - no limit)
+  //   import_threads -- number of threads for parsing text in import() (default: number of CPUs)
+  //   container   -- keep all databases as subdatabases in one <container>.db
+  //                  file instead of separate <name>.db files (lock or txn
+  //                  environment is needed)
+  // Cache and lock table sizes are applied only when the environment is created.
   GrapheneEnv(const std::string & dbpath_, const bool readonly,
-              const std::string & env_type, const std::string & tcl_libdir);
+              const std::string & env_type, const std::string & tcl_libdir,
+              const Opt & opts = Opt());
 
   ~GrapheneEnv();
 
   // find database in the pool. Create/Open/Reopen if needed
-  GrapheneDB & getdb(const std::string & name, const int fl = 0);
+  // db_flags are used only for creating a new database.
+  // The reference is valid until the next getdb call (the database can be
+  // closed by the LRU limit), use getdb_pin to keep the handle longer.
+  GrapheneDB & getdb(const std::string & name, const int fl = 0,
+                     const uint32_t db_flags = 0) {
+    return *getdb_pin(name, fl, db_flags); }
+
+  // Same, but the database is not closed by the LRU limit while the
+  // returned pointer is in use (e.g. filters can open other databases
+  // during a query).
+  std::shared_ptr<GrapheneDB> getdb_pin(const std::string & name,
+                     const int fl = 0, const uint32_t db_flags = 0);
+
+  // set/get time budget for get_* queries, ms (0 - no limit)
+  void set_query_time(const int t) {
+    if (t<0) throw Err() << "bad query time limit: " << t;
+    query_time = t; }
+  int get_query_time() const {return query_time;}
+
+  // set/get durability mode (sync, group, nosync)
+  void set_durability(const std::string & mode);
+  std::string get_durability() const {return durability;}
+
+  // Maintenance of txn environment:
+  // - checkpoint (if thresholds are reached or force is set),
+  // - remove log files which are not needed for recovery,
+  //   unless a log hold file (see log_hold()) exists.
+  void maintain(const bool force = false);
+
+  // Delete expired data in all databases with retention option:
+  // points older then now-retention are deleted in small transactions
+  // (trim_chunk points, with trim_pause ms between them).
+  // "<name> <number of deleted points>" lines are printed to out.
+  void trim(std::ostream & out);
+
+  // Move points with timestamps <= t2 to a new archive file
+  // (see GrapheneDB::archive), print "<name> <number of points>" line.
+  void archive(const std::string & name, const std::string & t2, std::ostream & out);
+
+  // Archive data older then now-archive in all databases with archive option.
+  void archive_all(std::ostream & out);
+
+  // Create/remove log hold file in the database directory.
+  // While it exists maintenance does not remove any logs
+  // (e.g. during external backup of the environment).
+  void log_hold(const bool hold);
 
   /****************/
 
   // return list of all databases
   std::vector<std::string> dblist();
 
+  // print information about all databases (see info_all command)
+  void print_info_all(std::ostream & out);
+
   // create new database
+  // opts: database options (see graphene_create_fmt_parse)
+  //   recnum -- record-number B-tree: fast count_range and
+  //             get_range with by_index=<k> sampling, but slower writes
+  //   step   -- fold runs of equal values (see GrapheneDB::set_opts)
+  //   scale, offset -- parameters of quantized data types
   void dbcreate(const std::string & name, const std::string & descr,
-              const DataType type);
+              const DataType type, const Opt & opts = Opt());
 
   // remove database file
   void dbremove(const std::string & name);
@@ -134,9 +347,32 @@ class GrapheneEnv{
   // print environment log files (same as db_archive -l)
   void list_logs();
 
+  // print environment statistics (mpool, lock, txn, log subsystems),
+  // one "<name> <value>" pair per line.
+  void stats(std::ostream & out);
+
   /****************/
   void set_descr(const std::string & name, const std::string & descr) {
-     getdb(name).set_descr(descr); }
+     getdb(name).set_descr(descr); cat_reset(name); }
+
+  // Compact a database (see GrapheneDB::compact), print
+  // "<name> <freed pages> <truncated pages> <time, s>" line to out.
+  void compact(const std::string & name, std::ostream & out);
+
+  // Compact all databases.
+  void compact_all(std::ostream & out) {
+    for (auto const & n: dblist()) compact(n, out); }
+
+  // set retention time (database option "retention", 0 - keep all data)
+  void set_retention(const std::string & name, const std::string & dt){
+    set_age_opt(name, "retention", dt); }
+
+  // set archiving time (database option "archive", 0 - do not archive)
+  void set_archive(const std::string & name, const std::string & dt){
+    set_age_opt(name, "archive", dt); }
+
+  // set a database option with time value, erase it for 0
+  void set_age_opt(const std::string & name, const std::string & opt, const std::string & dt);
 
   std::string get_descr(const std::string & name) {
      return getdb(name, DB_RDONLY).get_descr(); }
@@ -147,6 +383,20 @@ class GrapheneEnv{
   TimeType get_ttype(const std::string & name) {
      return getdb(name, DB_RDONLY).get_ttype(); }
 
+  // print database statistics (count, first/last time, min/max/sum)
+  void print_stats(const std::string & name, std::ostream & out) {
+     auto & db = getdb(name, DB_RDONLY);
+     db.get_stats().print(out, db.get_ttype()); }
+
+  // print database options, "<name> <value>" lines
+  void print_opts(const std::string & name, std::ostream & out) {
+     for (auto const & o: getdb(name, DB_RDONLY).get_opts())
+       out << o.first << " " << o.second << "\n"; }
+
+  // recalculate database statistics
+  void rebuild_stats(const std::string & name) {
+     getdb(name).rebuild_stats(); cat_reset(name); }
+
   /****************/
 
   // backup start: notify that we are going to start backup.
@@ -191,6 +441,7 @@ class GrapheneEnv{
            const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data);
 
   // get data range
+  // dt can be a time step or by_index=<k> for every k-th point (recnum databases)
   void get_range(const std::string & ext_name, const std::string & t1,
                  const std::string & t2, const std::string & dt,
                  const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data);
@@ -200,15 +451,22 @@ class GrapheneEnv{
                  const std::string & t, const std::string & cnt,
                  const TimeFMT timefmt, GrapheneFmtCB fmt_cb, void * fmt_cb_data);
 
+  // count points in the range
+  uint64_t count_range(const std::string & name,
+                       const std::string & t1, const std::string & t2) {
+    return getdb(name, DB_RDONLY).count_range(t1,t2); }
+
   /****************/
 
   // delete one data point
   void del(const std::string & name, const std::string & t1){
-    getdb(name).del(t1); }
+    getdb(name).del(t1); cat_reset(name); }
 
   // delete all points in the data range
-  void del_range(const std::string & name, const std::string & t1, const std::string & t2){
-    getdb(name).del_range(t1,t2); }
+  // (in a few transactions if del_chunk or del_time options are set, then
+  // progress lines "<deleted points> <last deleted time>" are printed to out)
+  void del_range(const std::string & name, const std::string & t1, const std::string & t2,
+                 std::ostream & out);
 
   /****************/
 
@@ -220,6 +478,37 @@ class GrapheneEnv{
   void dump(const std::string & name, const std::string & fname){
     getdb(name, DB_RDONLY).dump(fname); }
 
+  // binary dump/load (see GrapheneDB::dump_bin), file "-" is stdout/stdin
+  void dump_bin(const std::string & name, const std::string & fname, const bool zlib){
+    getdb(name, DB_RDONLY).dump_bin(fname, zlib); }
+
+  // Import text files ("-" for stdin) with "<name> <time> <values>" lines
+  // into existing databases. Text is parsed in parallel, points are sorted
+  // and written by bulk puts, existing points are replaced (see gr_import.cpp).
+  // Print "<name> <number of points>" lines to out.
+  void import(const std::vector<std::string> & files, std::ostream & out);
+
+  // Incremental backup of a database (or all databases for name "all")
+  // to <dir>/<name>.<n>.grinc files (see GrapheneDB::backup_inc and
+  // gr_backup.cpp). Databases are processed in parallel, an error in
+  // one database does not stop others. Print "<name> <number of points>" lines.
+  void backup(const std::string & name, const std::string & dir, std::ostream & out);
+
+  // Apply increments from the folder to a database (or all databases for
+  // name "all") in the order of their numbers, create missing databases.
+  // Applied files are removed. Print "<name> <number of points>" lines.
+  void restore(const std::string & name, const std::string & dir, std::ostream & out);
+
+  // Export points in the time range [t1,t2] of a numeric database
+  // to a columnar snapshot file (see gr_snap.h).
+  void export_snapshot(const std::string & name, const std::string & t1,
+                       const std::string & t2, const std::string & file);
+
+  // create db and load binary dump
+  // (database is closed to re-read information records,
+  // it is removed if loading fails)
+  void load_bin(const std::string & name, const std::string & fname);
+
   /****************/
 
   void set_filter(const std::string & name, const int N, const std::string & code){
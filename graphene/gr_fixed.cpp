@@ -0,0 +1,409 @@
+/* Fixed-rate databases: GrapheneDB methods for the blocked layout.
+
+   Points are placed on a regular time grid t0 + i*period and stored
+   in blocks of `block` points. Block key is the timestamp of its first
+   point, value is a bitmap of existing points followed by data of all
+   points of the block (fixed number of columns). Points are found by
+   index arithmetic, range reads are sequential reads of blocks.
+*/
+
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include "gr_db.h"
+
+using namespace std;
+
+// check if j-th point of the block exists, set/clear it
+#define FR_BIT(bv,j)  ((bv)[(j)/8] & (1<<((j)%8)))
+#define FR_SET(bv,j)  ((bv)[(j)/8] |= (char)(1<<((j)%8)))
+#define FR_CLR(bv,j)  ((bv)[(j)/8] &= (char)~(1<<((j)%8)))
+
+/************************************/
+int64_t
+GrapheneDB::fr_idx(const string & tp, const int rnd) const {
+  uint64_t u = graphene_time_to_units(tp, ttype);
+  if (u < fr_t0){
+    if (rnd>0) return 0;
+    if (rnd==0 && 2*(fr_t0-u) <= fr_period) return 0;
+    return -1;
+  }
+  uint64_t d = u - fr_t0;
+  uint64_t i = d/fr_period, r = d%fr_period;
+  if (rnd>0 && r>0) i++;
+  if (rnd==0 && 2*r >= fr_period) i++;
+  return i > INT64_MAX ? INT64_MAX : i;
+}
+
+int64_t
+GrapheneDB::fr_imax() const {
+  return fr_idx(graphene_time_parse("inf", ttype), -1);
+}
+
+string
+GrapheneDB::fr_time(const int64_t i) const {
+  if (i<0 || (uint64_t)i > (UINT64_MAX - fr_t0)/fr_period)
+    throw Err() << name << ".db: timestamp is out of range";
+  return graphene_time_from_units(fr_t0 + i*fr_period, ttype);
+}
+
+/************************************/
+void
+GrapheneDB::fr_scan(DB_TXN *txn, int64_t i1, int64_t i2,
+    const std::function<int64_t(const int64_t, const std::string &)> & cb){
+  if (i1<0) i1 = 0;
+  i2 = min(i2, fr_imax());
+  size_t nb = (fr_block+7)/8, ps = fr_psize();
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+    int64_t bn = -1; // first point of the block after the current one
+    DBT k = mk_dbt();
+    DBT v = mk_dbt();
+    while (i1<=i2){
+
+      // next block: step or seek
+      string bk;
+      bool found;
+      if (i1==bn) found = c_get(curs, &k, &v, DB_NEXT);
+      else {
+        bk = fr_time(i1 - i1%fr_block);
+        k = mk_dbt(bk);
+        found = c_get(curs, &k, &v, DB_SET_RANGE);
+      }
+      if (!found || !is_tstamp(&k)) break;
+
+      int64_t b0 = fr_idx(dbt2str(&k), 0);
+      if (b0>i2) break;
+      string bv = dbt2str(&v);
+      if (bv.size()!=fr_bsize())
+        throw Err() << name << ".db: broken fixed-rate block";
+
+      bn = b0 + fr_block;
+      int64_t i = max(i1, b0);
+      while (i<bn && i<=i2){
+        size_t j = i-b0;
+        if (!FR_BIT(bv,j)) { i++; continue; }
+        int64_t n = cb(i, bv.substr(nb + j*ps, ps));
+        if (n<0) { i = i2+1; break; }
+        i = max(n, i+1);
+      }
+      i1 = i;
+    }
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    throw e;
+  }
+}
+
+int64_t
+GrapheneDB::fr_prev(DB_TXN *txn, const int64_t i, string & val){
+  if (i<0) return -1;
+  size_t nb = (fr_block+7)/8, ps = fr_psize();
+  int64_t ret = -1;
+  DBC *curs = NULL;
+  try {
+    get_cursor(dbp.get(), txn, &curs, 0);
+    string bk = fr_time(i - i%fr_block);
+    DBT k = mk_dbt(bk);
+    DBT v = mk_dbt();
+
+    // block of the point i, or the previous one
+    bool found = c_get(curs, &k, &v, DB_SET_RANGE);
+    if (!found || dbt2str(&k)!=bk)
+      found = c_get(curs, &k, &v, found? DB_PREV:DB_LAST);
+
+    while (ret<0 && found && is_tstamp(&k)){
+      int64_t b0 = fr_idx(dbt2str(&k), 0);
+      string bv = dbt2str(&v);
+      if (bv.size()!=fr_bsize())
+        throw Err() << name << ".db: broken fixed-rate block";
+      for (int64_t j = min<int64_t>(i-b0, fr_block-1); j>=0; j--){
+        if (!FR_BIT(bv,j)) continue;
+        ret = b0+j;
+        val = bv.substr(nb + j*ps, ps);
+        break;
+      }
+      if (ret<0) found = c_get(curs, &k, &v, DB_PREV);
+    }
+    curs->close(curs);
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    throw e;
+  }
+  return ret;
+}
+
+/************************************/
+void
+GrapheneDB::fr_put(const string & tp, const string & vs, const string & dpolicy){
+  int64_t i = fr_idx(tp, 0);
+  if (i<0) throw Err() << name << ".db: "
+    << "timestamp is before the start of the fixed-rate database";
+  if (vs.size()!=fr_psize()) throw Err() << name << ".db: "
+    << fr_cols << " value(s) expected in the fixed-rate database";
+
+  size_t nb = (fr_block+7)/8, ps = fr_psize();
+  int64_t b0 = i - i%fr_block;
+  size_t j = i-b0;
+  string bk = fr_time(b0);
+  string ks = fr_time(i);
+
+  // do everything in a single transaction
+  DB_TXN *txn = txn_begin();
+  try {
+    GrapheneStats st;
+    bool use_st = stats_read(txn, st);
+
+    DBT k = mk_dbt(bk);
+    DBT v = mk_dbt();
+    int res = dbp->get(dbp.get(), txn, &k, &v, 0);
+    if (res!=0 && res!=DB_NOTFOUND)
+      throw Err() << name << ".db: " << db_strerror(res);
+    string bv = (res==0)? dbt2str(&v) : string(fr_bsize(), '\0');
+    if (bv.size()!=fr_bsize())
+      throw Err() << name << ".db: broken fixed-rate block";
+
+    if (FR_BIT(bv,j)){
+      if (dpolicy=="skip") {txn_commit(txn); return;}
+      if (dpolicy=="error") throw Err() << name << ".db: " << "Timestamp exists";
+      if (dpolicy=="sshift" || dpolicy=="nsshift")
+        throw Err() << name << ".db: " << dpolicy << " policy can not be used in fixed-rate databases";
+      if (dpolicy!="replace") throw Err() << "Unknown dpolicy setting: " << dpolicy;
+      if (use_st) st.del(ks, graphene_data_values(bv.substr(nb + j*ps, ps), dtype, quant), ttype);
+    }
+
+    FR_SET(bv,j);
+    bv.replace(nb + j*ps, ps, vs);
+    k = mk_dbt(bk);
+    v = mk_dbt(bv);
+    res = dbp->put(dbp.get(), txn, &k, &v, 0);
+    if (res!=0) throw Err() << name << ".db: " << db_strerror(res);
+    backup_upd(txn, ks);
+
+    if (use_st){
+      st.add(ks, graphene_data_values(vs, dtype, quant), ttype);
+      stats_write(txn, st);
+    }
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+/************************************/
+void
+GrapheneDB::fr_get_next(const string & t1p, GrapheneFormatter & out){
+  fr_prep(out);
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try {
+    fr_scan(txn, fr_idx(t1p, +1), INT64_MAX,
+      [&](const int64_t i, const string & v) -> int64_t {
+        out.proc_point(fr_time(i), v, ttype, dtype);
+        return -1;
+      });
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+void
+GrapheneDB::fr_get_prev(const string & t2p, GrapheneFormatter & out){
+  fr_prep(out);
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try {
+    string v;
+    int64_t i = fr_prev(txn, fr_idx(t2p, -1), v);
+    if (i>=0) out.proc_point(fr_time(i), v, ttype, dtype);
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+// previous or interpolated point
+void
+GrapheneDB::fr_get(const string & tp, GrapheneFormatter & out){
+  if (dtype!=DATA_FLOAT && dtype!=DATA_DOUBLE && !graphene_dtype_quant(dtype))
+    return fr_get_prev(tp, out);
+  fr_prep(out);
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try {
+    string v1, v2;
+    int64_t i1 = fr_prev(txn, fr_idx(tp, -1), v1), i2 = -1;
+    if (i1>=0){
+      string t1p = fr_time(i1);
+      // next point
+      if (t1p != tp)
+        fr_scan(txn, i1+1, INT64_MAX,
+          [&](const int64_t i, const string & v) -> int64_t {
+            i2 = i; v2 = v; return -1;
+          });
+      if (i2<0) out.proc_point(t1p, v1, ttype, dtype);
+      else out.proc_point(tp,
+        graphene_interpolate(tp, t1p, fr_time(i2), v1, v2, ttype, dtype), ttype, dtype);
+    }
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+// points in the range with distance >= dt between them,
+// no more then cnt points (if cnt>0)
+void
+GrapheneDB::fr_get_range(const string & t1p, const string & t2p,
+                         const string & dtp, const uint64_t cnt, GrapheneFormatter & out){
+  fr_prep(out);
+  uint64_t dt = graphene_time_to_units(dtp, ttype);
+  int64_t step = max<uint64_t>(1, (dt + fr_period - 1)/fr_period);
+  uint64_t n = 0;
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try {
+    fr_scan(txn, fr_idx(t1p, +1), fr_idx(t2p, -1),
+      [&](const int64_t i, const string & v) -> int64_t {
+        out.proc_point(fr_time(i), v, ttype, dtype);
+        if (cnt && ++n >= cnt) return -1;
+        return i+step;
+      });
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+uint64_t
+GrapheneDB::fr_count_range(const string & t1p, const string & t2p){
+  uint64_t n = 0;
+  DB_TXN *txn = txn_begin(DB_TXN_SNAPSHOT);
+  try {
+    fr_scan(txn, fr_idx(t1p, +1), fr_idx(t2p, -1),
+      [&](const int64_t i, const string & v) -> int64_t { n++; return i+1; });
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+  return n;
+}
+
+/************************************/
+// Delete points in the range. If single is set, delete one point
+// with timestamp t1p, throw an error if it does not exist.
+// Transaction limits are checked after each block with deleted points
+// (see del_range_txn).
+uint64_t
+GrapheneDB::fr_del_range(const string & t1p, const string & t2p, const bool single,
+                         const uint64_t max_n, const int max_ms, string & last, bool & more){
+  int64_t i1 = fr_idx(t1p, +1), i2 = min(fr_idx(t2p, -1), fr_imax());
+  size_t nb = (fr_block+7)/8, ps = fr_psize();
+  int64_t first_del = -1, last_del = -1;
+  uint64_t n = 0;
+  auto t0 = std::chrono::steady_clock::now();
+
+  DB_TXN *txn = txn_begin();
+  DBC *curs = NULL;
+  try {
+    GrapheneStats st;
+    bool use_st = stats_read(txn, st);
+
+    get_cursor(dbp.get(), txn, &curs, 0);
+    string bk = i1<=i2 ? fr_time(i1 - i1%fr_block) : string();
+    DBT k = mk_dbt(bk);
+    DBT v = mk_dbt();
+    int fl = DB_SET_RANGE;
+    while (i1<=i2){
+      if (n>0 && ((max_n && n>=max_n) || (max_ms>0 && std::chrono::steady_clock::now() - t0 >=
+                                  std::chrono::milliseconds(max_ms)))){
+        more = true;
+        break;
+      }
+      if (!c_get(curs, &k, &v, fl) || !is_tstamp(&k)) break;
+      fl = DB_NEXT;
+      int64_t b0 = fr_idx(dbt2str(&k), 0);
+      if (b0>i2) break;
+      string bv = dbt2str(&v);
+      if (bv.size()!=fr_bsize())
+        throw Err() << name << ".db: broken fixed-rate block";
+
+      bool changed = false, empty = true;
+      for (size_t j=0; j<fr_block; j++){
+        if (!FR_BIT(bv,j)) continue;
+        int64_t i = b0+j;
+        if (i<i1 || i>i2) { empty = false; continue; }
+        FR_CLR(bv,j);
+        changed = true;
+        if (first_del<0) first_del = i;
+        last_del = i;
+        n++;
+        if (use_st) st.del(fr_time(i),
+          graphene_data_values(bv.substr(nb + j*ps, ps), dtype, quant), ttype);
+      }
+      if (!changed) continue;
+
+      int res;
+      if (empty) res = curs->del(curs, 0);
+      else {
+        DBT v1 = mk_dbt(bv);
+        res = curs->put(curs, &k, &v1, DB_CURRENT);
+      }
+      if (res!=0) throw Err() << name << ".db: " << db_strerror(res);
+    }
+    curs->close(curs);
+    curs = NULL;
+
+    if (single && first_del<0)
+      throw Err() << name << ".db: No such record: " << graphene_time_print(t1p, ttype);
+
+    if (first_del>=0){
+      backup_upd(txn, fr_time(first_del));
+      if (use_st){
+        stats_fix_bounds(txn, st);
+        stats_write(txn, st);
+      }
+      last = fr_time(last_del);
+    }
+  }
+  catch (Err e){
+    if (curs) curs->close(curs);
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+  return n;
+}
+
+/************************************/
+void
+GrapheneDB::fr_rebuild_stats(){
+  GrapheneStats st;
+  DB_TXN *txn = txn_begin();
+  try {
+    fr_scan(txn, 0, INT64_MAX,
+      [&](const int64_t i, const string & v) -> int64_t {
+        st.add(fr_time(i), graphene_data_values(v, dtype, quant), ttype);
+        return i+1;
+      });
+    stats_write(txn, st);
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
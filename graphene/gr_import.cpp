@@ -0,0 +1,200 @@
+/* Parallel import of text data: GrapheneEnv::import method.
+
+   Input lines: <database> <time> <value> ..., fields are separated by
+   spaces, tabs or commas; empty lines and lines starting with # are
+   skipped. Input files are read by chunks of IMPORT_CHUNK bytes (split
+   at line boundaries). A batch of import_threads chunks is parsed in
+   parallel, then points of each database are sorted and written by
+   bulk puts (GrapheneDB::put_bulk) or one by one for databases which
+   do not support bulk writing.
+*/
+
+#include <thread>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include "gr_env.h"
+#include "gr_metrics.h"
+
+using namespace std;
+
+#define IMPORT_CHUNK (8<<20)
+
+// one input point
+struct GrapheneImpRec {
+  string name, t;       // database name, timestamp
+  vector<string> vals;  // values
+  string k, v;          // packed timestamp and value
+};
+
+// database parameters for packing
+struct GrapheneImpDB {
+  TimeType ttype;
+  DataType dtype;
+  DataQuant quant;
+  bool bulk;
+  vector<GrapheneImpRec *> recs;
+};
+
+// Run f(i) for i in [0,n) in parallel threads, rethrow the first error.
+void
+GrapheneEnv::run_parallel(const size_t n, const function<void(const size_t)> & f){
+  vector<thread> th;
+  vector<string> err(n);
+  vector<char> failed(n, 0);
+  for (size_t i=0; i<n; i++)
+    th.emplace_back([&f, &err, &failed, i](){
+      try { f(i); }
+      catch (Err & e){ err[i] = e.str(); failed[i] = 1; }
+      catch (std::exception & e){ err[i] = e.what(); failed[i] = 1; }
+      catch (...){ err[i] = "unknown error"; failed[i] = 1; }
+    });
+  for (auto & t: th) t.join();
+  for (size_t i=0; i<n; i++)
+    if (failed[i]) throw Err() << err[i];
+}
+
+// Split text into records.
+static void
+imp_tokenize(const string & file, const string & text, vector<GrapheneImpRec> & out){
+  const char *b = text.data(), *e = b + text.size();
+  while (b<e){
+    const char *le = (const char *)memchr(b, '\n', e-b);
+    if (!le) le = e;
+    string line(b, le);
+    b = le+1;
+
+    GrapheneImpRec r;
+    size_t n = 0, p = 0;
+    while (1){
+      size_t p1 = line.find_first_not_of(" \t,\r", p);
+      if (p1==string::npos) break;
+      if (n==0 && line[p1]=='#') break;
+      size_t p2 = line.find_first_of(" \t,\r", p1);
+      string w = line.substr(p1, p2==string::npos? string::npos : p2-p1);
+      if (n==0) r.name = w;
+      else if (n==1) r.t = w;
+      else r.vals.push_back(w);
+      n++;
+      if (p2==string::npos) break;
+      p = p2;
+    }
+    if (n==0) continue;
+    if (n<3) throw Err() << file << ": bad line: " << line;
+    out.push_back(r);
+  }
+}
+
+/************************************/
+void
+GrapheneEnv::import_batch(const vector<string> & files, const vector<string> & chunks,
+                          map<string, uint64_t> & cnt){
+  size_t n = chunks.size();
+
+  // parse text
+  vector<vector<GrapheneImpRec> > recs(n);
+  run_parallel(n, [&](const size_t i){ imp_tokenize(files[i], chunks[i], recs[i]); });
+
+  // database parameters
+  map<string, GrapheneImpDB> dbs;
+  for (auto & rv: recs){
+    for (auto & r: rv){
+      if (dbs.count(r.name)==0){
+        auto & db = getdb(r.name);
+        GrapheneImpDB & d = dbs[r.name];
+        d.ttype = db.get_ttype();
+        d.dtype = db.get_dtype();
+        d.quant = db.get_quant();
+        d.bulk  = db.can_put_bulk();
+      }
+      dbs[r.name].recs.push_back(&r);
+    }
+  }
+
+  // pack timestamps and values
+  run_parallel(n, [&](const size_t i){
+    for (auto & r: recs[i]){
+      auto const & d = dbs.at(r.name);
+      r.k = graphene_time_parse(r.t, d.ttype);
+      if (d.bulk) r.v = graphene_data_parse(r.vals, d.dtype, d.quant);
+    }
+  });
+
+  // sort and write data
+  for (auto & dd: dbs){
+    auto & d = dd.second;
+    stable_sort(d.recs.begin(), d.recs.end(),
+      [&d](const GrapheneImpRec *a, const GrapheneImpRec *b){
+        return graphene_time_cmp(a->k, b->k, d.ttype)<0; });
+
+    if (d.bulk){
+      // later points replace earlier ones with same timestamp
+      vector<pair<string, string> > kv;
+      for (auto r: d.recs){
+        if (kv.size() && kv.back().first == r->k) kv.back().second = r->v;
+        else kv.emplace_back(r->k, r->v);
+      }
+      getdb(dd.first).put_bulk(kv);
+      cnt[dd.first] += kv.size();
+      metrics_write(dd.first, kv.size());
+    }
+    else {
+      for (auto r: d.recs) getdb(dd.first).put(r->t, r->vals, "replace");
+      cnt[dd.first] += d.recs.size();
+      metrics_write(dd.first, d.recs.size());
+    }
+    cat_reset(dd.first);
+  }
+}
+
+void
+GrapheneEnv::import(const vector<string> & files, ostream & out){
+  if (readonly) throw Err() << "can't import data in readonly mode";
+  map<string, uint64_t> cnt;
+  vector<string> cfiles, chunks;
+
+  for (auto const & file: files){
+    ifstream ff;
+    if (file!="-"){
+      ff.open(file.c_str(), ios::binary);
+      if (!ff) throw Err() << file << ": " << strerror(errno);
+    }
+    istream & in = file=="-"? cin : ff;
+
+    // read chunks, split at line boundaries
+    string rest;
+    while (1){
+      string c;
+      c.swap(rest);
+      size_t s = c.size();
+      c.resize(s + IMPORT_CHUNK);
+      in.read(&c[s], IMPORT_CHUNK);
+      c.resize(s + in.gcount());
+      if (in.bad()) throw Err() << file << ": read error";
+      bool eof = !in;
+      if (!eof){
+        size_t p = c.rfind('\n');
+        if (p==string::npos){ // long line, read more
+          rest.swap(c);
+          continue;
+        }
+        rest = c.substr(p+1);
+        c.resize(p+1);
+      }
+      if (c.size()){
+        cfiles.push_back(file);
+        chunks.push_back(c);
+      }
+      if (chunks.size() >= (size_t)import_threads){
+        import_batch(cfiles, chunks, cnt);
+        cfiles.clear();
+        chunks.clear();
+      }
+      if (eof) break;
+    }
+  }
+  if (chunks.size()) import_batch(cfiles, chunks, cnt);
+
+  for (auto const & c: cnt) out << c.first << " " << c.second << "\n";
+}
@@ -0,0 +1,202 @@
+#include <map>
+#include <set>
+#include <mutex>
+#include <iomanip>
+
+#include "gr_metrics.h"
+
+/***************************************************/
+// Latency histogram (upper bounds of buckets, sec; last bucket is +Inf)
+static const double hist_bounds[] =
+  {0.0001, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10};
+#define HIST_NB (sizeof(hist_bounds)/sizeof(hist_bounds[0]))
+
+struct MetricsHist {
+  uint64_t buckets[HIST_NB+1]; // non-cumulative counts
+  uint64_t count;
+  double sum;
+
+  MetricsHist(): count(0), sum(0) { for (auto & b:buckets) b=0; }
+
+  void add(const double v){
+    size_t i=0;
+    while (i<HIST_NB && v>hist_bounds[i]) i++;
+    buckets[i]++; count++; sum+=v;
+  }
+
+  void merge(const MetricsHist & h){
+    for (size_t i=0; i<=HIST_NB; i++) buckets[i]+=h.buckets[i];
+    count+=h.count; sum+=h.sum;
+  }
+};
+
+// All metrics
+struct MetricsData {
+  std::map<std::string, MetricsHist> cmd_time, flt_time;
+  std::map<std::string, uint64_t> cmd_err, pts_read, pts_written, bytes_out;
+  uint64_t pool[3]; // handle cache events, see MetricsPoolEv
+
+  MetricsData() { for (auto & p:pool) p=0; }
+
+  static void merge_map(std::map<std::string, uint64_t> & m1,
+                        const std::map<std::string, uint64_t> & m2){
+    for (auto const & v:m2) m1[v.first] += v.second;
+  }
+  static void merge_map(std::map<std::string, MetricsHist> & m1,
+                        const std::map<std::string, MetricsHist> & m2){
+    for (auto const & v:m2) m1[v.first].merge(v.second);
+  }
+
+  void merge(const MetricsData & d){
+    merge_map(cmd_time, d.cmd_time);
+    merge_map(flt_time, d.flt_time);
+    merge_map(cmd_err, d.cmd_err);
+    merge_map(pts_read, d.pts_read);
+    merge_map(pts_written, d.pts_written);
+    merge_map(bytes_out, d.bytes_out);
+    for (int i=0; i<3; i++) pool[i] += d.pool[i];
+  }
+};
+
+/***************************************************/
+// Per-thread storage. Registered in a global list while the
+// thread is running, data is moved to `retired` when it finishes.
+
+struct MetricsThread;
+static std::mutex reg_mutex;
+static std::set<MetricsThread*> reg_threads;
+static MetricsData reg_retired;
+
+struct MetricsThread {
+  std::mutex m;
+  MetricsData d;
+
+  MetricsThread(){
+    std::lock_guard<std::mutex> lk(reg_mutex);
+    reg_threads.insert(this);
+  }
+  ~MetricsThread(){
+    std::lock_guard<std::mutex> lk(reg_mutex);
+    reg_retired.merge(d);
+    reg_threads.erase(this);
+  }
+};
+
+static MetricsThread & metrics_thread(){
+  static thread_local MetricsThread t;
+  return t;
+}
+
+/***************************************************/
+
+void
+metrics_cmd(const std::string & cmd, const double sec, const bool err){
+  auto & t = metrics_thread();
+  std::lock_guard<std::mutex> lk(t.m);
+  t.d.cmd_time[cmd].add(sec);
+  if (err) t.d.cmd_err[cmd]++;
+}
+
+void
+metrics_filter(const std::string & db, const double sec){
+  auto & t = metrics_thread();
+  std::lock_guard<std::mutex> lk(t.m);
+  t.d.flt_time[db].add(sec);
+}
+
+void
+metrics_read(const std::string & db, const uint64_t points, const uint64_t bytes){
+  auto & t = metrics_thread();
+  std::lock_guard<std::mutex> lk(t.m);
+  t.d.pts_read[db]  += points;
+  t.d.bytes_out[db] += bytes;
+}
+
+void
+metrics_write(const std::string & db, const uint64_t points){
+  auto & t = metrics_thread();
+  std::lock_guard<std::mutex> lk(t.m);
+  t.d.pts_written[db] += points;
+}
+
+void
+metrics_pool(const MetricsPoolEv ev){
+  auto & t = metrics_thread();
+  std::lock_guard<std::mutex> lk(t.m);
+  t.d.pool[ev]++;
+}
+
+void
+metrics_reset(){
+  std::lock_guard<std::mutex> lk(reg_mutex);
+  reg_retired = MetricsData();
+  for (auto t:reg_threads){
+    std::lock_guard<std::mutex> lk(t->m);
+    t->d = MetricsData();
+  }
+}
+
+/***************************************************/
+
+// print label value with escaping
+static std::string
+metrics_label(const std::string & name, const std::string & val){
+  std::string ret = name + "=\"";
+  for (auto c:val){
+    if (c=='\\' || c=='"') ret += '\\';
+    if (c=='\n') { ret += "\\n"; continue; }
+    ret += c;
+  }
+  return ret + "\"";
+}
+
+static void
+metrics_print_hist(std::ostream & out, const std::string & name,
+    const std::string & label, const std::map<std::string, MetricsHist> & m){
+  out << "# TYPE " << name << " histogram\n";
+  for (auto const & v:m){
+    auto l = metrics_label(label, v.first);
+    uint64_t cnt = 0;
+    for (size_t i=0; i<=HIST_NB; i++){
+      cnt += v.second.buckets[i];
+      out << name << "_bucket{" << l << ",le=\"";
+      if (i<HIST_NB) out << hist_bounds[i];
+      else out << "+Inf";
+      out << "\"} " << cnt << "\n";
+    }
+    out << name << "_sum{" << l << "} " << v.second.sum << "\n";
+    out << name << "_count{" << l << "} " << v.second.count << "\n";
+  }
+}
+
+static void
+metrics_print_cnt(std::ostream & out, const std::string & name,
+    const std::string & label, const std::map<std::string, uint64_t> & m){
+  out << "# TYPE " << name << " counter\n";
+  for (auto const & v:m)
+    out << name << "{" << metrics_label(label, v.first) << "} " << v.second << "\n";
+}
+
+void
+metrics_print(std::ostream & out){
+  MetricsData d;
+  {
+    std::lock_guard<std::mutex> lk(reg_mutex);
+    d.merge(reg_retired);
+    for (auto t:reg_threads){
+      std::lock_guard<std::mutex> lk(t->m);
+      d.merge(t->d);
+    }
+  }
+  metrics_print_hist(out, "graphene_command_seconds", "cmd", d.cmd_time);
+  metrics_print_cnt(out,  "graphene_command_errors_total", "cmd", d.cmd_err);
+  metrics_print_hist(out, "graphene_filter_seconds", "db", d.flt_time);
+  metrics_print_cnt(out,  "graphene_points_read_total", "db", d.pts_read);
+  metrics_print_cnt(out,  "graphene_points_written_total", "db", d.pts_written);
+  metrics_print_cnt(out,  "graphene_bytes_out_total", "db", d.bytes_out);
+  const char *pn[] = {"hits", "misses", "evictions"};
+  for (int i=0; i<3; i++){
+    out << "# TYPE graphene_pool_" << pn[i] << "_total counter\n";
+    out << "graphene_pool_" << pn[i] << "_total " << d.pool[i] << "\n";
+  }
+}
@@ -0,0 +1,64 @@
+/* Runtime metrics: command latency histograms, per-database
+   counters and filter time.
+
+   Values are collected into per-thread storage (each thread
+   locks only its own, normally uncontended, mutex) and summed up
+   on reading. Output is in Prometheus text format.
+ */
+
+#ifndef GR_METRICS_H
+#define GR_METRICS_H
+
+#include <string>
+#include <ostream>
+#include <chrono>
+#include <cstdint>
+
+// Command latency, sec. err -- command failed.
+void metrics_cmd(const std::string & cmd, const double sec, const bool err = false);
+
+// Filter time for one query, sec.
+void metrics_filter(const std::string & db, const double sec);
+
+// Points read from a database and bytes sent to output.
+void metrics_read(const std::string & db, const uint64_t points, const uint64_t bytes);
+
+// Points written to a database.
+void metrics_write(const std::string & db, const uint64_t points);
+
+// Database handle cache (GrapheneEnv::getdb): found in the cache,
+// opened, closed because of the cache size limit.
+enum MetricsPoolEv {POOL_HIT, POOL_MISS, POOL_EVICT};
+void metrics_pool(const MetricsPoolEv ev);
+
+// Print all metrics in Prometheus text format.
+void metrics_print(std::ostream & out);
+
+// Reset all metrics (for tests).
+void metrics_reset();
+
+/***************************************************/
+
+// Measure command latency: record it in the destructor.
+// If the destructor is called during exception processing
+// the command is counted as failed.
+class MetricsTimer {
+  std::string cmd;
+  std::chrono::steady_clock::time_point t0;
+  bool active;
+
+  public:
+  MetricsTimer(const std::string & cmd_):
+    cmd(cmd_), t0(std::chrono::steady_clock::now()), active(true) {}
+
+  // Do not record anything (e.g. for unknown commands).
+  void cancel() {active = false;}
+
+  ~MetricsTimer(){
+    if (!active) return;
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    metrics_cmd(cmd, dt.count(), std::uncaught_exception());
+  }
+};
+
+#endif
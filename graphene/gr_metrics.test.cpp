@@ -0,0 +1,91 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <string>
+
+#include "err/err.h"
+#include "err/assert_err.h"
+
+#include "gr_metrics.h"
+
+// find a line starting with the prefix, return rest of the line
+std::string
+get_val(const std::string & text, const std::string & prefix){
+  std::istringstream in(text);
+  std::string l;
+  while (std::getline(in, l))
+    if (l.compare(0, prefix.size(), prefix) == 0) return l.substr(prefix.size());
+  return "none";
+}
+
+int main() {
+  try{
+
+    metrics_cmd("put", 0.002);
+    metrics_cmd("put", 0.02);
+    metrics_cmd("put", 20, true);
+    metrics_write("db1", 2);
+    metrics_read("db1", 10, 100);
+    metrics_filter("db1", 0.5);
+    metrics_pool(POOL_MISS);
+    metrics_pool(POOL_HIT);
+    metrics_pool(POOL_HIT);
+
+    // data from other threads is summed up, also after thread exit
+    std::thread th([](){ metrics_write("db1", 3); metrics_read("db\"2", 1, 5); });
+    th.join();
+
+    std::ostringstream out;
+    metrics_print(out);
+    auto s = out.str();
+
+    assert_eq(get_val(s, "# TYPE graphene_command_seconds "), "histogram");
+    assert_eq(get_val(s, "graphene_command_seconds_bucket{cmd=\"put\",le=\"0.001\"} "), "0");
+    assert_eq(get_val(s, "graphene_command_seconds_bucket{cmd=\"put\",le=\"0.005\"} "), "1");
+    assert_eq(get_val(s, "graphene_command_seconds_bucket{cmd=\"put\",le=\"0.05\"} "), "2");
+    assert_eq(get_val(s, "graphene_command_seconds_bucket{cmd=\"put\",le=\"10\"} "), "2");
+    assert_eq(get_val(s, "graphene_command_seconds_bucket{cmd=\"put\",le=\"+Inf\"} "), "3");
+    assert_eq(get_val(s, "graphene_command_seconds_sum{cmd=\"put\"} "), "20.022");
+    assert_eq(get_val(s, "graphene_command_seconds_count{cmd=\"put\"} "), "3");
+    assert_eq(get_val(s, "graphene_command_errors_total{cmd=\"put\"} "), "1");
+    assert_eq(get_val(s, "graphene_filter_seconds_count{db=\"db1\"} "), "1");
+    assert_eq(get_val(s, "graphene_points_read_total{db=\"db1\"} "), "10");
+    assert_eq(get_val(s, "graphene_points_read_total{db=\"db\\\"2\"} "), "1");
+    assert_eq(get_val(s, "graphene_points_written_total{db=\"db1\"} "), "5");
+    assert_eq(get_val(s, "graphene_bytes_out_total{db=\"db1\"} "), "100");
+    assert_eq(get_val(s, "graphene_pool_hits_total "), "2");
+    assert_eq(get_val(s, "graphene_pool_misses_total "), "1");
+    assert_eq(get_val(s, "graphene_pool_evictions_total "), "0");
+
+    // timer
+    {
+      MetricsTimer mt("get");
+    }
+    {
+      MetricsTimer mt("xxx");
+      mt.cancel();
+    }
+    try {
+      MetricsTimer mt("get");
+      throw Err() << "error";
+    }
+    catch (Err & e) {}
+
+    out.str("");
+    metrics_print(out);
+    s = out.str();
+    assert_eq(get_val(s, "graphene_command_seconds_count{cmd=\"get\"} "), "2");
+    assert_eq(get_val(s, "graphene_command_errors_total{cmd=\"get\"} "), "1");
+    assert_eq(get_val(s, "graphene_command_seconds_count{cmd=\"xxx\"} "), "none");
+
+    metrics_reset();
+    out.str("");
+    metrics_print(out);
+    assert_eq(get_val(out.str(), "graphene_command_seconds_count{cmd=\"put\"} "), "none");
+
+  } catch (Err E){
+    std::cerr << E.str() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,297 @@
+/* Partitioned databases: GrapheneDB methods for routing data
+   to partition databases.
+
+   Partition k keeps points with k*period <= t < (k+1)*period in a
+   normal database <name>%p<k> (in the same folder or container). The
+   main database keeps information records (description, data type,
+   options, filters, backup timers) and the list of existing partitions
+   (KEY_PARTS record, array of uint64 numbers). Queries open only
+   partitions which overlap the requested time range, old data can be
+   removed by deleting whole partitions.
+*/
+
+#include <algorithm>
+#include "gr_db.h"
+
+using namespace std;
+
+// KEY_PARTS record <-> list of partitions
+static vector<uint64_t>
+pt_unpack(const string & s){
+  vector<uint64_t> ret(s.size()/sizeof(uint64_t));
+  for (size_t i=0; i<ret.size(); i++)
+    ret[i] = *(uint64_t *)(s.data() + i*sizeof(uint64_t));
+  return ret;
+}
+
+static string
+pt_pack(const vector<uint64_t> & l){
+  return string((const char *)l.data(), l.size()*sizeof(uint64_t));
+}
+
+/************************************/
+string
+GrapheneDB::part_name(const string & name, const uint64_t k){
+  return name + "%p" + type_to_str(k);
+}
+
+bool
+GrapheneDB::is_part_name(const string & name){
+  size_t p = name.rfind("%p");
+  if (p==string::npos || p+2==name.size()) return false;
+  return name.find_first_not_of("0123456789", p+2) == string::npos;
+}
+
+void
+GrapheneDB::check_int_name(const string & name){
+  check_name(is_part_name(name)? name.substr(0, name.rfind("%p")) : name);
+}
+
+vector<string>
+GrapheneDB::part_names(){
+  vector<string> ret;
+  if (pt_period) for (auto k: pt_list()) ret.push_back(part_name(name, k));
+  return ret;
+}
+
+uint64_t
+GrapheneDB::pt_idx(const string & tp) const {
+  return graphene_time_to_units(tp, ttype)/pt_period;
+}
+
+vector<uint64_t>
+GrapheneDB::pt_list(){
+  return pt_unpack(get_key(NULL, KEY_PARTS));
+}
+
+GrapheneDB &
+GrapheneDB::pt_db(const uint64_t k, const bool create){
+  auto i = pt_cache.find(k);
+  if (i!=pt_cache.end() && !(create && i->second.first->is_readonly())){
+    i->second.second = ++pt_use;
+    return *i->second.first;
+  }
+
+  auto l = pt_list();
+  bool init = create && !binary_search(l.begin(), l.end(), k);
+  if (i!=pt_cache.end()) pt_cache.erase(i);
+
+  // close least recently used partitions
+  while (pt_max && pt_cache.size() >= pt_max){
+    auto j = pt_cache.begin();
+    for (auto m = pt_cache.begin(); m!=pt_cache.end(); ++m)
+      if (m->second.second < j->second.second) j = m;
+    pt_cache.erase(j);
+  }
+
+  shared_ptr<GrapheneDB> db;
+  if (!init)
+    db = make_shared<GrapheneDB>(env, path, part_name(name, k),
+                 create? DB_CREATE : (open_flags & DB_RDONLY), 0, container);
+  else {
+    // new partition: same data type and options (except partitioning).
+    // It is created and added to the partition list in one transaction.
+    DB_TXN *txn = txn_begin();
+    try {
+      db = make_shared<GrapheneDB>(env, path, part_name(name, k),
+                 DB_CREATE, 0, container, txn);
+      db->dtype = dtype;
+      db->dbopts = dbopts;
+      db->dbopts.erase("partition");
+      db->apply_opts();
+      db->write_info(txn);
+      db->stats_write(txn, GrapheneStats()); // empty statistics
+
+      l = pt_unpack(get_key(txn, KEY_PARTS));
+      auto j = lower_bound(l.begin(), l.end(), k);
+      if (j==l.end() || *j!=k) l.insert(j, k);
+      set_key(txn, KEY_PARTS, mk_dbt(pt_pack(l)));
+    }
+    catch (Err e){
+      txn_abort(txn);
+      throw e;
+    }
+    txn_commit(txn);
+  }
+  db->scan_mode = scan_mode;
+  pt_cache[k] = make_pair(db, ++pt_use);
+  return *db;
+}
+
+void
+GrapheneDB::pt_drop(const uint64_t k){
+  // remove the partition from the list
+  DB_TXN *txn = txn_begin();
+  try {
+    auto l = pt_unpack(get_key(txn, KEY_PARTS));
+    l.erase(remove(l.begin(), l.end(), k), l.end());
+    set_key(txn, KEY_PARTS, mk_dbt(pt_pack(l)));
+  }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+
+  // close and remove the database
+  pt_cache.erase(k);
+  string pn = part_name(name, k);
+  int res;
+  if (container!="")
+    res = env->dbremove(env, NULL, (container + ".db").c_str(), pn.c_str(), 0);
+  else if (env)
+    res = env->dbremove(env, NULL, (pn + ".db").c_str(), NULL, 0);
+  else
+    res = remove((path + "/" + pn + ".db").c_str()) ? errno : 0;
+  if (res!=0) throw Err() << pn << ".db: " << db_strerror(res);
+}
+
+/************************************/
+void
+GrapheneDB::pt_put(const string & tp, const vector<string> & dat, const string & dpolicy){
+  uint64_t k = pt_idx(tp);
+  pt_db(k, true).put(graphene_time_print(tp, ttype), dat, dpolicy);
+
+  DB_TXN *txn = txn_begin();
+  try { backup_upd(txn, tp); }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+void
+GrapheneDB::pt_get_next(const string & t1p, GrapheneFormatter & out){
+  auto l = pt_list();
+  auto t1 = graphene_time_print(t1p, ttype);
+  for (auto i = lower_bound(l.begin(), l.end(), pt_idx(t1p)); i!=l.end(); ++i){
+    GrapheneProxyFormatter pf(out);
+    pt_db(*i).get_next(t1, pf);
+    if (pf.n) return;
+  }
+}
+
+void
+GrapheneDB::pt_get_prev(const string & t2p, GrapheneFormatter & out){
+  auto l = pt_list();
+  auto t2 = graphene_time_print(t2p, ttype);
+  auto i = upper_bound(l.begin(), l.end(), pt_idx(t2p));
+  while (i!=l.begin()){
+    --i;
+    GrapheneProxyFormatter pf(out);
+    pt_db(*i).get_prev(t2, pf);
+    if (pf.n) return;
+  }
+}
+
+// points in the range with distance >= dt between them,
+// no more then cnt points (if cnt>0)
+void
+GrapheneDB::pt_get_range(const string & t1p, const string & t2p,
+                         const string & dtp, uint64_t cnt, GrapheneFormatter & out){
+  auto l = pt_list();
+  bool every = graphene_time_zero(dtp, ttype);
+  auto t2 = graphene_time_print(t2p, ttype);
+  auto dt = graphene_time_print(dtp, ttype);
+  string t1p1 = t1p;
+  uint64_t k2 = pt_idx(t2p);
+  for (auto i = lower_bound(l.begin(), l.end(), pt_idx(t1p)); i!=l.end() && *i<=k2; ++i){
+    GrapheneProxyFormatter pf(out);
+    auto & db = pt_db(*i);
+    if (cnt) db.get_count(graphene_time_print(t1p1, ttype), type_to_str(cnt), pf);
+    else db.get_range(graphene_time_print(t1p1, ttype), t2, dt, pf);
+    if (cnt) {
+      if (pf.n >= cnt) break;
+      cnt -= pf.n;
+    }
+    // keep distance between the last point and the next partition
+    if (pf.n && !every) t1p1 = graphene_time_add(pf.k, dtp, ttype);
+  }
+}
+
+uint64_t
+GrapheneDB::pt_count_range(const string & t1p, const string & t2p){
+  auto l = pt_list();
+  auto t1 = graphene_time_print(t1p, ttype);
+  auto t2 = graphene_time_print(t2p, ttype);
+  uint64_t k2 = pt_idx(t2p), ret = 0;
+  for (auto i = lower_bound(l.begin(), l.end(), pt_idx(t1p)); i!=l.end() && *i<=k2; ++i)
+    ret += pt_db(*i).count_range(t1, t2);
+  return ret;
+}
+
+void
+GrapheneDB::pt_del(const string & tp){
+  auto l = pt_list();
+  uint64_t k = pt_idx(tp);
+  if (!binary_search(l.begin(), l.end(), k))
+    throw Err() << name << ".db: No such record: " << graphene_time_print(tp, ttype);
+  pt_db(k).del(graphene_time_print(tp, ttype));
+
+  DB_TXN *txn = txn_begin();
+  try { backup_upd(txn, tp); }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+}
+
+// Partitions which are fully inside the range are removed,
+// in others del_range is done with same transaction limits.
+void
+GrapheneDB::pt_del_range(const string & t1p, const string & t2p,
+                         const uint64_t max_n, const int max_ms, const int pause_ms,
+                         GrapheneDelCB cb){
+  auto l = pt_list();
+  auto t1 = graphene_time_print(t1p, ttype);
+  auto t2 = graphene_time_print(t2p, ttype);
+  uint64_t u1 = graphene_time_to_units(t1p, ttype);
+  uint64_t u2 = graphene_time_to_units(t2p, ttype);
+  uint64_t k2 = pt_idx(t2p);
+  auto i1 = lower_bound(l.begin(), l.end(), pt_idx(t1p));
+  if (i1==l.end() || *i1>k2) return;
+
+  // backup timer of the main database is updated before deleting data
+  // (deletion can be interrupted)
+  DB_TXN *txn = txn_begin();
+  try { backup_upd(txn, t1p); }
+  catch (Err e){
+    txn_abort(txn);
+    throw e;
+  }
+  txn_commit(txn);
+
+  uint64_t n = 0;
+  for (auto i = i1; i!=l.end() && *i<=k2; ++i){
+    uint64_t s = *i * pt_period;
+    if (s >= u1 && u2 - s >= pt_period - 1){
+      auto st = pt_db(*i).get_stats();
+      pt_drop(*i);
+      n += st.count;
+      if (cb && st.count) cb(n, graphene_time_print(st.last, ttype));
+    }
+    else {
+      uint64_t n0 = n;
+      pt_db(*i).del_range(t1, t2, max_n, max_ms, pause_ms,
+        [&n, n0, cb](const uint64_t c, const string & last){
+          n = n0 + c;
+          if (cb) cb(n, last);
+        });
+    }
+  }
+}
+
+/************************************/
+GrapheneStats
+GrapheneDB::pt_get_stats(){
+  GrapheneStats st;
+  for (auto k: pt_list()) st.merge(pt_db(k).get_stats(), ttype);
+  return st;
+}
+
+void
+GrapheneDB::pt_rebuild_stats(){
+  for (auto k: pt_list()) pt_db(k).rebuild_stats();
+}
@@ -0,0 +1,236 @@
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <iomanip>
+#include <ostream>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "err/err.h"
+#include "gr_snap.h"
+
+using namespace std;
+
+/***********************************************************/
+static FILE *
+snap_tmpfile(){
+  FILE *f = tmpfile();
+  if (!f) throw Err() << "snapshot: can't create a temporary file: " << strerror(errno);
+  return f;
+}
+
+static void
+snap_fwrite(const void *p, const size_t s, FILE *f){
+  if (fwrite(p, s, 1, f)!=1)
+    throw Err() << "snapshot: can't write a temporary file: " << strerror(errno);
+}
+
+// copy a temporary file to the end of another file
+static bool
+snap_copy(FILE *from, FILE *to){
+  if (fflush(from)!=0 || fseek(from, 0, SEEK_SET)!=0) return false;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+    if (fwrite(buf, 1, n, to)!=n) return false;
+  return !ferror(from);
+}
+
+GrapheneSnapWriter::GrapheneSnapWriter(const string & file_, const TimeType ttype_,
+                                       const uint32_t block_):
+    file(file_), ttype(ttype_), block(block_), npts(0), ft(NULL), fn(NULL) {
+  if (block==0) throw Err() << "bad snapshot block size: 0";
+  ft = snap_tmpfile();
+  try { fn = snap_tmpfile(); }
+  catch (Err & e){ fclose(ft); throw e; }
+}
+
+GrapheneSnapWriter::~GrapheneSnapWriter(){
+  fclose(ft);
+  fclose(fn);
+  for (auto f: fc) fclose(f);
+}
+
+void
+GrapheneSnapWriter::add(const uint64_t t, const double *v, const uint32_t n){
+  const double nan = numeric_limits<double>::quiet_NaN();
+  uint64_t b = npts/block;
+
+  // new block
+  if (npts%block == 0){
+    bt.push_back(t);
+    bt.push_back(t);
+    for (auto & m: mm) m.resize(2*(b+1), nan);
+  }
+  bt[2*b+1] = t;
+
+  // new columns: no values in previous points
+  while (fc.size()<n){
+    fc.push_back(snap_tmpfile());
+    for (uint64_t i=0; i<npts; i++) snap_fwrite(&nan, sizeof(double), fc.back());
+    mm.push_back(vector<double>(2*(b+1), nan));
+  }
+
+  snap_fwrite(&t, sizeof(uint64_t), ft);
+  snap_fwrite(&n, sizeof(uint32_t), fn);
+  for (uint32_t c=0; c<fc.size(); c++){
+    double x = c<n? v[c] : nan;
+    snap_fwrite(&x, sizeof(double), fc[c]);
+    if (c<n && !std::isnan(x)){
+      double & mn = mm[c][2*b];
+      double & mx = mm[c][2*b+1];
+      if (std::isnan(mn) || x < mn) mn = x;
+      if (std::isnan(mx) || x > mx) mx = x;
+    }
+  }
+  npts++;
+}
+
+void
+GrapheneSnapWriter::finish(){
+  GrapheneSnapHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, GRAPHENE_SNAP_MAGIC, sizeof(h.magic));
+  h.ttype = ttype;
+  h.block = block;
+  h.npts  = npts;
+  h.ncols = fc.size();
+
+  string tmp = file + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) throw Err() << tmp << ": " << strerror(errno);
+  bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+  ok = ok && snap_copy(ft, f) && snap_copy(fn, f);
+  const char pad[8] = {0};
+  size_t np = GRAPHENE_SNAP_SZ(npts) - npts*sizeof(uint32_t);
+  if (np) ok = ok && fwrite(pad, 1, np, f) == np;
+  for (auto c: fc) ok = ok && snap_copy(c, f);
+
+  // block index: first and last time, min[ncols], max[ncols]
+  for (uint64_t b=0; b<bt.size()/2 && ok; b++){
+    ok = fwrite(&bt[2*b], sizeof(uint64_t), 2, f) == 2;
+    for (int m=0; m<2; m++)
+      for (auto const & c: mm) ok = ok && fwrite(&c[2*b+m], sizeof(double), 1, f) == 1;
+  }
+  ok = (fclose(f)==0) && ok;
+  if (!ok || rename(tmp.c_str(), file.c_str())!=0){
+    int e = errno;
+    remove(tmp.c_str());
+    throw Err() << file << ": " << strerror(e);
+  }
+}
+
+void
+graphene_snap_write(const string & file, const TimeType ttype,
+                    const vector<uint64_t> & times,
+                    const vector<uint32_t> & sizes,
+                    const vector<double> & vals,
+                    const uint32_t block){
+  if (sizes.size()!=times.size()) throw Err() << "snapshot: wrong number of sizes";
+  uint64_t nv = 0;
+  for (auto n: sizes) nv += n;
+  if (nv!=vals.size()) throw Err() << "snapshot: wrong number of values";
+
+  GrapheneSnapWriter w(file, ttype, block);
+  uint64_t off = 0;
+  for (size_t i=0; i<times.size(); i++){
+    w.add(times[i], vals.data() + off, sizes[i]);
+    off += sizes[i];
+  }
+  w.finish();
+}
+
+/***********************************************************/
+GrapheneSnap::GrapheneSnap(const string & file): map(NULL), map_size(0) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd<0) throw Err() << file << ": " << strerror(errno);
+  struct stat st;
+  if (fstat(fd, &st)!=0) {
+    int e = errno;
+    ::close(fd);
+    throw Err() << file << ": " << strerror(e);
+  }
+  map_size = st.st_size;
+  if (map_size < sizeof(GrapheneSnapHeader)){
+    ::close(fd);
+    throw Err() << file << ": not a graphene snapshot";
+  }
+  map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) throw Err() << file << ": mmap: " << strerror(errno);
+
+  h = (const GrapheneSnapHeader *)map;
+  nb = h->block ? (h->npts + h->block - 1)/h->block : 0;
+  uint64_t need = sizeof(GrapheneSnapHeader) + h->npts*sizeof(uint64_t)
+                + GRAPHENE_SNAP_SZ(h->npts) + h->ncols*h->npts*sizeof(double) + nb*(2*sizeof(uint64_t) + 2*h->ncols*sizeof(double));
+  if (memcmp(h->magic, GRAPHENE_SNAP_MAGIC, sizeof(h->magic))!=0 ||
+      h->block==0 || need != map_size){
+    munmap(map, map_size);
+    throw Err() << file << ": not a graphene snapshot";
+  }
+  t   = (const uint64_t *)((const char *)map + sizeof(GrapheneSnapHeader));
+  n   = (const uint32_t *)(t + h->npts);
+  d   = (const double *)((const char *)n + GRAPHENE_SNAP_SZ(h->npts));
+  idx = (const char *)(d + h->ncols*h->npts);
+}
+
+GrapheneSnap::~GrapheneSnap(){
+  if (map) munmap(map, map_size);
+}
+
+uint64_t
+GrapheneSnap::lower_bound(const uint64_t tu) const {
+  // first block with t2 >= tu
+  uint64_t b1 = 0, b2 = nb;
+  while (b1<b2){
+    uint64_t m = (b1+b2)/2;
+    if (block_t2(m) < tu) b1 = m+1;
+    else b2 = m;
+  }
+  if (b1==nb) return h->npts;
+  const uint64_t *s = t + b1*h->block;
+  const uint64_t *e = t + min((b1+1)*h->block, h->npts);
+  return std::lower_bound(s, e, tu) - t;
+}
+
+void
+GrapheneSnap::print(ostream & out, const string & t1, const string & t2) const {
+  TimeType tt = ttype();
+  uint64_t u1 = graphene_time_to_units(graphene_time_parse(t1, tt), tt);
+  uint64_t u2 = graphene_time_to_units(graphene_time_parse(t2, tt), tt);
+  for (uint64_t i = lower_bound(u1); i<h->npts && t[i]<=u2; i++){
+    out << graphene_time_print(graphene_time_from_units(t[i], tt), tt);
+    for (uint32_t c=0; c<n[i] && c<h->ncols; c++)
+      out << " " << setprecision(16) << column(c)[i];
+    out << "\n";
+  }
+}
+
+void
+GrapheneSnap::print_info(ostream & out) const {
+  TimeType tt = ttype();
+  out << "points " << h->npts << "\n"
+      << "columns " << h->ncols << "\n"
+      << "blocks " << nb << "\n";
+  if (!h->npts) return;
+  out << "first " << graphene_time_print(graphene_time_from_units(t[0], tt), tt) << "\n"
+      << "last "  << graphene_time_print(graphene_time_from_units(t[h->npts-1], tt), tt) << "\n";
+  for (int m=0; m<2; m++){
+    out << (m? "max":"min");
+    for (uint32_t c=0; c<h->ncols; c++){
+      double r = numeric_limits<double>::quiet_NaN();
+      for (uint64_t b=0; b<nb; b++){
+        double v = m? block_max(b,c) : block_min(b,c);
+        if (std::isnan(v)) continue;
+        if (std::isnan(r) || (m? v>r : v<r)) r = v;
+      }
+      out << " " << setprecision(16) << r;
+    }
+    out << "\n";
+  }
+}
@@ -0,0 +1,139 @@
+/* Columnar snapshot files: export of numeric data for offline analysis.
+
+   File layout (numbers in host byte order, all sections 8-byte aligned):
+     header      -- GrapheneSnapHeader
+     time column -- npts uint64 values (time units: ms for TIME_V1, ns for TIME_V2)
+     sizes       -- npts uint32 numbers of values in each point (padded to 8 bytes);
+                    column c of point i exists if c < size(i)
+     data        -- ncols columns of npts double values (NaN for missing values,
+                    stored values can be NaN as well)
+     block index -- for each block of `block` points: first and last time
+                    (uint64), then min[ncols] and max[ncols] (double,
+                    NaN if a column has no values in the block).
+
+   GrapheneSnap reads the file with mmap, all accessors return pointers
+   into the mapped memory. A snapshot does not depend on the database
+   environment and can be copied and read anywhere (with same byte order).
+*/
+
+#ifndef GR_SNAP_H
+#define GR_SNAP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include "data.h"
+
+#define GRAPHENE_SNAP_MAGIC "GRSNAP01"
+#define GRAPHENE_SNAP_BLOCK 4096 // default points per block
+
+// size of the sizes section (npts uint32 values padded to 8 bytes)
+#define GRAPHENE_SNAP_SZ(npts) ((((npts)*sizeof(uint32_t) + 7)/8)*8)
+
+struct GrapheneSnapHeader {
+  char magic[8];     // GRAPHENE_SNAP_MAGIC
+  uint32_t ttype;    // time type (TimeType)
+  uint32_t ncols;    // number of data columns
+  uint32_t block;    // points per block
+  uint32_t reserved;
+  uint64_t npts;     // number of points
+};
+
+/***********************************************************/
+// Streaming snapshot writer. Points are added one by one (sorted by
+// time); times, sizes and data columns are spilled to temporary files,
+// only the block index is kept in memory. The snapshot file is assembled
+// by finish() (through a temporary file and rename).
+class GrapheneSnapWriter {
+  std::string file;
+  TimeType ttype;
+  uint32_t block;
+  uint64_t npts;
+  FILE *ft, *fn;             // times, sizes
+  std::vector<FILE *> fc;    // data columns
+  std::vector<uint64_t> bt;  // first and last time of each block
+  std::vector<std::vector<double> > mm; // min and max of each block, for each column
+
+  GrapheneSnapWriter(const GrapheneSnapWriter &) = delete;
+  GrapheneSnapWriter & operator=(const GrapheneSnapWriter &) = delete;
+
+  public:
+  GrapheneSnapWriter(const std::string & file, const TimeType ttype,
+                     const uint32_t block = GRAPHENE_SNAP_BLOCK);
+  ~GrapheneSnapWriter();
+
+  // add a point: time units, n values
+  void add(const uint64_t t, const double *v, const uint32_t n);
+
+  // write the snapshot file
+  void finish();
+};
+
+// Write a snapshot file from memory (see GrapheneSnapWriter).
+// times -- time units, sorted; sizes -- number of values in each point;
+// vals -- values of all points, point by point.
+void graphene_snap_write(const std::string & file, const TimeType ttype,
+                         const std::vector<uint64_t> & times,
+                         const std::vector<uint32_t> & sizes,
+                         const std::vector<double> & vals,
+                         const uint32_t block = GRAPHENE_SNAP_BLOCK);
+
+/***********************************************************/
+// Read-only memory-mapped snapshot.
+class GrapheneSnap {
+  void *map;
+  size_t map_size;
+  const GrapheneSnapHeader *h;
+  const uint64_t *t;
+  const uint32_t *n;
+  const double *d;
+  const char *idx;
+  uint64_t nb;
+
+  // block index record
+  size_t bsize() const { return 2*sizeof(uint64_t) + 2*h->ncols*sizeof(double); }
+  const char * brec(const uint64_t b) const { return idx + b*bsize(); }
+
+  GrapheneSnap(const GrapheneSnap &) = delete;
+  GrapheneSnap & operator=(const GrapheneSnap &) = delete;
+
+  public:
+  GrapheneSnap(const std::string & file);
+  ~GrapheneSnap();
+
+  TimeType ttype() const { return (TimeType)h->ttype; }
+  uint64_t size() const { return h->npts; }
+  uint32_t ncols() const { return h->ncols; }
+
+  // columns (zero copy)
+  const uint64_t * times() const { return t; }
+  const uint32_t * sizes() const { return n; }
+  const double * column(const uint32_t c) const { return d + c*h->npts; }
+
+  // is there a value in column c of point i
+  bool has_value(const uint64_t i, const uint32_t c) const { return c < n[i]; }
+
+  // block index
+  uint64_t nblocks() const { return nb; }
+  uint32_t block_size() const { return h->block; }
+  uint64_t block_t1(const uint64_t b) const { return ((const uint64_t *)brec(b))[0]; }
+  uint64_t block_t2(const uint64_t b) const { return ((const uint64_t *)brec(b))[1]; }
+  double block_min(const uint64_t b, const uint32_t c) const {
+    return ((const double *)(brec(b) + 2*sizeof(uint64_t)))[c]; }
+  double block_max(const uint64_t b, const uint32_t c) const {
+    return ((const double *)(brec(b) + 2*sizeof(uint64_t)))[h->ncols + c]; }
+
+  // index of the first point with time >= tu (size() if there is no such point),
+  // binary search in the block index, then in the block
+  uint64_t lower_bound(const uint64_t tu) const;
+
+  // print points in the time range [t1,t2] (text timestamps, like get_range)
+  void print(std::ostream & out, const std::string & t1, const std::string & t2) const;
+
+  // print information: number of points and columns, time range,
+  // min and max values of each column (from the block index)
+  void print_info(std::ostream & out) const;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+
+#include "err/err.h"
+#include "err/assert_err.h"
+
+#include "gr_snap.h"
+
+int main() {
+  try{
+    const char *fn = "gr_snap.test.tmp";
+    double nan = std::numeric_limits<double>::quiet_NaN();
+
+    // 10 points, two columns (second is missing in some points,
+    // NaN value in point 8), 4 points per block
+    std::vector<uint64_t> t;
+    std::vector<uint32_t> n;
+    std::vector<double> v;
+    for (int i=0; i<10; i++){
+      t.push_back(1000*(i+1));
+      n.push_back(i%3? 2:1);
+      v.push_back(i*0.5);
+      if (i%3) v.push_back(i==8? nan : -i);
+    }
+    graphene_snap_write(fn, TIME_V1, t, n, v, 4);
+    assert_err(graphene_snap_write(fn, TIME_V1, t, n, std::vector<double>(3), 4),
+      "snapshot: wrong number of values");
+
+    {
+      GrapheneSnap s(fn);
+      assert_eq(s.ttype(), TIME_V1);
+      assert_eq(s.size(), 10);
+      assert_eq(s.ncols(), 2);
+      assert_eq(s.nblocks(), 3);
+      assert_eq(s.block_size(), 4);
+      assert_eq(s.times()[9], 10000);
+      assert_eq(s.column(0)[3], 1.5);
+      assert_eq(std::isnan(s.column(1)[3]), true);
+      assert_eq(s.sizes()[3], 1);
+      assert_eq(s.has_value(3,1), false);
+      assert_eq(s.has_value(8,1), true);
+      assert_eq(std::isnan(s.column(1)[8]), true);
+
+      // block index
+      assert_eq(s.block_t1(1), 5000);
+      assert_eq(s.block_t2(1), 8000);
+      assert_eq(s.block_t2(2), 10000);
+      assert_eq(s.block_min(1,0), 2.0);
+      assert_eq(s.block_max(1,0), 3.5);
+      assert_eq(s.block_min(1,1), -7);
+      assert_eq(s.block_max(1,1), -4);
+      assert_eq(std::isnan(s.block_min(2,1)), true);
+
+      // search
+      assert_eq(s.lower_bound(0), 0);
+      assert_eq(s.lower_bound(1000), 0);
+      assert_eq(s.lower_bound(4500), 4);
+      assert_eq(s.lower_bound(8000), 7);
+      assert_eq(s.lower_bound(10000), 9);
+      assert_eq(s.lower_bound(10001), 10);
+
+      std::ostringstream out;
+      s.print(out, "3.5", "6");
+      assert_eq(out.str(), "4.000000000 1.5\n5.000000000 2 -4\n6.000000000 2.5 -5\n");
+
+      out.str("");
+      s.print(out, "9", "10");
+      assert_eq(out.str(), "9.000000000 4 nan\n10.000000000 4.5\n");
+
+      out.str("");
+      s.print_info(out);
+      assert_eq(out.str(), "points 10\ncolumns 2\nblocks 3\n"
+        "first 1.000000000\nlast 10.000000000\nmin 0 -7\nmax 4.5 -1\n");
+    }
+
+    // empty snapshot
+    graphene_snap_write(fn, TIME_V2, std::vector<uint64_t>(),
+                        std::vector<uint32_t>(), std::vector<double>());
+    {
+      GrapheneSnap s(fn);
+      assert_eq(s.size(), 0);
+      assert_eq(s.nblocks(), 0);
+      assert_eq(s.lower_bound(0), 0);
+    }
+
+    // broken file
+    FILE *f = fopen(fn, "w");
+    fprintf(f, "GRSNAP01 broken");
+    fclose(f);
+    assert_err(GrapheneSnap s(fn), "gr_snap.test.tmp: not a graphene snapshot");
+    assert_err(GrapheneSnap s("gr_snap.test.none"),
+      "gr_snap.test.none: No such file or directory");
+
+    remove(fn);
+
+  } catch (Err E){
+    std::cerr << E.str() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -98,6 +98,61 @@ GrapheneTCL::restart(const std::string & tcl_libdir) {
 }
 
 
+/***************************************************/
+
+void
+GrapheneTCL::set_limits(const int time_ms, const int cmds){
+  if (time_ms<0) throw Err() << "filter: bad time limit: " << time_ms;
+  if (cmds<0)    throw Err() << "filter: bad command limit: " << cmds;
+  time_limit = time_ms;
+  cmd_limit  = cmds;
+}
+
+// Set interpreter limits for a top-level filter run, remove
+// them when the run is finished. Filters can be called recursively
+// (through graphene_get command), inner calls use limits of the
+// outer one.
+class TclLimitGuard {
+  Tcl_Interp *interp;
+  int & depth;
+  bool on;
+
+  public:
+  TclLimitGuard(Tcl_Interp *interp_, int & depth_, const int tl, const int cl):
+       interp(interp_), depth(depth_), on(false) {
+    if (depth>0 || (tl<=0 && cl<=0)) {depth++; return;}
+
+    if (cl>0){
+      // command limit is absolute, we need the current command count
+      if (Tcl_Eval(interp, "info cmdcount") != TCL_OK)
+        throw Err() << "filter: can't get command count: " << tcl_error(interp);
+      int cnt;
+      if (Tcl_GetIntFromObj(interp, Tcl_GetObjResult(interp), &cnt) != TCL_OK)
+        throw Err() << "filter: can't get command count: " << tcl_error(interp);
+      Tcl_LimitSetCommands(interp, cnt + cl);
+      Tcl_LimitTypeSet(interp, TCL_LIMIT_COMMANDS);
+    }
+    if (tl>0){
+      Tcl_Time t;
+      Tcl_GetTime(&t);
+      t.sec  += tl/1000;
+      t.usec += (tl%1000)*1000;
+      if (t.usec >= 1000000) {t.sec++; t.usec -= 1000000;}
+      Tcl_LimitSetTime(interp, &t);
+      Tcl_LimitTypeSet(interp, TCL_LIMIT_TIME);
+    }
+    on = true;
+    depth++;
+  }
+
+  ~TclLimitGuard(){
+    depth--;
+    if (!on) return;
+    Tcl_LimitTypeReset(interp, TCL_LIMIT_COMMANDS);
+    Tcl_LimitTypeReset(interp, TCL_LIMIT_TIME);
+  }
+};
+
 /***************************************************/
 
 // Process and optionally modify input, return true if it
@@ -111,11 +166,19 @@ GrapheneTCL::restart(const std::string & tcl_libdir) {
 //
 // * `storage` - global variable which which will be kept
 //   between filter runs
+//
+// Time and command limits are applied to each top-level run
+// (see set_limits()), tmax can make the time limit smaller.
 bool
-GrapheneTCL::run(const std::string & code, std::string & t, std::vector<std::string> & d, std::string & storage){
+GrapheneTCL::run(const std::string & code, std::string & t, std::vector<std::string> & d,
+                 std::string & storage, const int tmax){
 
   if (code=="") return true;
 
+  int tl = time_limit;
+  if (tmax>0 && (tl==0 || tmax<tl)) tl = tmax;
+  TclLimitGuard lg(interp.get(), depth, tl, cmd_limit);
+
   // define global variable time
   if (Tcl_SetVar(interp.get(), "time", t.c_str(), TCL_GLOBAL_ONLY | TCL_LEAVE_ERR_MSG) == NULL)
     throw Err() << "filter: can't set time variable: " << tcl_error(interp.get());
@@ -136,8 +199,11 @@ GrapheneTCL::run(const std::string & code, std::string & t, std::vector<std::str
 
 
   // run TCL script
-  if (Tcl_Eval(interp.get(), code.c_str()) != TCL_OK)
+  if (Tcl_Eval(interp.get(), code.c_str()) != TCL_OK){
+    if (Tcl_LimitExceeded(interp.get()))
+      throw Err() << "filter: " << Tcl_GetStringResult(interp.get());
     throw Err() << "filter: can't run TCL script: " << tcl_error(interp.get());
+  }
 
   // get timestamp back
   auto tc = Tcl_GetVar(interp.get(), "time", TCL_GLOBAL_ONLY | TCL_LEAVE_ERR_MSG);
@@ -26,20 +26,32 @@ class GrapheneTCL {
 
   std::shared_ptr<Tcl_Interp> interp;
 
+  int time_limit; // time limit for a single filter run, ms (0 - no limit)
+  int cmd_limit;  // command limit for a single filter run (0 - no limit)
+  int depth;      // nesting level of run() calls (filters can call graphene_get)
+
   public:
 
   // Restart the interpreter
   void restart(const std::string & tcl_libdir);
 
   // Constructor
-  GrapheneTCL(const std::string & tcl_libdir) {restart(tcl_libdir);}
+  GrapheneTCL(const std::string & tcl_libdir):
+    time_limit(0), cmd_limit(0), depth(0) {restart(tcl_libdir);}
+
+  // Set resource limits for a single filter run:
+  // time in milliseconds, number of TCL commands (0 - no limit).
+  void set_limits(const int time_ms, const int cmds);
 
   // add a command
   void add_cmd(const char *name, GrapheneTCLProc * proc);
 
-  // Run the code, return true if it should be recorded
+  // Run the code, return true if it should be recorded.
+  // tmax (ms) is an additional time limit (e.g. the remaining
+  // part of a query time budget), 0 - no limit.
   bool run(const std::string & code, std::string & t,
-           std::vector<std::string> & d, std::string & storage);
+           std::vector<std::string> & d, std::string & storage,
+           const int tmax = 0);
 
 };
 
@@ -15,12 +15,18 @@
 #include <cerrno>
 #include <csignal>
 #include <setjmp.h>
+#include <getopt.h>
+#include <unistd.h>
 
 #include <map>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <algorithm>
 #include "gr_env.h"
+#include "gr_metrics.h"
+#include "gr_snap.h"
 
 #include "err/err.h"
 #include "read_words/read_words.h"
@@ -63,6 +69,7 @@ class Pars{
   vector<string> pars; /* non-option parameters */
   TimeFMT timefmt;     /* output time format */
   bool readonly;       /* open databases in read-only mode */
+  Opt envopts;         /* additional environment options (long options, see gr_env.h) */
 
   // get options and parameters from argc/argv
   Pars(const int argc, char **argv){
@@ -75,11 +82,43 @@ class Pars{
     readonly  = false;
     if (argc<1) return; // needed for print_help()
     /* parse  options */
-    int c;
-    while((c = getopt(argc, argv, "+d:T:D:E:his:rR"))!=-1){
+    // Long options without short equivalents are
+    // collected in envopts and passed to GrapheneEnv.
+    static const struct option long_opts[] = {
+      {"filter_time", 1, NULL, 0},
+      {"filter_cmds", 1, NULL, 0},
+      {"query_time",  1, NULL, 0},
+      {"list_len",    1, NULL, 0},
+      {"durability",  1, NULL, 0},
+      {"group_time",  1, NULL, 0},
+      {"log_size",    1, NULL, 0},
+      {"maintain_time",  1, NULL, 0},
+      {"checkpoint_kb",  1, NULL, 0},
+      {"checkpoint_min", 1, NULL, 0},
+      {"cache_size",     1, NULL, 0},
+      {"mmap_size",      1, NULL, 0},
+      {"lk_max_locks",   1, NULL, 0},
+      {"lk_max_lockers", 1, NULL, 0},
+      {"lk_max_objects", 1, NULL, 0},
+      {"max_open",       1, NULL, 0},
+      {"trim_chunk",     1, NULL, 0},
+      {"trim_pause",     1, NULL, 0},
+      {"del_chunk",      1, NULL, 0},
+      {"del_time",       1, NULL, 0},
+      {"del_pause",      1, NULL, 0},
+      {"compact_pages",  1, NULL, 0},
+      {"import_threads", 1, NULL, 0},
+      {"container",      1, NULL, 0},
+      {"arch_dir",       1, NULL, 0},
+      {"scan_mode",      1, NULL, 0},
+      {NULL, 0, NULL, 0}
+    };
+    int c, idx;
+    while((c = getopt_long(argc, argv, "+d:T:D:E:his:rR", long_opts, &idx))!=-1){
       switch (c){
         case '?':
         case ':': throw Err(); /* error msg is printed by getopt*/
+        case 0: envopts[long_opts[idx].name] = optarg; break;
         case 'd': dbpath = optarg; break;
         case 'T': tcllib = optarg; break;
         case 'D': dpolicy = optarg; break;
@@ -120,14 +159,20 @@ class Pars{
 
   // print command list (used in both -h message and interactive mode help)
   void print_cmdlist(ostream & out){
-    out <<  "  create <name> <data_fmt> <description>\n"
-            "      -- create a database\n"
+    out <<  "  create <name> <data_fmt>[,<option>...] <description>\n"
+            "      -- create a database; options: recnum, step, scale=<v>, offset=<v>,\n"
+            "         period=<dt>, t0=<t>, block=<n>, cols=<n>, partition=<dt>, retention=<dt>,\n"
+            "         archive=<dt>\n"
             "  delete <name>\n"
             "      -- delete a database\n"
             "  rename <old_name> <new_name>\n"
             "      -- rename a database\n"
             "  set_descr <name> <description>\n"
             "      -- set/change database description\n"
+            "  set_retention <name> <dt>\n"
+            "      -- keep only data newer then <dt> seconds (0 - keep all), see trim command\n"
+            "  set_archive <name> <dt>\n"
+            "      -- archive data older then <dt> seconds (0 - do not archive), see archive_all command\n"
             "  set_filter <name> <N> <tcl code>\n"
             "      -- set/change filter N\n"
             "  print_filter <name> <N>\n"
@@ -139,8 +184,18 @@ class Pars{
             "  info <name>\n"
             "      -- print database information, tab-separated time format,\n"
             "         data format and description (if it is not empty)\n"
+            "  info <name> stats\n"
+            "      -- print database statistics: number of points, first and last\n"
+            "         timestamps, min/max/sum of each column\n"
+            "  info <name> opts\n"
+            "      -- print database options\n"
+            "  rebuild_stats <name>\n"
+            "      -- recalculate database statistics (needed for old databases)\n"
             "  list\n"
             "      -- list all databases in the data folder\n"
+            "  info_all\n"
+            "      -- print information about all databases: name, data format, version,\n"
+            "         number of points, first and last timestamps, description\n"
             "  put <name> <time> <value1> ... <valueN>\n"
             "      -- write a data point\n"
             "  put_flt <name> <time> <value1> ... <valueN>\n"
@@ -152,21 +207,41 @@ class Pars{
             "  get_prev <name>[:N] [<time2>]\n"
             "      -- get previous point before time2\n"
             "  get_range <name>[:N] [<time1>] [<time2>] [<dt>]\n"
-            "      -- get points in the time range\n"
+            "      -- get points in the time range; dt=by_index=<k> gives\n"
+            "         every k-th point (for databases with recnum option)\n"
             "  get_count <name>[:N] [<time1>] [<cnt>]\n"
             "      -- get up to cnt points starting from t1\n"
+            "  count_range <name> [<time1>] [<time2>]\n"
+            "      -- count points in the time range\n"
             "  del <name> <time>\n"
             "      -- delete one data point\n"
             "  del_range <name> <time1> <time2>\n"
-            "      -- delete all points in the time range\n"
+            "      -- delete all points in the time range (see --del_chunk, --del_time options)\n"
             "  close        -- close all opened databases in interactive mode\n"
             "  close <name> -- close one database\n"
             "  sync         -- sync all opened databases\n"
             "  sync <name> -- sync one database\n"
+            "  durability [<mode>] -- print or set durability mode (sync, group, nosync)\n"
+            "  maintain [<period>] -- checkpoint and remove unneeded logs, once or every <period> seconds\n"
+            "  trim [<period>] -- delete expired data (see set_retention), once or every <period> seconds\n"
+            "  archive <name> <t2> -- move points with time <= t2 to a new archive file\n"
+            "  archive_all [<period>] -- archive old data (see set_archive), once or every <period> seconds\n"
+            "  compact <name> -- compact a database, return free space to the file system\n"
+            "  compact_all [<period>] -- compact all databases, once or every <period> seconds\n"
+            "  log_hold    -- do not remove logs during maintenance\n"
+            "  log_release -- allow removing logs during maintenance\n"
             "  load <name> <file> -- create db and load file in a db_dump format\n"
             "  dump <name> <file> -- dump the database into a file (same as db_dump utility)\n"
+            "  dump_bin <name> <file> [zlib] -- binary dump (file - for stdout), optionally compressed\n"
+            "  load_bin <name> <file> -- create db and load binary dump (file - for stdin)\n"
+            "  import <file> ... -- import \"<name> <time> <values>\" lines (file - for stdin)\n"
+            "  export_snapshot <name> <t1> <t2> <file> -- export numeric data to a columnar snapshot file\n"
+            "  snapshot_get <file> [<t1>] [<t2>] -- print points from a snapshot file\n"
+            "  snapshot_info <file> -- print snapshot information (size, time range, min/max values)\n"
             "  list_dbs -- print environment database files for archiving (same as db_archive -s)"
-            "  list_logs -- print environment log files (same as db_archive -l)"
+            "  list_logs -- print environment log files (same as db_archive -l)\n"
+            "  stats -- print environment statistics (cache, locks, transactions, logs)\n"
+            "  metrics -- print runtime metrics: command latency, points read/written (Prometheus format)\n"
             "  cmdlist -- print this list of commands\n"
             "  *idn?   -- print intentifier: Graphene database " << VERSION << "\n"
             "  get_time -- print current time (unix seconds with microsecond precision)\n"
@@ -175,6 +250,8 @@ class Pars{
             "  backup_end <name> [<timestamp>] -- notify that backup is successfully finished\n"
             "  backup_reset <name> -- reset backup timer\n"
             "  backup_print <name> -- print backup timer\n"
+            "  backup <name>|all <dir> -- write incremental backup files to the folder\n"
+            "  restore <name>|all <dir> -- apply incremental backup files from the folder\n"
             "\n"
             "For more information see https://github.com/slazav/graphene/\n"
     ;
@@ -197,6 +274,35 @@ class Pars{
             "  -s <name> -- socket mode: use unix socket <name> for communications\n"
             "  -r        -- output relative times (seconds from requested time) instead of absolute timestamps\n"
             "  -R        -- read-only mode\n"
+            "  --filter_time <ms> -- time limit for a single filter run (default: 0, no limit)\n"
+            "  --filter_cmds <n>  -- limit of TCL commands for a single filter run (default: 0, no limit)\n"
+            "  --query_time <ms>  -- time budget for a single get_* query (default: 0, no limit)\n"
+            "  --list_len <bytes> -- text length read by get_range and get_count (default: 1024, 0 - full)\n"
+            "  --durability <word> -- durability of transactions in txn environment:\n"
+            "               sync, group, nosync (default: sync)\n"
+            "  --group_time <ms>  -- log flush period for the group durability mode (default: 100)\n"
+            "  --log_size <bytes> -- log file size for txn environment (default: 1048576)\n"
+            "  --maintain_time <s> -- period of background checkpoints and log removal\n"
+            "               in txn environment (default: 0, off)\n"
+            "  --checkpoint_kb <n>  -- checkpoint if more then n kbytes of log was written (default: 1024)\n"
+            "  --checkpoint_min <n> -- checkpoint if n minutes passed since the last one (default: 10)\n"
+            "  --trim_chunk <n>   -- max number of points deleted in one transaction by trim (default: 1000)\n"
+            "  --trim_pause <ms>  -- pause between trim transactions (default: 10)\n"
+            "  --del_chunk <n>    -- max number of points deleted in one del_range transaction (default: 0, no limit)\n"
+            "  --del_time <ms>    -- max time of one del_range transaction (default: 0, no limit)\n"
+            "  --del_pause <ms>   -- pause between del_range transactions (default: 0)\n"
+            "  --compact_pages <n> -- max number of pages freed in one compaction step (default: 1000)\n"
+            "  --import_threads <n> -- number of threads for parsing text in import, number of databases\n"
+            "                          processed in parallel by backup and restore in txn env (default: number of CPUs)\n"
+            "  --cache_size <MB>  -- database cache size (default: libdb setting)\n"
+            "  --mmap_size <MB>   -- max size of read-only files mapped to memory (default: libdb setting)\n"
+            "  --lk_max_locks <n>, --lk_max_lockers <n>, --lk_max_objects <n>\n"
+            "               -- sizes of lock tables (default: libdb settings)\n"
+            "  --max_open <n>     -- max number of open databases (default: 0, no limit)\n"
+            "  --container <name> -- keep all databases in one file <name>.db\n"
+            "               (lock or txn environment is needed)\n"
+            "  --arch_dir <dir>   -- folder for archive files (default: database folder)\n"
+            "  --scan_mode <mode> -- get_range scan strategy for dt>0: auto, seek, next (default: auto)\n"
             "Commands:\n"
     ;
     print_cmdlist(cout);
@@ -215,7 +321,7 @@ class Pars{
     // Outer try -- exit on errors with #Error message
     // For SPP2 it should be #Fatal
     try {
-      GrapheneEnv env(dbpath, readonly, env_type, tcllib);
+      GrapheneEnv env(dbpath, readonly, env_type, tcllib, envopts);
       if (setjmp(sig_jmp_buf)) throw 0;
       out << "#OK\n";
       out.flush();
@@ -288,11 +394,30 @@ class Pars{
   // Cmdline mode.
   void run_cmdline(){
     if (pars.size() < 1) throw Err() << "command is expected";
-    GrapheneEnv env(dbpath, readonly, env_type, tcllib);
+    GrapheneEnv env(dbpath, readonly, env_type, tcllib, envopts);
     if (setjmp(sig_jmp_buf)) throw 0;
     run_command(&env, cout);
   }
 
+  // Periodic commands (maintain, trim, compact_all, archive_all):
+  // without the period argument run f(false) once, with it run f(true)
+  // every <period> seconds until a signal is received. The loop never
+  // returns, it is allowed only in the command-line mode.
+  void run_periodic(const string & what, const std::function<void(bool)> & f,
+                    ostream & out){
+    if (pars.size()>2) throw Err() << "too many parameters";
+    if (pars.size()==1) { f(false); return; }
+    int period = str_to_type<int>(pars[1]);
+    if (period<=0) throw Err() << "bad " << what << " period: " << pars[1];
+    if (interactive || sockname!="")
+      throw Err() << pars[0] << " with a period can be used only in command-line mode";
+    while (1) {
+      f(true);
+      out.flush();
+      sleep(period);
+    }
+  }
+
   // Run command, using parameters
   // For read/write commands time is transferred as a string
   // to db.put, db.get_* functions without change.
@@ -300,6 +425,11 @@ class Pars{
   void run_command(GrapheneEnv* env, ostream & out){
     string cmd = pars[0];
 
+    // measure command latency for metrics
+    string cmd_lc(cmd);
+    std::transform(cmd_lc.begin(), cmd_lc.end(), cmd_lc.begin(), ::tolower);
+    MetricsTimer mt(cmd_lc);
+
     // print current time (unix seconds with ms precision)
     if (strcasecmp(cmd.c_str(), "get_time")==0){
       if (pars.size()>1) throw Err() << "too many parameters";
@@ -320,10 +450,11 @@ class Pars{
     // args: create <name> [<data_fmt>] [<description>]
     if (strcasecmp(cmd.c_str(), "create")==0){
       if (pars.size()<2) throw Err() << "database name expected";
-      DataType dtype = pars.size()<3 ? DATA_DOUBLE : graphene_dtype_parse(pars[2]);
+      Opt opts;
+      DataType dtype = pars.size()<3 ? DATA_DOUBLE : graphene_create_fmt_parse(pars[2], opts);
       std::string descr = pars.size()<4 ? "": pars[3];
       for (int i=4; i<pars.size(); i++) descr+=" "+pars[i];
-      env->dbcreate(pars[1], descr, dtype);
+      env->dbcreate(pars[1], descr, dtype, opts);
       return;
     }
 
@@ -355,11 +486,44 @@ class Pars{
       return;
     }
 
+    // set retention time
+    // args: set_retention <name> <dt>
+    if (strcasecmp(cmd.c_str(), "set_retention")==0){
+      if (pars.size()<3) throw Err() << "database name and retention time expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->set_retention(pars[1], pars[2]);
+      return;
+    }
+
+    // set archiving time
+    // args: set_archive <name> <dt>
+    if (strcasecmp(cmd.c_str(), "set_archive")==0){
+      if (pars.size()<3) throw Err() << "database name and archiving time expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->set_archive(pars[1], pars[2]);
+      return;
+    }
+
+    // recalculate database statistics
+    // args: rebuild_stats <name>
+    if (strcasecmp(cmd.c_str(), "rebuild_stats")==0){
+      if (pars.size()<2) throw Err() << "database name expected";
+      if (pars.size()>2) throw Err() << "too many parameters";
+      env->rebuild_stats(pars[1]);
+      return;
+    }
+
     // print database info
-    // args: info <name>
+    // args: info <name> [stats|opts]
     if (strcasecmp(cmd.c_str(), "info")==0){
       if (pars.size()<2) throw Err() << "database name expected";
-      if (pars.size()>2) throw Err() << "too many parameters";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      if (pars.size()==3){
+        if (pars[2]=="stats") env->print_stats(pars[1], out);
+        else if (pars[2]=="opts") env->print_opts(pars[1], out);
+        else throw Err() << "unknown info parameter: " << pars[2];
+        return;
+      }
       auto dtype = env->get_dtype(pars[1]);
       auto descr = env->get_descr(pars[1]);
       cout << graphene_dtype_name(dtype);
@@ -377,6 +541,14 @@ class Pars{
       return;
     }
 
+    // print information about all databases (from the catalog)
+    // args: info_all
+    if (strcasecmp(cmd.c_str(), "info_all")==0){
+      if (pars.size()>1) throw Err() << "too many parameters";
+      env->print_info_all(out);
+      return;
+    }
+
     // backup start: notify that we are going to start backup.
     // - reset temporary backup timer
     // - return value of the main backup timer
@@ -414,6 +586,24 @@ class Pars{
       return;
     }
 
+    // incremental backup of one or all databases
+    // args: backup <name>|all <dir>
+    if (strcasecmp(cmd.c_str(), "backup")==0){
+      if (pars.size()<3) throw Err() << "database name and folder expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->backup(pars[1], pars[2], out);
+      return;
+    }
+
+    // apply incremental backup files
+    // args: restore <name>|all <dir>
+    if (strcasecmp(cmd.c_str(), "restore")==0){
+      if (pars.size()<3) throw Err() << "database name and folder expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->restore(pars[1], pars[2], out);
+      return;
+    }
+
     // write data
     // args: put <name> <time> <value1> ...
     if (strcasecmp(cmd.c_str(), "put")==0){
@@ -490,6 +680,17 @@ class Pars{
       return;
     }
 
+    // count points in the range
+    // args: count_range <name> [<time1>] [<time2>]
+    if (strcasecmp(cmd.c_str(), "count_range")==0){
+      if (pars.size()<2) throw Err() << "database name expected";
+      if (pars.size()>4) throw Err() << "too many parameters";
+      string t1 = pars.size()>2? pars[2]: "0";
+      string t2 = pars.size()>3? pars[3]: "inf";
+      out << env->count_range(pars[1], t1, t2) << "\n";
+      return;
+    }
+
     // delete one data point
     // args: del <name> <time>
     if (strcasecmp(cmd.c_str(), "del")==0){
@@ -504,7 +705,7 @@ class Pars{
     if (strcasecmp(cmd.c_str(), "del_range")==0){
       if (pars.size()<4) throw Err() << "database name and two times expected";
       if (pars.size()>4) throw Err() << "too many parameters";
-      env->del_range(pars[1], pars[2], pars[3]);
+      env->del_range(pars[1], pars[2], pars[3], out);
       return;
     }
 
@@ -526,6 +727,70 @@ class Pars{
       return;
     }
 
+    // print or set durability mode
+    // args: durability [<mode>]
+    if (strcasecmp(cmd.c_str(), "durability")==0){
+      if (pars.size()>2) throw Err() << "too many parameters";
+      if (pars.size()==2) env->set_durability(pars[1]);
+      else out << env->get_durability() << "\n";
+      return;
+    }
+
+    // checkpoint and remove unneeded logs (txn environment)
+    // args: maintain [<period>]
+    if (strcasecmp(cmd.c_str(), "maintain")==0){
+      run_periodic("maintenance", [&](bool p){ env->maintain(!p); }, out);
+      return;
+    }
+
+    // delete expired data
+    // args: trim [<period>]
+    if (strcasecmp(cmd.c_str(), "trim")==0){
+      run_periodic("trim", [&](bool){ env->trim(out); }, out);
+      return;
+    }
+
+    // move old data to an archive
+    // args: archive <name> <t2>
+    if (strcasecmp(cmd.c_str(), "archive")==0){
+      if (pars.size()<3) throw Err() << "database name and time expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->archive(pars[1], pars[2], out);
+      return;
+    }
+
+    // archive old data in all databases
+    // args: archive_all [<period>]
+    if (strcasecmp(cmd.c_str(), "archive_all")==0){
+      run_periodic("archive", [&](bool){ env->archive_all(out); }, out);
+      return;
+    }
+
+    // compact a database
+    // args: compact <name>
+    if (strcasecmp(cmd.c_str(), "compact")==0){
+      if (pars.size()<2) throw Err() << "database name expected";
+      if (pars.size()>2) throw Err() << "too many parameters";
+      env->compact(pars[1], out);
+      return;
+    }
+
+    // compact all databases
+    // args: compact_all [<period>]
+    if (strcasecmp(cmd.c_str(), "compact_all")==0){
+      run_periodic("compaction", [&](bool){ env->compact_all(out); }, out);
+      return;
+    }
+
+    // create/remove log hold file
+    // args: log_hold, log_release
+    if (strcasecmp(cmd.c_str(), "log_hold")==0 ||
+        strcasecmp(cmd.c_str(), "log_release")==0){
+      if (pars.size()>1) throw Err() << "too many parameters";
+      env->log_hold(strcasecmp(cmd.c_str(), "log_hold")==0);
+      return;
+    }
+
     // create db and load file in db_dump format
     // (we can not use db_load because of user-defined comparison function)
     // args: load <name> <file>
@@ -549,6 +814,58 @@ class Pars{
       return;
     }
 
+    // binary dump
+    // args: dump_bin <name> <file> [zlib]
+    if (strcasecmp(cmd.c_str(), "dump_bin")==0){
+      if (pars.size()<3) throw Err() << "database name and dump file expected";
+      if (pars.size()>4) throw Err() << "too many parameters";
+      if (pars.size()==4 && pars[3]!="zlib") throw Err() << "unknown compression: " << pars[3];
+      env->dump_bin(pars[1], pars[2], pars.size()==4);
+      return;
+    }
+
+    // create db and load binary dump
+    // args: load_bin <name> <file>
+    if (strcasecmp(cmd.c_str(), "load_bin")==0){
+      if (pars.size()<3) throw Err() << "database name and dump file expected";
+      if (pars.size()>3) throw Err() << "too many parameters";
+      env->load_bin(pars[1], pars[2]);
+      return;
+    }
+
+    // import text data
+    // args: import <file> ...
+    if (strcasecmp(cmd.c_str(), "import")==0){
+      if (pars.size()<2) throw Err() << "file name expected";
+      env->import(std::vector<std::string>(pars.begin()+1, pars.end()), out);
+      return;
+    }
+
+    // export columnar snapshot
+    // args: export_snapshot <name> <t1> <t2> <file>
+    if (strcasecmp(cmd.c_str(), "export_snapshot")==0){
+      if (pars.size()!=5) throw Err() << "database name, time range, snapshot file expected";
+      env->export_snapshot(pars[1], pars[2], pars[3], pars[4]);
+      return;
+    }
+
+    // read snapshot file
+    // args: snapshot_get <file> [<t1>] [<t2>]
+    if (strcasecmp(cmd.c_str(), "snapshot_get")==0){
+      if (pars.size()<2) throw Err() << "snapshot file expected";
+      if (pars.size()>4) throw Err() << "too many parameters";
+      GrapheneSnap s(pars[1]);
+      s.print(out, pars.size()>2? pars[2]:"0", pars.size()>3? pars[3]:"inf");
+      return;
+    }
+
+    // args: snapshot_info <file>
+    if (strcasecmp(cmd.c_str(), "snapshot_info")==0){
+      if (pars.size()!=2) throw Err() << "snapshot file expected";
+      GrapheneSnap(pars[1]).print_info(out);
+      return;
+    }
+
     // set filter
     // args: set_filter <name> <N> <tcl script>
     if (strcasecmp(cmd.c_str(), "set_filter")==0){
@@ -603,6 +920,14 @@ class Pars{
       return;
     }
 
+    // print environment statistics
+    // args: stats
+    if (strcasecmp(cmd.c_str(), "stats")==0){
+      if (pars.size()>1) throw Err() << "too many parameters";
+      env->stats(out);
+      return;
+    }
+
     // print list of commands
     // args: cmdlist
     if (strcasecmp(cmd.c_str(), "cmdlist")==0){
@@ -619,7 +944,16 @@ class Pars{
       return;
     }
 
+    // print runtime metrics (Prometheus text format)
+    // args: metrics
+    if (strcasecmp(cmd.c_str(), "metrics")==0){
+      if (pars.size()>1) throw Err() << "too many parameters";
+      metrics_print(out);
+      return;
+    }
+
     // unknown command
+    mt.cancel();
     throw Err() << "Unknown command: " << cmd;
   }
 
@@ -16,6 +16,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <sys/wait.h> // wait
 #include <cstdlib>
 #include <stdint.h>
@@ -30,6 +31,7 @@
 #include "log/log.h"
 #include "getopt/getopt.h"
 #include "gr_env.h"
+#include "gr_metrics.h"
 
 #if MHD_VERSION < 0x00097002
 #define MHD_Result int
@@ -71,6 +73,7 @@ request_answer(void * cls, struct MHD_Connection * connection, const char * url,
   static string in_data; // data recieved in POST requests
   int code = MHD_HTTP_OK;
   GrapheneEnv *env = (GrapheneEnv *) cls; /* server parameters */
+  int query_time = env->get_query_time(); /* server query time budget */
 
   Log(2) << "> " << method << " " << url << "\n";
 
@@ -99,7 +102,12 @@ request_answer(void * cls, struct MHD_Connection * connection, const char * url,
       }
       else{ // Process the query by graphene_json() and answer
         string out_data;
-        out_data = graphene_json(env, url, in_data);
+        {
+          MetricsTimer mt(url);
+          if (strcmp(url,"/query")!=0 && strcmp(url,"/search")!=0 &&
+              strcmp(url,"/annotations")!=0) mt.cancel();
+          out_data = graphene_json(env, url, in_data);
+        }
 
         Log(3) << ">>> " << in_data << "\n";
         Log(4) << "<<< " << out_data << "\n";
@@ -122,6 +130,20 @@ request_answer(void * cls, struct MHD_Connection * connection, const char * url,
       auto tfmt = graphene_tfmt_parse(mhs_get_par(connection, "tfmt", "def"));
       std::ostringstream out;
 
+      // query time budget for this request, it can only reduce
+      // the server setting
+      auto qt = mhs_get_par(connection, "query_time", "");
+      if (qt!=""){
+        int t = str_to_type<int>(qt);
+        if (t<=0) throw Err() << "bad query time limit: " << qt;
+        if (query_time==0 || t<query_time) env->set_query_time(t);
+      }
+
+      // commands are case-insensitive, use lowercase names as metric labels
+      string cmd_lc(cmd);
+      std::transform(cmd_lc.begin(), cmd_lc.end(), cmd_lc.begin(), ::tolower);
+      MetricsTimer mt(cmd_lc);
+
       if (strcasecmp(cmd.c_str(),"get")==0)
          env->get(n, t2, tfmt, out_cb_simple, &out);
       else if (strcasecmp(cmd.c_str(),"get_next")==0)
@@ -132,9 +154,29 @@ request_answer(void * cls, struct MHD_Connection * connection, const char * url,
          env->get_range(n, t1,t2,dt, tfmt, out_cb_simple, &out);
       else if (strcasecmp(cmd.c_str(),"get_count")==0)
          env->get_count(n, t1,cnt, tfmt, out_cb_simple, &out);
+      else if (strcasecmp(cmd.c_str(),"count_range")==0)
+         out << env->count_range(n, t1,t2) << "\n";
+      else if (strcasecmp(cmd.c_str(), "info")==0){
+         if (mhs_get_par(connection, "stats", "") != "") env->print_stats(n, out);
+         else {
+           auto descr = env->get_descr(n);
+           out << graphene_dtype_name(env->get_dtype(n));
+           if (descr!="") out << '\t' << descr;
+           out << "\n";
+         }
+      }
       else if (strcasecmp(cmd.c_str(), "list")==0)
          for (auto const & n: env->dblist()) out << n << "\n";
-      else throw Err() << "bad command: " << cmd.c_str();
+      else if (strcasecmp(cmd.c_str(), "info_all")==0)
+         env->print_info_all(out);
+      else if (strcasecmp(cmd.c_str(), "stats")==0)
+         env->stats(out);
+      else if (strcasecmp(cmd.c_str(), "metrics")==0)
+         metrics_print(out);
+      else {
+        mt.cancel();
+        throw Err() << "bad command: " << cmd.c_str();
+      }
 
       string out_data = out.str();
       response = MHD_create_response_from_buffer(
@@ -153,6 +195,7 @@ request_answer(void * cls, struct MHD_Connection * connection, const char * url,
     // close all databases. In case of an error which needs recovery/reopening.
     env->close();
   }
+  env->set_query_time(query_time);
 
   // this allowes external grafana server make requests
   MHD_add_response_header (response, "Access-Control-Allow-Origin",  "*");
@@ -182,6 +225,23 @@ int main(int argc, char ** argv) {
     options.add("env_type", 1,'E', "GR", "environment type: none, lock, txn "
        "(default: lock)");
     options.add("port",    1,'p', "GR", "TCP port for connections (default: 8081).");
+    options.add("filter_time", 1,0, "GR", "Time limit for a single filter run, ms (default: 0, no limit).");
+    options.add("filter_cmds", 1,0, "GR", "Limit of TCL commands for a single filter run (default: 0, no limit).");
+    options.add("query_time",  1,0, "GR", "Time budget for a single query, ms. "
+      "Queries which exceed it are aborted with an error (default: 0, no limit).");
+    options.add("list_len",   1,0, "GR", "Text length read for annotations and get_range/get_count "
+      "commands, bytes (default: 1024, 0 - full values).");
+    options.add("cache_size", 1,0, "GR", "Database cache size, MB (default: libdb setting).");
+    options.add("mmap_size",  1,0, "GR", "Max size of read-only database files mapped to memory, MB (default: libdb setting).");
+    options.add("lk_max_locks",   1,0, "GR", "Max number of locks (default: libdb setting).");
+    options.add("lk_max_lockers", 1,0, "GR", "Max number of lockers (default: libdb setting).");
+    options.add("lk_max_objects", 1,0, "GR", "Max number of locked objects (default: libdb setting).");
+    options.add("max_open",   1,0, "GR", "Max number of open databases, least recently used "
+      "ones are closed (default: 0, no limit).");
+    options.add("container",  1,0, "GR", "Keep all databases as subdatabases in one <container>.db file.");
+    options.add("arch_dir",   1,0, "GR", "Folder for archive files (default: database folder).");
+    options.add("scan_mode",  1,0, "GR", "Scan strategy of get_range with a time step: "
+      "auto, seek, next (default: auto).");
     options.add("dofork",  0,'f', "GR", "Do fork and run as a daemon.");
     options.add("stop",    0,'S', "GR", "Stop running daemon (found by pid-file).");
     options.add("verbose", 1,'v', "GR", "Verbosity level: 0 - write nothing; "
@@ -305,7 +365,10 @@ int main(int argc, char ** argv) {
       mypid = true;
     }
 
-    GrapheneEnv env(dbpath, true, env_type, tcllib);
+    GrapheneEnv env(dbpath, true, env_type, tcllib,
+      opts.clone_known({"filter_time", "filter_cmds", "query_time", "list_len", "cache_size",
+                        "mmap_size", "lk_max_locks", "lk_max_lockers", "lk_max_objects",
+                        "max_open", "container", "arch_dir", "scan_mode"}));
 
     // start server
     d = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY,
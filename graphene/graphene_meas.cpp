@@ -18,6 +18,7 @@
 #define NVAL 100000
 #define NVAL_FLT 100000
 #define TFMT TFMT_DEF
+#define DBNAME_SCAN "time_test_scan"
 
 class TimeCounter{
   struct timeval tv;
@@ -37,6 +38,42 @@ class TimeCounter{
   }
 };
 
+// Fill a database for get_range scan benchmark.
+// Data is written in blocks of n points with time step dt.
+void
+put_blocks(GrapheneEnv & env, const std::string & name,
+           const int nblocks, const int n1, const double dt1,
+           const int n2, const double dt2){
+  std::vector<std::string> dat(1, "1");
+  double t = 0;
+  for (int b = 0; b<nblocks; b++){
+    for (int i = 0; i<n1+n2; i++){
+      std::ostringstream st;
+      st.precision(15);
+      st << t;
+      env.put(name, st.str(), dat, DPOLICY);
+      t += i<n1 ? dt1:dt2;
+    }
+  }
+}
+
+// Run get_range with dt>0 using all scan strategies
+// (a separate environment with scan_mode option for each one).
+void
+meas_scan(const std::string & name,
+          const std::string & dt, const std::string & descr){
+  const char * modes[] = {"auto", "seek", "next"};
+  for (int m = SCAN_AUTO; m<=SCAN_NEXT; m++){
+    Opt o;
+    o.put("scan_mode", modes[m]);
+    GrapheneEnv env(DBPATH, true, ENV_TYPE, TCL_LIB, o);
+    std::ostringstream out;
+    TimeCounter tc;
+    env.get_range(name, "0", "inf", dt, TFMT, out_cb_simple, &out);
+    std::cerr << "get_range, " << descr << ", dt=" << dt << ", "
+              << modes[m] << ": " << tc.meas() << "\n";
+  }
+}
 
 int
 main(){
@@ -77,7 +114,22 @@ main(){
     env.get_range(DBNAME, "0", "inf", "0", TFMT, NULL, NULL);
     std::cerr << "Get " << NVAL << " values using get_range(): " << tc.meas() << "\n";
 
-    env.del_range(DBNAME, "0", "inf");
+    env.del_range(DBNAME, "0", "inf", std::cerr);
+
+    // get_range scan strategies: dense, sparse and bursty data
+    env.dbcreate(DBNAME_SCAN, "Test database", DATA_DOUBLE);
+    put_blocks(env, DBNAME_SCAN, 1, NVAL, 0.001, 0, 0);
+    meas_scan(DBNAME_SCAN, "1", "dense data (1kHz)");
+    meas_scan(DBNAME_SCAN, "0.002", "dense data (1kHz)");
+    env.del_range(DBNAME_SCAN, "0", "inf", std::cerr);
+
+    put_blocks(env, DBNAME_SCAN, 1, NVAL, 1, 0, 0);
+    meas_scan(DBNAME_SCAN, "0.5", "sparse data (1Hz)");
+    env.del_range(DBNAME_SCAN, "0", "inf", std::cerr);
+
+    put_blocks(env, DBNAME_SCAN, 10, NVAL/20, 1, NVAL/20, 0.001);
+    meas_scan(DBNAME_SCAN, "0.5", "bursty data (1Hz/1kHz)");
+    env.dbremove(DBNAME_SCAN);
 
     // input filter
     env.set_filter(DBNAME, 0, "set data [expr $data**2]");
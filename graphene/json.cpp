@@ -231,11 +231,16 @@ Json json_annotations(GrapheneEnv * env, const Json & ji){
 
 /***************************************************************************/
 // process /search
+// Grafana sends text typed by the user in the target field,
+// return database names which contain it.
 Json json_search(GrapheneEnv * env, const Json & ji){
   Json out = Json::array();
+  std::string target;
+  if (ji.exists("target") && ji["target"].is_string())
+    target = ji["target"].as_string();
   auto names = env->dblist();
   for (auto const & n:names)
-    out.append(Json(n));
+    if (n.find(target)!=std::string::npos) out.append(Json(n));
   return out;
 }
 
@@ -69,6 +69,21 @@ assert_cmd "./graphene -d . info test_4" "UINT32	Uint 32 database"
 assert_cmd "./graphene -d . list a" "Error: too many parameters" 1
 assert_cmd "./graphene -d . list | sort" "$(printf "test_1\ntest_2\ntest_3\ntest_4")"
 
+# info_all
+assert_cmd "./graphene -d . info_all a" "Error: too many parameters" 1
+assert_cmd "./graphene -d . info_all" "$(printf "test_1\tDOUBLE\t2\t0\t-\t-
+test_2\tUINT16\t2\t0\t-\t-
+test_3\tUINT32\t2\t0\t-\t-\tUint 32 database
+test_4\tUINT32\t2\t0\t-\t-\tUint 32 database")"
+assert_cmd "grep -c '^test_' graphene.catalog" "4"
+# catalog is not saved in read-only mode
+rm -f graphene.catalog
+assert_cmd "./graphene -R -d . info_all | wc -l" "4"
+assert_cmd "ls graphene.catalog* 2>/dev/null | wc -l" "0"
+assert_cmd "./graphene -d . set_descr test_1 new descr" ""
+assert_cmd "./graphene -d . info_all | head -1" "$(printf "test_1\tDOUBLE\t2\t0\t-\t-\tnew descr")"
+assert_cmd "./graphene -d . set_descr test_1 ''" ""
+
 # list_dbs
 assert_cmd "./graphene -d . list_dbs a" "Error: too many parameters" 1
 assert_cmd "./graphene -E lock -d . list_dbs" "Error: list_dbs can not by run in this environment type: lock" 1
@@ -126,6 +141,73 @@ assert_cmd "./graphene -E txn -d . delete test_2" ""
 assert_cmd "./graphene -E txn -d . delete test_3" ""
 assert_cmd "./graphene -E txn -d . delete test_4" ""
 
+# durability modes
+assert_cmd "./graphene -E txn -d . durability" "sync"
+assert_cmd "./graphene -E txn -d . durability abc" "Error: unknown durability mode: abc" 1
+assert_cmd "./graphene -d . durability group" \
+  "Error: durability mode group can be used only in txn environment" 1
+assert_cmd "./graphene -E txn -d . --durability group durability" "group"
+assert_cmd "./graphene -E txn -d . --group_time 0 durability" "Error: bad group_time setting: 0" 1
+
+assert_cmd "./graphene -E txn -d . --durability group create test_1" ""
+assert_cmd "printf 'put test_1 1 1\ndurability nosync\nput test_1 2 2\ndurability sync\nput test_1 3 3\n' |\
+   ./graphene -E txn -d . --durability group -i | grep -v '^#'" "Graphene database. Type cmdlist to see list of commands"
+assert_cmd "./graphene -E txn -d . get_range test_1" "$(printf "1 1\n2 2\n3 3")"
+
+# checkpoints and log removal
+assert_cmd "./graphene -d . maintain" "Error: maintenance can be used only in txn environment" 1
+assert_cmd "./graphene -d . --maintain_time 100 list" \
+  "Error: maintenance can be used only in txn environment" 1
+assert_cmd "./graphene -E txn -d . maintain 0" "Error: bad maintenance period: 0" 1
+assert_cmd "printf 'maintain 1\n' | ./graphene -E txn -d . -i | grep '^#Error'" \
+  "#Error: maintain with a period can be used only in command-line mode"
+assert_cmd "./graphene -E txn -d . --log_size 0 list" "Error: bad log_size setting: 0" 1
+
+# small log files: write a few of them
+assert_cmd "for i in \$(seq 1000); do echo put test_1 \$i 1234567890 1234567890; done |\
+   ./graphene -E txn -d . --log_size 32768 -i | grep -v '^#'" "Graphene database. Type cmdlist to see list of commands"
+nlogs="$(ls log.* | wc -l)"
+[ "$nlogs" -gt 2 ] || { echo "expected more then two log files"; exit 1; }
+
+# logs are kept while hold file exists
+assert_cmd "./graphene -E txn -d . log_hold" ""
+assert_cmd "./graphene -E txn -d . maintain" ""
+assert_cmd "ls log.* | wc -l" "$nlogs"
+assert_cmd "./graphene -E txn -d . log_release" ""
+assert_cmd "./graphene -E txn -d . maintain" ""
+[ "$(ls log.* | wc -l)" -lt "$nlogs" ] || { echo "logs were not removed"; exit 1; }
+assert_cmd "./graphene -E txn -d . get_range test_1 | wc -l" "1000"
+
+# environment statistics
+assert_cmd "./graphene -E txn -d . stats | grep -c '^cache_'" "11"
+assert_cmd "./graphene -E txn -d . stats | grep -c '^lock_'" "14"
+assert_cmd "./graphene -E txn -d . stats | grep -c '^txn_'" "8"
+assert_cmd "./graphene -E txn -d . stats | grep -c '^log_'" "7"
+# log size is set on every start, default is used without the option
+assert_cmd "./graphene -E txn -d . --log_size 32768 stats | grep '^log_file_size '" "log_file_size 32768"
+assert_cmd "./graphene -E txn -d . stats | grep '^log_file_size '" "log_file_size 1048576"
+assert_cmd "./graphene -E none -d . stats" "Error: Command can not be run without DB environment" 1
+assert_cmd "./graphene -d . --cache_size -1 stats" "Error: bad cache_size setting: -1" 1
+
+# runtime metrics
+assert_cmd "printf 'get_range test_1 1 3\nput test_1 1001 1\nmetrics\n' |\
+   ./graphene -E txn -d . -i | grep '^graphene_points_\|_count{cmd=\"put'" \
+'graphene_command_seconds_count{cmd="put"} 1
+graphene_points_read_total{db="test_1"} 3
+graphene_points_written_total{db="test_1"} 1'
+
+# handle cache: only one database is kept open
+assert_cmd "./graphene -d . --max_open -1 list" "Error: bad max_open setting: -1" 1
+assert_cmd "./graphene -E txn -d . create test_2" ""
+assert_cmd "printf 'get_next test_1\nget_next test_2\nget_next test_1\nget_next test_1\nmetrics\n' |\
+   ./graphene -E txn -d . --max_open 1 -i | grep '^graphene_pool_'" \
+'graphene_pool_hits_total 1
+graphene_pool_misses_total 3
+graphene_pool_evictions_total 2'
+assert_cmd "./graphene -E txn -d . delete test_2" ""
+
+assert_cmd "./graphene -E txn -d . delete test_1" ""
+
 rm -f -- __db.* log.*
 ###########################################################################
 # DOUBLE database
@@ -185,6 +267,22 @@ assert_cmd "./graphene -r -d . get_range test_1 1234567890 2234567890.123 2" "0.
 
 assert_cmd "./graphene -d . get_range test_1 1234567890 2234567890.123 1200000000" "1234567890.000000000 0.1"
 
+# dense and sparse data: get_range switches between DB_NEXT and DB_SET_RANGE
+assert_cmd "./graphene -d . create test_s" ""
+assert_cmd "(for i in \$(seq 0 99); do echo put test_s 10.\$(printf %02d \$i) 1; done;
+  for i in \$(seq 11 40); do echo put test_s \$i 2; done) | ./graphene -d . -i | grep -v '^#'"\
+   "Graphene database. Type cmdlist to see list of commands"
+assert_cmd "./graphene -d . get_range test_s 0 inf 0.25 | head -6" "10.000000000 1
+10.250000000 1
+10.500000000 1
+10.750000000 1
+11.000000000 2
+12.000000000 2"
+assert_cmd "./graphene -d . get_range test_s 0 inf 0.25 | wc -l" "34"
+assert_cmd "./graphene -d . get_range test_s 0 inf 5 | tr '\n' ' '" \
+   "10.000000000 1 15.000000000 2 20.000000000 2 25.000000000 2 30.000000000 2 35.000000000 2 40.000000000 2 "
+assert_cmd "./graphene -d . delete test_s" ""
+
 # -inf +inf nan values:
 assert_cmd "./graphene -d . put test_1 1 -inf -Inf nan NaN nAn +inf +Inf" ""
 assert_cmd "./graphene -d . get test_1 1" "1.000000000 -inf -inf nan nan nan inf inf"
@@ -193,6 +291,19 @@ assert_cmd "./graphene -d . get test_1 1" "1.000000000 -inf -inf nan nan nan inf
 assert_cmd "./graphene -d . put test_1 3 10 10 10 10 10 10 10" ""
 assert_cmd "./graphene -d . get test_1 2" "2.000000000 -inf -inf nan nan nan inf inf"
 
+# statistics with inf/nan values is stored and read back
+assert_cmd "./graphene -d . create test_s DOUBLE" ""
+assert_cmd "./graphene -d . put test_s 1 -inf nan" ""
+assert_cmd "./graphene -d . put test_s 2 1 2" ""
+assert_cmd "./graphene -d . info test_s stats" "count 2
+first 1.000000000
+last 2.000000000
+min -inf nan
+max 1 nan
+sum -inf nan
+minmax_exact 1"
+assert_cmd "./graphene -d . delete test_s" ""
+
 
 ###########################################################################
 # get_count
@@ -250,6 +361,11 @@ assert_cmd "./graphene -d . get_range test_2:0" "1000.000000000 1
 
 assert_cmd "./graphene -d . get_range test_2:3" "1000.000000000 NaN
 2000.000000000 NaN"
+# only the needed column is read, short records give NaN
+assert_cmd "./graphene -d . get_range test_2:2" "1000.000000000 30
+2000.000000000 NaN"
+assert_cmd "./graphene -d . get_count test_2:1 0 5" "1000.000000000 10
+2000.000000000 20"
 assert_cmd "./graphene -d . delete test_2" ""
 
 ###########################################################################
@@ -316,8 +432,450 @@ assert_cmd "./graphene -d . get_range test_3" "10.000000000 1
 14.000000000 5
 15.000000000 6"
 
+# statistics is updated by put/del/del_range
+assert_cmd "./graphene -d . info test_3 stats" "count 3
+first 10.000000000
+last 15.000000000
+min 1
+max 6
+sum 12
+minmax_exact 1"
+assert_cmd "./graphene -d . info test_3 abc" "Error: unknown info parameter: abc" 1
+
+# replacing the max value: min/max becomes inexact
+assert_cmd "./graphene -d . put test_3 15 3" ""
+assert_cmd "./graphene -d . del test_3 10" ""
+assert_cmd "./graphene -d . info test_3 stats" "count 2
+first 14.000000000
+last 15.000000000
+min 1
+max 6
+sum 8
+minmax_exact 0"
+
+assert_cmd "./graphene -d . rebuild_stats test_3" ""
+assert_cmd "./graphene -d . info test_3 stats" "count 2
+first 14.000000000
+last 15.000000000
+min 3
+max 5
+sum 8
+minmax_exact 1"
+
+assert_cmd "./graphene -d . del_range test_3 0 inf" ""
+assert_cmd "./graphene -d . info test_3 stats" "count 0"
+
 assert_cmd "./graphene -d . delete test_3" ""
 
+###########################################################################
+# record-number databases: count_range, sampling by index
+
+assert_cmd "./graphene -d . create test_r DOUBLE,abc" "Error: unknown option: abc" 1
+assert_cmd "./graphene -d . create test_r DOUBLE,recnum" ""
+assert_cmd "./graphene -d . create test_3 UINT32" ""
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  ./graphene -d . put test_r $i $i
+  ./graphene -d . put test_3 $i $i
+done
+
+for db in test_r test_3; do
+  assert_cmd "./graphene -d . count_range $db" "10"
+  assert_cmd "./graphene -d . count_range $db 3 7" "5"
+  assert_cmd "./graphene -d . count_range $db 3.5 7.5" "4"
+  assert_cmd "./graphene -d . count_range $db 7 3" "0"
+  assert_cmd "./graphene -d . count_range $db 11 12" "0"
+done
+
+assert_cmd "./graphene -d . get_range test_r 1 10 by_index=3" "1.000000000 1
+4.000000000 4
+7.000000000 7
+10.000000000 10"
+assert_cmd "./graphene -d . get_range test_r 2.5 8 by_index=2" "3.000000000 3
+5.000000000 5
+7.000000000 7"
+assert_cmd "./graphene -d . get_range test_r 1 10 by_index=-1" "Error: bad index step: -1" 1
+assert_cmd "./graphene -d . get_range test_r 1 10 by_index=0" "Error: bad index step: 0" 1
+assert_cmd "./graphene -d . get_range test_3 1 10 by_index=3" \
+  "Error: test_3.db: sampling by index needs a database created with recnum option" 1
+
+assert_cmd "./graphene -d . delete test_r" ""
+assert_cmd "./graphene -d . delete test_3" ""
+
+###########################################################################
+# quantized databases
+assert_cmd "./graphene -d . create test_q DOUBLE,scale=0.1" \
+  "Error: scale and offset options can be used only with quantized data types" 1
+assert_cmd "./graphene -d . create test_q Q16,scale=0" "Error: bad scale: 0" 1
+assert_cmd "./graphene -d . create test_q Q16,scale=0.01,offset=300" ""
+assert_cmd "./graphene -d . info test_q" "Q16"
+assert_cmd "./graphene -d . info test_q opts" "offset 300
+scale 0.01"
+assert_cmd "./graphene -d . put test_q 1 300.014 1.5" ""
+assert_cmd "./graphene -d . put test_q 2 301 nan" ""
+assert_cmd "./graphene -d . put test_q 3 1000" "Error: Q16 value out of range: 1000" 1
+assert_cmd "./graphene -d . get_range test_q" "1.000000000 300.01 1.5
+2.000000000 301 nan"
+assert_cmd "./graphene -d . get test_q 1.5" "1.500000000 300.51 nan" # codes 1 and 100
+assert_cmd "./graphene -d . get_next test_q:1" "1.000000000 1.5"
+assert_cmd "./graphene -d . info test_q stats | grep max" "max 301 1.5"
+assert_cmd "./graphene -d . delete test_q" ""
+
+###########################################################################
+# step databases: runs of equal values are folded
+
+assert_cmd "./graphene -d . create test_st DOUBLE,step" ""
+assert_cmd "./graphene -d . info test_st opts" "step 1"
+for i in 1 2 3 4 5 6 7; do
+  v=$(( i<4 ? 1 : (i<7 ? 2 : 1) ))
+  ./graphene -d . put test_st $i $v
+done
+assert_cmd "./graphene -d . get_range test_st" "1.000000000 1
+3.000000000 1
+4.000000000 2
+6.000000000 2
+7.000000000 1"
+assert_cmd "./graphene -d . get test_st 2"   "2.000000000 1"
+assert_cmd "./graphene -d . get test_st 3.5" "3.500000000 1.5"
+# get_prev inside a run: the value is reconstructed at the requested time
+assert_cmd "./graphene -d . get_prev test_st 5" "5.000000000 2"
+assert_cmd "./graphene -d . get_prev test_st 5.5" "5.500000000 2"
+assert_cmd "./graphene -d . get_prev test_st 6" "6.000000000 2"
+assert_cmd "./graphene -d . get_prev test_st 6.5" "6.000000000 2"
+assert_cmd "./graphene -d . info test_st stats" "count 5
+first 1.000000000
+last 7.000000000
+min 1
+max 2
+sum 7
+minmax_exact 1"
+# existing timestamps are not folded
+assert_cmd "./graphene -d . put test_st 6 2" ""
+assert_cmd "./graphene -d . count_range test_st" "5"
+assert_cmd "./graphene -d . delete test_st" ""
+
+###########################################################################
+# fixed-rate databases
+
+assert_cmd "./graphene -d . create test_f TEXT,period=1" \
+  "Error: fixed-rate databases can not have TEXT data type" 1
+assert_cmd "./graphene -d . create test_f DOUBLE,block=4" \
+  "Error: t0, block and cols options can be used only with period option" 1
+assert_cmd "./graphene -d . create test_f DOUBLE,period=0" "Error: bad period: 0" 1
+assert_cmd "./graphene -d . create test_f DOUBLE,period=0.5,block=4,cols=2" ""
+assert_cmd "./graphene -d . info test_f opts" "block 4
+cols 2
+period 0.5"
+assert_cmd "./graphene -d . put test_f 1 1 10" ""
+assert_cmd "./graphene -d . put test_f 0.4 0 0" "" # rounded to 0.5
+assert_cmd "./graphene -d . put test_f 3 3 30" "" # next block
+assert_cmd "./graphene -d . put test_f 2 1" \
+  "Error: test_f.db: 2 value(s) expected in the fixed-rate database" 1
+assert_cmd "./graphene -d . -D error put test_f 3 3 31" "Error: test_f.db: Timestamp exists" 1
+assert_cmd "./graphene -d . get_range test_f" "0.500000000 0 0
+1.000000000 1 10
+3.000000000 3 30"
+assert_cmd "./graphene -d . get_range test_f 0 10 1" "0.500000000 0 0
+3.000000000 3 30"
+assert_cmd "./graphene -d . get_count test_f 0 2" "0.500000000 0 0
+1.000000000 1 10"
+assert_cmd "./graphene -d . get_next test_f 1.2" "3.000000000 3 30"
+assert_cmd "./graphene -d . get_prev test_f 2.9" "1.000000000 1 10"
+assert_cmd "./graphene -d . get test_f 2" "2.000000000 2 20"
+assert_cmd "./graphene -d . count_range test_f" "3"
+assert_cmd "./graphene -d . del test_f 1" ""
+assert_cmd "./graphene -d . del test_f 1" "Error: test_f.db: No such record: 1.000000000" 1
+assert_cmd "./graphene -d . info test_f stats" "count 2
+first 0.500000000
+last 3.000000000
+min 0 0
+max 3 30
+sum 3 30
+minmax_exact 1"
+assert_cmd "./graphene -d . del_range test_f 0 1" ""
+assert_cmd "./graphene -d . get_range test_f" "3.000000000 3 30"
+assert_cmd "./graphene -d . delete test_f" ""
+
+###########################################################################
+# partitioned databases
+
+assert_cmd "./graphene -d . create test_p DOUBLE,partition=0" "Error: bad partition: 0" 1
+assert_cmd "./graphene -d . create test_p DOUBLE,partition=100" ""
+assert_cmd "./graphene -d . info test_p opts" "partition 100"
+assert_cmd "./graphene -d . put test_p 10 1" ""
+assert_cmd "./graphene -d . put test_p 150 2" ""
+assert_cmd "./graphene -d . put test_p 160 3" ""
+assert_cmd "./graphene -d . put test_p 350 4" ""
+assert_cmd "ls test_p%p*.db" "test_p%p0.db
+test_p%p1.db
+test_p%p3.db"
+assert_cmd "./graphene -d . list | grep test_p" "test_p"
+assert_cmd "./graphene -d . create test_p%p2" \
+  "Error: symbols '.:+|% \\n\\t/' are not allowed in the database name: test_p%p2" 1
+assert_cmd "./graphene -d . get_range test_p" "10.000000000 1
+150.000000000 2
+160.000000000 3
+350.000000000 4"
+# only one partition is kept open
+assert_cmd "printf 'get_range test_p\nget_next test_p 0\n' | ./graphene -d . --max_open 2 -i | grep -v '^#'" "Graphene database. Type cmdlist to see list of commands
+10.000000000 1
+150.000000000 2
+160.000000000 3
+350.000000000 4
+10.000000000 1"
+assert_cmd "./graphene -d . get_range test_p 0 1000 100" "10.000000000 1
+150.000000000 2
+350.000000000 4"
+assert_cmd "./graphene -d . get_count test_p 100 2" "150.000000000 2
+160.000000000 3"
+assert_cmd "./graphene -d . get_next test_p 200" "350.000000000 4"
+assert_cmd "./graphene -d . get_prev test_p 300" "160.000000000 3"
+assert_cmd "./graphene -d . get test_p 255" "255.000000000 3.5"
+assert_cmd "./graphene -d . count_range test_p 0 200" "3"
+assert_cmd "./graphene -d . info test_p stats" "count 4
+first 10.000000000
+last 350.000000000
+min 1
+max 4
+sum 10
+minmax_exact 1"
+assert_cmd "./graphene -d . dump test_p test_p.txt" \
+  "Error: test_p.db: dump is not supported for partitioned databases, dump partitions instead" 1
+assert_cmd "./graphene -d . del_range test_p 100 200" "" # partition 1 removed
+assert_cmd "ls test_p%p*.db" "test_p%p0.db
+test_p%p3.db"
+assert_cmd "./graphene -d . del test_p 200" "Error: test_p.db: No such record: 200.000000000" 1
+assert_cmd "./graphene -d . del test_p 10" ""
+assert_cmd "./graphene -d . get_range test_p" "350.000000000 4"
+assert_cmd "./graphene -d . rename test_p test_pp" ""
+assert_cmd "./graphene -d . get_range test_pp" "350.000000000 4"
+assert_cmd "./graphene -d . delete test_pp" ""
+assert_cmd "ls test_p*.db 2>/dev/null" ""
+
+###########################################################################
+# retention
+
+assert_cmd "./graphene -d . create test_r DOUBLE,retention=x" "Error: Bad timestamp: can't read seconds: x" 1
+assert_cmd "./graphene -d . create test_r DOUBLE" ""
+assert_cmd "./graphene -d . put test_r 1 1" ""
+assert_cmd "./graphene -d . put test_r 2 2" ""
+assert_cmd "./graphene -d . put test_r 3 3" ""
+assert_cmd "./graphene -d . put test_r now 4" ""
+assert_cmd "./graphene -d . trim" ""
+assert_cmd "./graphene -d . set_retention test_r 1000" ""
+assert_cmd "./graphene -d . info test_r opts" "retention 1000"
+assert_cmd "./graphene -d . --trim_chunk 0 trim" "Error: bad trim_chunk setting: 0" 1
+assert_cmd "./graphene -d . --trim_chunk 2 trim" "test_r 3"
+assert_cmd "./graphene -d . count_range test_r" "1"
+assert_cmd "./graphene -d . set_retention test_r 0" ""
+assert_cmd "./graphene -d . info test_r opts" ""
+assert_cmd "./graphene -d . delete test_r" ""
+
+# expired partitions are removed
+assert_cmd "./graphene -d . create test_r DOUBLE,partition=100,retention=1000" ""
+assert_cmd "./graphene -d . put test_r 10 1" ""
+assert_cmd "./graphene -d . put test_r 150 2" ""
+assert_cmd "./graphene -d . put test_r now 3" ""
+assert_cmd "./graphene -d . trim" "test_r 2"
+assert_cmd "ls test_r%p*.db | wc -l" "1"
+assert_cmd "./graphene -d . delete test_r" ""
+
+###########################################################################
+# archives
+
+assert_cmd "./graphene -d . create test_a DOUBLE,archive=x" "Error: Bad timestamp: can't read seconds: x" 1
+assert_cmd "./graphene -d . create test_a DOUBLE,recnum,archive=100" \
+  "Error: archive option can not be used with period, partition or recnum" 1
+assert_cmd "./graphene -d . create test_a DOUBLE" ""
+for i in 1 2 3 4 5 6 7 8 9 10; do ./graphene -d . put test_a $i $i; done
+assert_cmd "./graphene -d . archive test_a 4" "test_a 4"
+assert_cmd "./graphene -d . archive test_a 3" "test_a 0"
+assert_cmd "ls test_a%a*.gra" "test_a%a4000000000.gra"
+assert_cmd "./graphene -d . get_range test_a 0 inf 3" "1.000000000 1
+4.000000000 4
+7.000000000 7
+10.000000000 10"
+assert_cmd "./graphene -d . get_count test_a 3 3" "3.000000000 3
+4.000000000 4
+5.000000000 5"
+assert_cmd "./graphene -d . get_next test_a 0" "1.000000000 1"
+assert_cmd "./graphene -d . get_prev test_a 3.5" "3.000000000 3"
+assert_cmd "./graphene -d . get_prev test_a 4.5" "4.000000000 4"
+assert_cmd "./graphene -d . get test_a 4.5" "4.500000000 4.5"
+assert_cmd "./graphene -d . count_range test_a 2 6" "5"
+assert_cmd "./graphene -d . put test_a 2 5" "Error: test_a.db: can't modify archived data: 2.000000000" 1
+assert_cmd "./graphene -d . del_range test_a 0 5" "Error: test_a.db: can't modify archived data: 0.000000000" 1
+assert_cmd "./graphene -d . archive test_a 7.5" "test_a 3"
+assert_cmd "./graphene -d . get_range test_a 3 8" "3.000000000 3
+4.000000000 4
+5.000000000 5
+6.000000000 6
+7.000000000 7
+8.000000000 8"
+assert_cmd "./graphene -d . info test_a stats" "count 10
+first 1.000000000
+last 10.000000000
+min 1
+max 10
+sum 55
+minmax_exact 0"
+# archive files are renamed with the database
+assert_cmd "./graphene -d . rename test_a test_b" ""
+assert_cmd "ls test_a%a*.gra 2>/dev/null" ""
+assert_cmd "ls test_b%a*.gra" "test_b%a4000000000.gra
+test_b%a7500000000.gra"
+assert_cmd "./graphene -d . count_range test_b 0 inf" "10"
+assert_cmd "./graphene -d . rename test_b test_a" ""
+assert_cmd "./graphene -d . get_range test_a 0 2" "1.000000000 1
+2.000000000 2"
+# expired archives are removed by trim
+assert_cmd "./graphene -d . set_retention test_a 1000" ""
+assert_cmd "./graphene -d . trim" "test_a 10"
+assert_cmd "ls test_a%a*.gra 2>/dev/null" ""
+# archiving policy, archives are removed with the database
+assert_cmd "./graphene -d . put test_a 1 1" ""
+assert_cmd "./graphene -d . put test_a now 2" ""
+assert_cmd "./graphene -d . set_retention test_a 0" ""
+assert_cmd "./graphene -d . set_archive test_a 1000" ""
+assert_cmd "./graphene -d . info test_a opts" "archive 1000"
+assert_cmd "./graphene -d . archive_all" "test_a 1"
+assert_cmd "./graphene -d . count_range test_a" "2"
+assert_cmd "ls test_a%a*.gra | wc -l" "1"
+assert_cmd "./graphene -d . delete test_a" ""
+assert_cmd "ls test_a%a*.gra 2>/dev/null" ""
+
+###########################################################################
+# chunked del_range
+
+assert_cmd "./graphene -d . create test_d DOUBLE" ""
+for i in 1 2 3 4 5 6 7; do ./graphene -d . put test_d $i $i; done
+assert_cmd "./graphene -d . --del_chunk -1 del_range test_d 0 10" "Error: bad del_chunk setting: -1" 1
+assert_cmd "./graphene -d . --del_chunk 3 --del_pause 1 del_range test_d 2 6" "3 4.000000000
+5 6.000000000"
+assert_cmd "./graphene -d . get_range test_d" "1.000000000 1
+7.000000000 7"
+assert_cmd "./graphene -d . info test_d stats" "count 2
+first 1.000000000
+last 7.000000000
+min 1
+max 7
+sum 8
+minmax_exact 1"
+# tiny time limit: each transaction still deletes at least one point
+for i in $(seq 10 40); do ./graphene -d . put test_d $i $i; done
+./graphene -d . --del_time 1 del_range test_d 10 39 > /dev/null
+assert_cmd "./graphene -d . get_range test_d" "1.000000000 1
+7.000000000 7
+40.000000000 40"
+assert_cmd "./graphene -d . info test_d" "DOUBLE"
+assert_cmd "./graphene -d . del_range test_d 40 40" ""
+assert_cmd "./graphene -d . compact test_d | cut -d ' ' -f 1" "test_d"
+assert_cmd "./graphene -d . compact_all | grep -c test_d" "1"
+assert_cmd "./graphene -d . compact_all 0" "Error: bad compaction period: 0" 1
+assert_cmd "./graphene -d . delete test_d" ""
+
+# compaction frees pages and truncates the file after deletions
+assert_cmd "./graphene -d . create test_c" ""
+seq 20000 | awk '{print "test_c", $1, $1}' | ./graphene -d . import - > /dev/null
+s1=$(stat -c %s test_c.db)
+./graphene -d . del_range test_c 100 inf > /dev/null
+assert_cmd "./graphene -d . compact_all | awk '/^test_c / {print (\$2>0 && \$3>0)}'" "1"
+s2=$(stat -c %s test_c.db)
+[ "$s2" -lt "$s1" ] || { echo "compact_all: file was not truncated"; exit 1; }
+# periodic mode: output is flushed after each run
+assert_cmd "timeout 5 ./graphene -d . compact_all 1 | grep -m1 '^test_c ' | cut -d ' ' -f 1" "test_c"
+assert_cmd "./graphene -d . delete test_c" ""
+
+###########################################################################
+# import
+
+assert_cmd "./graphene -d . create test_i1 DOUBLE" ""
+assert_cmd "./graphene -d . create test_i2 TEXT" ""
+printf "test_i1 2 2\ntest_i1 1 1\n# comment\n\ntest_i2 1 a\ntest_i1,3,3\ntest_i1\t2\t20\n" > test_i1.tmp
+printf "test_i2 2 b\ntest_i1 4 4" > test_i2.tmp
+assert_cmd "./graphene -d . --import_threads 1 import test_i1.tmp test_i2.tmp" "test_i1 4
+test_i2 2"
+assert_cmd "./graphene -d . get_range test_i1" "1.000000000 1
+2.000000000 20
+3.000000000 3
+4.000000000 4"
+assert_cmd "./graphene -d . get_range test_i2" "1.000000000 a
+2.000000000 b"
+assert_cmd "./graphene -d . info test_i1 stats" "count 4
+first 1.000000000
+last 4.000000000
+min 1
+max 20
+sum 28
+minmax_exact 1"
+assert_cmd "printf 'import test_i1.tmp test_i2.tmp\nmetrics\n' |\
+   ./graphene -d . -i | grep '^graphene_points_written'" \
+'graphene_points_written_total{db="test_i1"} 4
+graphene_points_written_total{db="test_i2"} 2'
+assert_cmd "echo 'test_i1 0.5 0.5' | ./graphene -d . import -" "test_i1 1"
+assert_cmd "./graphene -d . count_range test_i1" "5"
+assert_cmd "echo 'test_i1 5' | ./graphene -d . import -" "Error: -: bad line: test_i1 5" 1
+assert_cmd "echo 'test_i3 5 5' | ./graphene -d . import -" "Error: test_i3.db: No such file or directory" 1
+assert_cmd "./graphene -d . delete test_i1" ""
+assert_cmd "./graphene -d . delete test_i2" ""
+rm -f test_i1.tmp test_i2.tmp
+
+###########################################################################
+# columnar snapshots
+
+assert_cmd "./graphene -d . create test_s DOUBLE" ""
+assert_cmd "./graphene -d . create test_st TEXT" ""
+assert_cmd "./graphene -d . put test_s 1 1 10" ""
+assert_cmd "./graphene -d . put test_s 2 2" ""
+assert_cmd "./graphene -d . put test_s 3 3 30" ""
+assert_cmd "./graphene -d . put test_s 4 4.5 40" ""
+assert_cmd "./graphene -d . put test_s 5 nan 50" ""
+assert_cmd "./graphene -d . export_snapshot test_s 2 inf test_s.tmp" ""
+assert_cmd "./graphene -d . snapshot_info test_s.tmp" "points 4
+columns 2
+blocks 1
+first 2.000000000
+last 5.000000000
+min 2 30
+max 4.5 50"
+# missing value and NaN value are different
+assert_cmd "./graphene -d . snapshot_get test_s.tmp" "2.000000000 2
+3.000000000 3 30
+4.000000000 4.5 40
+5.000000000 nan 50"
+assert_cmd "./graphene -d . snapshot_get test_s.tmp 2.5 3" "3.000000000 3 30"
+assert_cmd "./graphene -d . snapshot_get test_s.tmp 5" ""
+assert_cmd "./graphene -d . export_snapshot test_st 0 inf test_s.tmp" \
+  "Error: test_st.db: snapshots are not supported for TEXT databases" 1
+assert_cmd "./graphene -d . snapshot_info test_s.none" \
+  "Error: test_s.none: No such file or directory" 1
+assert_cmd "./graphene -d . delete test_s" ""
+assert_cmd "./graphene -d . delete test_st" ""
+rm -f test_s.tmp
+
+###########################################################################
+# databases in a container file
+
+assert_cmd "./graphene -d . -E none --container cnt list" \
+  "Error: container can not be used without DB environment" 1
+assert_cmd "./graphene -d . --container cnt list" ""
+assert_cmd "./graphene -d . --container cnt create test_c1 DOUBLE" ""
+assert_cmd "./graphene -d . --container cnt create test_c2 TEXT" ""
+assert_cmd "./graphene -d . --container cnt create test_c1 DOUBLE" "Error: test_c1.db: File exists" 1
+assert_cmd "./graphene -d . --container cnt put test_c1 1 10" ""
+assert_cmd "./graphene -d . --container cnt put test_c2 1 text" ""
+assert_cmd "./graphene -d . --container cnt list" "test_c1
+test_c2"
+assert_cmd "./graphene -d . --container cnt get_range test_c1" "1.000000000 10"
+assert_cmd "./graphene -d . --container cnt rename test_c1 test_c2" \
+  "Error: renaming test_c1.db -> test_c2.db: Destination exists" 1
+assert_cmd "./graphene -d . --container cnt rename test_c1 test_c3" ""
+assert_cmd "./graphene -d . --container cnt get_next test_c3" "1.000000000 10"
+assert_cmd "./graphene -d . --container cnt delete test_c2" ""
+assert_cmd "./graphene -d . --container cnt list" "test_c3"
+assert_cmd "./graphene -d . --container cnt delete test_c3" ""
+assert_cmd "./graphene -d . --container cnt list" ""
+rm -f cnt.db
+
 ###########################################################################
 # TEXT database
 assert_cmd "./graphene -d . create test_4 TEXT" ""
@@ -375,6 +933,24 @@ assert_cmd "./graphene -d . get_range test_4 1000 2000" "1000.000000000 text1
 assert_cmd "./graphene -d . get_range test_4 1000 2000 1000" "1000.000000000 text1
 2000.000000000 text2"
 assert_cmd "./graphene -d . get_range test_4 1000 2000 1001" "1000.000000000 text1"
+# all scan strategies give same results
+for m in auto seek next; do
+  assert_cmd "./graphene -d . --scan_mode $m get_range test_4 1000 2000 1001" "1000.000000000 text1"
+done
+assert_cmd "./graphene -d . --scan_mode fast list" "Error: bad scan_mode setting: fast" 1
+
+# only beginning of the text is read in list mode
+assert_cmd "./graphene -d . --list_len 3 get_range test_4" "1000.000000000 tex
+2000.000000000 tex"
+assert_cmd "./graphene -d . --list_len 3 get_count test_4 1500" "2000.000000000 tex"
+assert_cmd "./graphene -d . --list_len 3 get_next test_4 1500" "2000.000000000 text2
+2"
+assert_cmd "./graphene -d . --list_len 0 get_range test_4 2000" "2000.000000000 text2"
+# a cut UTF-8 character is removed (3 bytes of "тест" -> "т")
+assert_cmd "./graphene -d . put test_4 3000 тест" ""
+assert_cmd "./graphene -d . --list_len 3 get_range test_4 3000" "3000.000000000 т"
+assert_cmd "./graphene -d . del test_4 3000" ""
+assert_cmd "./graphene -d . --list_len -1 get_range test_4" "Error: bad list_len setting: -1" 1
 
 # columns are not important
 assert_cmd "./graphene -d . get_next test_4:5" "1000.000000000 text1"
@@ -484,8 +1060,28 @@ db_dump test_2.db > test_3.tmp
 assert_cmd "diff test_2.tmp test_1.tmp" ""
 assert_cmd "diff test_2.tmp test_3.tmp" ""
 
+# binary dump
+assert_cmd "./graphene -d . dump_bin test_1 test_b.tmp gzip" "Error: unknown compression: gzip" 1
+assert_cmd "./graphene -d . dump_bin test_1 test_b.tmp" ""
+assert_cmd "./graphene -d . load_bin test_3 test_b.tmp" ""
+assert_cmd "./graphene -d . dump_bin test_1 - zlib | ./graphene -d . load_bin test_4 -" ""
+./graphene -d . dump test_3 test_3.tmp
+./graphene -d . dump test_4 test_4.tmp
+assert_cmd "diff test_1.tmp test_3.tmp" ""
+assert_cmd "diff test_1.tmp test_4.tmp" ""
+assert_cmd "./graphene -d . load_bin test_3 test_b.tmp" "Error: test_3.db: File exists" 1
+assert_cmd "./graphene -d . load_bin test_5 test_1.tmp" "Error: test_1.tmp: not a graphene binary dump" 1
+assert_cmd "ls test_5.db 2>/dev/null | wc -l" "0"
+# damaged block
+printf "\377" | dd of=test_b.tmp bs=1 count=1 conv=notrunc seek=$(($(stat -c %s test_b.tmp)-20)) 2>/dev/null
+assert_cmd "./graphene -d . load_bin test_5 test_b.tmp" "Error: test_b.tmp: checksum error" 1
+assert_cmd "ls test_5.db 2>/dev/null | wc -l" "0"
+assert_cmd "./graphene -d . list | grep -c test_5" "0" 1
+
 assert_cmd "./graphene -d . delete test_1" ""
 assert_cmd "./graphene -d . delete test_2" ""
+assert_cmd "./graphene -d . delete test_3" ""
+assert_cmd "./graphene -d . delete test_4" ""
 
 rm -f test_*.tmp
 
@@ -567,6 +1163,51 @@ assert_cmd "./graphene -d . backup_print test_1" "1234.000000000"
 
 assert_cmd "./graphene -d . delete test_1" ""
 
+# native incremental backup
+rm -rf test_bk1 test_bk2 test_inc
+mkdir test_bk1 test_bk2 test_inc
+assert_cmd "./graphene -d test_bk1 create test_1 DOUBLE descr1" ""
+assert_cmd "./graphene -d test_bk1 create test_2 TEXT" ""
+for i in 1 2 3; do ./graphene -d test_bk1 put test_1 $i $i; done
+assert_cmd "./graphene -d test_bk1 put test_2 1 abc" ""
+# description with a newline and a backslash
+./graphene -d test_bk1 set_descr test_2 "$(printf 'l1\nl2\\n')"
+assert_cmd "./graphene -d test_bk1 backup test_1 test_none" "Error: test_none: No such file or directory" 1
+assert_cmd "./graphene -d test_bk1 backup all test_inc" "test_1 3
+test_2 1"
+assert_cmd "./graphene -d test_bk1 backup_print test_1" "4294967295.999999999"
+# only the modified range is written
+assert_cmd "./graphene -d test_bk1 put test_1 4 4" ""
+assert_cmd "./graphene -d test_bk1 del test_1 2" ""
+assert_cmd "./graphene -d test_bk1 backup all test_inc" "test_1 2
+test_2 0"
+assert_cmd "ls test_inc" "test_1.1.grinc
+test_1.2.grinc
+test_2.1.grinc
+test_2.2.grinc"
+
+assert_cmd "./graphene -d test_bk2 restore test_3 test_inc" "Error: test_inc: no increments for database test_3" 1
+assert_cmd "./graphene -d test_bk2 restore all test_inc" "test_1 5
+test_2 1"
+assert_cmd "ls test_inc" ""
+assert_cmd "./graphene -d test_bk2 get_range test_1 0 inf" "1.000000000 1
+3.000000000 3
+4.000000000 4"
+assert_cmd "./graphene -d test_bk2 get_range test_2 0 inf" "1.000000000 abc"
+assert_cmd "./graphene -d test_bk2 info test_1" "DOUBLE	descr1"
+[ "$(./graphene -d test_bk2 info test_2)" = "$(printf 'TEXT\tl1\nl2\\n')" ] ||
+  { echo "wrong description after restore"; exit 1; }
+
+# wrong data type, broken file
+assert_cmd "./graphene -d test_bk1 put test_1 5 5" ""
+assert_cmd "./graphene -d test_bk1 backup test_1 test_inc" "test_1 1"
+assert_cmd "./graphene -d test_bk2 delete test_1" ""
+assert_cmd "./graphene -d test_bk2 create test_1 INT32" ""
+assert_cmd "./graphene -d test_bk2 restore test_1 test_inc" "Error: test_inc/test_1.1.grinc: data type differs from test_1.db" 1
+echo "broken file" > test_inc/test_3.1.grinc
+assert_cmd "./graphene -d test_bk2 restore test_3 test_inc" "Error: test_inc/test_3.1.grinc: not a graphene increment" 1
+rm -rf test_bk1 test_bk2 test_inc
+
 ###########################################################################
 ## input filter
 assert_cmd "./graphene -d . create test_1 DOUBLE" ""
@@ -645,6 +1286,22 @@ assert_cmd "./graphene -d . print_filter test_1 5" "$code"
 assert_cmd "./graphene -d . get_range test_1:f5" \
 "Error: filter: can't get time value: can't read \"time\": no such variable" 1
 
+###########################################################################
+## filter and query limits
+code='while 1 {incr x}; return 1'
+./graphene -d . set_filter test_1 6 "$code"
+
+assert_cmd "./graphene --filter_time 100 -d . get_range test_1:f6" \
+"Error: filter: time limit exceeded" 1
+
+assert_cmd "./graphene --query_time 100 -d . get_range test_1:f6" \
+"Error: filter: time limit exceeded" 1
+
+code='proc f {} {f}; f'
+./graphene -d . set_filter test_1 6 "$code"
+assert_cmd "./graphene --filter_cmds 100 -d . get_range test_1:f6" \
+"Error: filter: command count limit exceeded" 1
+
 
 ###########################################################################
 ## graphene_get command in a filter